@@ -68,7 +68,13 @@ int main()
     auto r = cam.snap(CaptureMode::NonAFCapt, 1);
 
     // 5) Wait to complete shooting
-    CamCaptStatus st = cam.wait_completion(0, 50, 200);
+    WaitPolicy wait;
+    wait.timeout = std::chrono::seconds(10);
+    WaitStats ws;
+    CamCaptStatus st = cam.wait_completion(0, wait, &ws);
+    LOG_INFO("Capture took %lld ms (shoot %lld ms, image gen %lld ms, %d polls)",
+             (long long)ws.total.count(), (long long)ws.shoot_ms.count(),
+             (long long)ws.image_gen_ms.count(), ws.polls);
     LOG_INFO("CamCaptStatus: id=%u head=%u tail=%u code=0x%04X dest=0x%02X",
              st.ImageId, st.ImageDBHead, st.ImageDBTail, st.Status, st.Dest);
 
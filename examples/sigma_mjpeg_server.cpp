@@ -0,0 +1,333 @@
+// Serves the live view as MJPEG (multipart/x-mixed-replace) on localhost.
+//
+//   sigma_mjpeg_server [port=8080] [fps=15]
+//   then open http://127.0.0.1:8080/ in a browser or `ffplay`.
+//
+// One LiveViewEngine fetches frames; each new frame is copied once into a
+// shared buffer and every client sends from that same buffer with
+// sendmsg(). A client holds at most the frame it is sending plus the newest
+// one after it; a slow client skips frames instead of queueing them.
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "ptp/usb_transport.h"
+#include "sigma/live_view.h"
+#include "sigma/sigma_ptp.h"
+#include "utils/log.h"
+
+static const char kBoundary[] = "sigmaframe";
+
+struct Frame
+{
+  std::string head; // part boundary and headers
+  std::vector<std::uint8_t> jpeg;
+};
+using FramePtr = std::shared_ptr<const Frame>;
+
+struct Client
+{
+  int fd{-1};
+  std::string request; // until the blank line
+  bool streaming{false};
+  std::string reply; // response header, sent ahead of the first frame
+  std::size_t reply_off{0};
+  FramePtr cur;  // being sent
+  FramePtr next; // newest frame after cur
+  std::size_t off{0}; // bytes of cur already sent
+  bool want_out{false};
+  std::uint64_t sent{0};
+  std::uint64_t skipped{0};
+};
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void on_signal(int) { g_stop = 1; }
+
+static int listen_on(int port)
+{
+  const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(std::uint16_t(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local tools only
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 || listen(fd, 16) != 0)
+    throw std::runtime_error(std::string("bind/listen: ") + std::strerror(errno));
+  return fd;
+}
+
+static void watch_out(int ep, Client &c, bool on)
+{
+  if (c.want_out == on)
+    return;
+  c.want_out = on;
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLRDHUP | (on ? EPOLLOUT : 0u);
+  ev.data.fd = c.fd;
+  epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+// Sends as much as the socket takes. False if the client is gone.
+static bool flush(int ep, Client &c)
+{
+  static const char kTail[] = "\r\n";
+  for (;;)
+  {
+    iovec iov[4];
+    int n = 0;
+    if (c.reply_off < c.reply.size())
+      iov[n++] = {&c.reply[c.reply_off], c.reply.size() - c.reply_off};
+    if (c.cur)
+    {
+      // the frame is head + jpeg + tail; skip what was already sent
+      const std::pair<const void *, std::size_t> parts[] = {
+          {c.cur->head.data(), c.cur->head.size()},
+          {c.cur->jpeg.data(), c.cur->jpeg.size()},
+          {kTail, 2}};
+      std::size_t skip = c.off;
+      for (const auto &p : parts)
+      {
+        if (skip >= p.second)
+        {
+          skip -= p.second;
+          continue;
+        }
+        iov[n++] = {const_cast<char *>(static_cast<const char *>(p.first)) + skip,
+                    p.second - skip};
+        skip = 0;
+      }
+    }
+    if (n == 0)
+    {
+      watch_out(ep, c, false);
+      return true;
+    }
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = std::size_t(n);
+    const ssize_t w = sendmsg(c.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        watch_out(ep, c, true);
+        return true;
+      }
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    std::size_t left = std::size_t(w);
+    const std::size_t r = std::min(left, c.reply.size() - c.reply_off);
+    c.reply_off += r;
+    left -= r;
+    if (c.cur)
+    {
+      c.off += left;
+      if (c.off == c.cur->head.size() + c.cur->jpeg.size() + 2)
+      {
+        ++c.sent;
+        c.cur = std::move(c.next);
+        c.off = 0;
+      }
+    }
+  }
+}
+
+static void drop(int ep, std::unordered_map<int, Client> &clients, int fd)
+{
+  auto it = clients.find(fd);
+  if (it == clients.end())
+    return;
+  LOG_INFO("client %d: closed after %llu frames (%llu skipped)", fd,
+           (unsigned long long)it->second.sent, (unsigned long long)it->second.skipped);
+  epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  clients.erase(it);
+}
+
+int main(int argc, char **argv)
+{
+  const int port = argc > 1 ? std::atoi(argv[1]) : 8080;
+  const double fps = argc > 2 ? std::atof(argv[2]) : 15.0;
+  log_set_level(LogLevel::Info);
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  try
+  {
+    USBTransport usb;
+    usb.open_first();
+
+    SigmaCamera cam(usb);
+    cam.open_session(1);
+    cam.config_api();
+
+    LiveViewOptions opt;
+    opt.target_fps = fps;
+    LiveViewEngine lv(cam, opt);
+
+    const int lfd = listen_on(port);
+    const int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event lev{};
+    lev.events = EPOLLIN;
+    lev.data.fd = lfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &lev);
+    LOG_INFO("MJPEG on http://127.0.0.1:%d/ at up to %.1f fps", port, fps);
+
+    std::unordered_map<int, Client> clients;
+    std::size_t streaming = 0;
+    lv.start();
+
+    // frames are picked up between socket events; half a frame period keeps
+    // the added latency below one frame
+    const int tick_ms = std::max(1, int(500.0 / (fps > 0 ? fps : 15.0)));
+    epoll_event evs[64];
+    while (!g_stop)
+    {
+      const int n = epoll_wait(ep, evs, 64, tick_ms);
+      if (n < 0 && errno != EINTR)
+        throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+
+      for (int i = 0; i < n; ++i)
+      {
+        const int fd = evs[i].data.fd;
+        if (fd == lfd)
+        {
+          int cfd;
+          while ((cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+          {
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = cfd;
+            epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &ev);
+            clients[cfd].fd = cfd;
+          }
+          continue;
+        }
+
+        auto it = clients.find(fd);
+        if (it == clients.end())
+          continue;
+        Client &c = it->second;
+        bool gone = evs[i].events & (EPOLLERR | EPOLLHUP);
+
+        if (!gone && (evs[i].events & EPOLLIN))
+        {
+          char buf[2048];
+          const ssize_t r = recv(fd, buf, sizeof buf, 0);
+          if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR))
+            gone = true;
+          else if (r > 0 && !c.streaming)
+          {
+            c.request.append(buf, std::size_t(r));
+            if (c.request.find("\r\n\r\n") != std::string::npos)
+            {
+              if (c.request.compare(0, 4, "GET ") != 0)
+                gone = true;
+              else
+              {
+                c.streaming = true;
+                ++streaming;
+                c.request.clear();
+                c.reply = std::string("HTTP/1.0 200 OK\r\n"
+                                      "Cache-Control: no-cache, no-store\r\n"
+                                      "Connection: close\r\n"
+                                      "Content-Type: multipart/x-mixed-replace; boundary=") +
+                          kBoundary + "\r\n\r\n";
+                gone = !flush(ep, c);
+              }
+            }
+            else if (c.request.size() > 8192)
+              gone = true;
+          }
+          // anything a streaming client sends is ignored
+        }
+        if (!gone && (evs[i].events & EPOLLOUT))
+          gone = !flush(ep, c);
+        if (gone)
+        {
+          if (c.streaming)
+            --streaming;
+          drop(ep, clients, fd);
+        }
+      }
+
+      bool is_new = false;
+      const LiveFrame *lf = lv.acquire(&is_new);
+      if (!lf || !is_new || streaming == 0)
+        continue;
+
+      // the only copy: out of the engine's slot, which it will reuse
+      auto f = std::make_shared<Frame>();
+      f->head = std::string("--") + kBoundary +
+                "\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                std::to_string(lf->size()) + "\r\n\r\n";
+      f->jpeg.assign(lf->data(), lf->data() + lf->size());
+      const FramePtr frame = std::move(f);
+
+      std::vector<int> dead;
+      for (auto &kv : clients)
+      {
+        Client &c = kv.second;
+        if (!c.streaming)
+          continue;
+        if (c.cur)
+        {
+          if (c.next)
+            ++c.skipped; // never started; replaced by a newer one
+          c.next = frame;
+          continue;
+        }
+        c.cur = frame;
+        c.off = 0;
+        if (!flush(ep, c))
+          dead.push_back(kv.first);
+      }
+      for (int fd : dead)
+      {
+        --streaming;
+        drop(ep, clients, fd);
+      }
+    }
+
+    LOG_INFO("stopping");
+    lv.stop();
+    const LiveViewStats st = lv.stats();
+    LOG_INFO("live view: %llu fetched, %llu published, %llu errors",
+             (unsigned long long)st.fetched, (unsigned long long)st.published,
+             (unsigned long long)st.errors);
+    while (!clients.empty())
+      drop(ep, clients, clients.begin()->first);
+    close(ep);
+    close(lfd);
+
+    cam.close_application();
+    cam.close_session();
+    usb.close();
+    return 0;
+  }
+  catch (const std::exception &e)
+  {
+    LOG_ERROR("Error: %s", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Membership set for one PTP code space: the standard page (e.g. 0x10xx for
+// operations) and the vendor page (e.g. 0x90xx). A lookup is one bit test.
+class CodeSet {
+    public:
+        CodeSet(std::uint16_t std_base, std::uint16_t vendor_base)
+            : std_base_(std_base), vendor_base_(vendor_base) {}
+
+        void set(std::uint16_t code) {
+            if ((code & 0xFF00) == std_base_)         std_.set(code & 0xFF);
+            else if ((code & 0xFF00) == vendor_base_) vendor_.set(code & 0xFF);
+        }
+        bool test(std::uint16_t code) const {
+            if ((code & 0xFF00) == std_base_)    return std_.test(code & 0xFF);
+            if ((code & 0xFF00) == vendor_base_) return vendor_.test(code & 0xFF);
+            return false;
+        }
+        void reset() { std_.reset(); vendor_.reset(); }
+
+    private:
+        std::uint16_t std_base_, vendor_base_;
+        std::bitset<256> std_, vendor_;
+};
+
+// ---------- DeviceInfo (decode-only, ISO 15740 5.5.1) ----------
+class DeviceInfo
+{
+public:
+    std::uint16_t StandardVersion{0};
+    std::uint32_t VendorExtensionID{0};
+    std::uint16_t VendorExtensionVersion{0};
+    std::string VendorExtensionDesc;
+    std::uint16_t FunctionalMode{0};
+    std::vector<std::uint16_t> OperationsSupported;
+    std::vector<std::uint16_t> EventsSupported;
+    std::vector<std::uint16_t> DevicePropertiesSupported;
+    std::vector<std::uint16_t> CaptureFormats;
+    std::vector<std::uint16_t> ImageFormats;
+    std::string Manufacturer;
+    std::string Model;
+    std::string DeviceVersion;
+    std::string SerialNumber;
+
+    void decode(const std::vector<std::uint8_t> &raw);
+
+    bool supports_operation(std::uint16_t op) const { return ops_.test(op); }
+    bool supports_event(std::uint16_t code) const { return events_.test(code); }
+    bool supports_property(std::uint16_t prop) const { return props_.test(prop); }
+
+private:
+    CodeSet ops_{0x1000, 0x9000};
+    CodeSet events_{0x4000, 0xC000};
+    CodeSet props_{0x5000, 0xD000};
+};
+
+// Raw GetDeviceInfo datasets on disk, one file per body (model, firmware
+// and serial number: units of one model and firmware may still differ in
+// what they report, e.g. after a paid feature unlock).
+class DeviceInfoCache
+{
+public:
+    explicit DeviceInfoCache(std::string dir) : dir_(std::move(dir)) {}
+
+    std::optional<std::vector<std::uint8_t>> load(const std::string &key) const;
+    void store(const std::string &key, const std::vector<std::uint8_t> &raw) const;
+
+    // "<model>_<firmware>_<serial>" with anything outside [A-Za-z0-9._-]
+    // replaced.
+    static std::string make_key(const std::string &model, const std::string &firmware,
+                                const std::string &serial);
+
+private:
+    std::string path_(const std::string &key) const;
+
+    std::string dir_;
+};
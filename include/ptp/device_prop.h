@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ptp/event_monitor.h"
+
+class CameraPTP;
+
+// ISO 15740 datatype codes (5.3)
+enum : std::uint16_t {
+    PTP_DTC_UNDEF   = 0x0000,
+    PTP_DTC_INT8    = 0x0001,
+    PTP_DTC_UINT8   = 0x0002,
+    PTP_DTC_INT16   = 0x0003,
+    PTP_DTC_UINT16  = 0x0004,
+    PTP_DTC_INT32   = 0x0005,
+    PTP_DTC_UINT32  = 0x0006,
+    PTP_DTC_INT64   = 0x0007,
+    PTP_DTC_UINT64  = 0x0008,
+    PTP_DTC_INT128  = 0x0009,
+    PTP_DTC_UINT128 = 0x000A,
+    PTP_DTC_ARRAY   = 0x4000, // OR-ed onto a scalar code: AINT8 .. AUINT128
+    PTP_DTC_STR     = 0xFFFF,
+};
+
+// One value of any PTP datatype.
+class PropValue
+{
+public:
+    std::uint16_t Type{PTP_DTC_UNDEF};
+    std::uint64_t Bits{0};           // integers, sign-extended; low half of 128-bit
+    std::uint64_t High{0};           // high half of INT128 / UINT128
+    std::vector<PropValue> Elements; // arrays
+    std::string Str;                 // STR, as UTF-8
+
+    bool is_string() const { return Type == PTP_DTC_STR; }
+    bool is_array() const { return Type != PTP_DTC_STR && (Type & PTP_DTC_ARRAY); }
+    bool is_signed() const;
+    std::int64_t as_int() const { return std::int64_t(Bits); }
+    std::uint64_t as_uint() const { return Bits; }
+
+    // Wire form, e.g. for SetDevicePropValue.
+    std::vector<std::uint8_t> encode() const;
+    void encode(std::vector<std::uint8_t> &out) const;
+    static PropValue decode(std::uint16_t type, const std::vector<std::uint8_t> &raw,
+                            std::size_t &i);
+
+    static PropValue of_int(std::uint16_t type, std::int64_t v);
+    static PropValue of_uint(std::uint16_t type, std::uint64_t v);
+    static PropValue of_str(std::string s);
+
+    bool operator==(const PropValue &o) const;
+    bool operator!=(const PropValue &o) const { return !(*this == o); }
+    // Signed/unsigned aware; 128-bit values compare on both halves.
+    bool less(const PropValue &o) const;
+};
+
+// ---------- DevicePropDesc (decode-only, ISO 15740 5.5.3) ----------
+class DevicePropDesc
+{
+public:
+    enum : std::uint8_t { FormNone = 0, FormRange = 1, FormEnum = 2 };
+
+    std::uint16_t PropertyCode{0};
+    std::uint16_t DataType{PTP_DTC_UNDEF};
+    std::uint8_t GetSet{0}; // 0 = read-only, 1 = read/write
+    PropValue FactoryDefaultValue;
+    PropValue CurrentValue;
+    std::uint8_t FormFlag{FormNone};
+    PropValue RangeMin;  // FormRange
+    PropValue RangeMax;
+    PropValue RangeStep;
+    std::vector<PropValue> Enumeration; // FormEnum
+
+    void decode(const std::vector<std::uint8_t> &raw);
+
+    bool writable() const { return GetSet == 1; }
+    // Type matches and the value is inside the range (on a step) or listed.
+    bool accepts(const PropValue &v) const;
+};
+
+// Descriptors fetched once per session.
+//
+// GetDevicePropDesc is only issued on a miss; a DevicePropChanged event
+// drops that property's entry, and DeviceReset, a session recovery or
+// clear() drop them all.
+class DevicePropCache
+{
+public:
+    explicit DevicePropCache(CameraPTP &cam);
+    ~DevicePropCache();
+
+    DevicePropCache(const DevicePropCache &) = delete;
+    DevicePropCache &operator=(const DevicePropCache &) = delete;
+
+    DevicePropDesc get(std::uint16_t code);
+    bool cached(std::uint16_t code) const;
+
+    // Validate against the descriptor, send SetDevicePropValue and update
+    // the cached current value. Throws on a value the camera would refuse.
+    std::uint16_t set(std::uint16_t code, const PropValue &v);
+
+    void invalidate(std::uint16_t code);
+    void clear();
+
+private:
+    void on_event_(const PtpEvent &ev);
+
+    CameraPTP &cam_;
+    int listener_id_{0};
+
+    mutable std::mutex mu_;
+    std::map<std::uint16_t, DevicePropDesc> descs_;
+    std::uint32_t recoveries_seen_{0};
+    std::uint64_t epoch_{0}; // bumped by every invalidation
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "utils/sink.h"
+
+class CameraPTP;
+
+struct DownloadOptions
+{
+    std::uint32_t chunk_bytes{1024 * 1024}; // GetPartialObject request size
+    std::size_t queue_depth{4};              // chunks buffered between USB and disk
+    std::uint64_t checkpoint_bytes{8 * 1024 * 1024}; // fsync interval of download_to_file
+};
+
+// Per-stage timings of one download. "stall" is time a stage spent blocked
+// on the other one: a large usb_stall_ms means the disk is the bottleneck,
+// a large write_stall_ms means USB is.
+struct DownloadStats
+{
+    std::uint64_t bytes{0};
+    std::uint32_t chunks{0};
+    double total_ms{0};
+    double usb_ms{0};
+    double usb_stall_ms{0};
+    double write_ms{0};
+    double write_stall_ms{0};
+
+    double mb_per_s() const { return total_ms > 0 ? bytes / (total_ms * 1e3) : 0; }
+    double usb_mb_per_s() const { return usb_ms > 0 ? bytes / (usb_ms * 1e3) : 0; }
+    double write_mb_per_s() const { return write_ms > 0 ? bytes / (write_ms * 1e3) : 0; }
+};
+
+// Chunked GetPartialObject download with overlapped disk writes.
+//
+// The calling thread issues the USB requests; a writer thread drains a
+// bounded queue into the sink, so chunk N+1 is on the wire while chunk N is
+// being written.
+class ObjectDownloader
+{
+public:
+    explicit ObjectDownloader(CameraPTP &cam, DownloadOptions opt = {})
+        : cam_(cam), opt_(opt) {}
+
+    // Size is taken from GetObjectInfo.
+    DownloadStats download(std::uint32_t handle, ByteSink &sink);
+    // Bytes [offset, size) of the object.
+    DownloadStats download(std::uint32_t handle, std::uint32_t size,
+                           ByteSink &sink, std::uint32_t offset = 0);
+
+    // Download into `path`, resuming from "<path>.part" when a previous
+    // attempt for the same object was interrupted. `stats.bytes` only
+    // counts what this call transferred.
+    DownloadStats download_to_file(std::uint32_t handle, const std::string &path);
+
+private:
+    CameraPTP &cam_;
+    DownloadOptions opt_;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "ptp/transport.h"
+
+// Decoded EVENT container as received on the interrupt IN pipe.
+struct PtpEvent
+{
+    std::uint16_t code{0};
+    std::uint32_t transaction_id{0};
+    std::vector<std::uint32_t> params; // 0..3 parameters
+
+    // Returns std::nullopt if the bytes are not a complete EVENT container.
+    static std::optional<PtpEvent> parse(const std::uint8_t* p, std::size_t n);
+};
+
+using EventPredicate = std::function<bool(const PtpEvent&)>;
+using EventListener  = std::function<void(const PtpEvent&)>;
+
+// Background reader of the interrupt pipe.
+//
+// Events are decoded on a dedicated thread and kept in a short backlog, so a
+// waiter blocks on a condition variable and wakes as soon as the event lands
+// instead of slicing its timeout into blocking reads. Listeners see every
+// event, in arrival order, on the monitor thread.
+class EventMonitor {
+    public:
+        explicit EventMonitor(Transport& t, std::size_t backlog = 64);
+        ~EventMonitor();
+
+        EventMonitor(const EventMonitor&) = delete;
+        EventMonitor& operator=(const EventMonitor&) = delete;
+
+        // slice_ms only bounds how long stop() may take; wakeup latency is
+        // that of the interrupt transfer itself.
+        void start(unsigned slice_ms = 100);
+        void stop();
+        bool running() const;
+
+        // Wait for (and consume) the oldest backlog event matching `pred`
+        // that arrived at or after `since`; older ones are left alone. An
+        // empty predicate matches any event. The predicate runs without
+        // the monitor lock held, so it may issue PTP transactions.
+        std::optional<PtpEvent> wait(const EventPredicate& pred,
+                                     std::chrono::milliseconds timeout,
+                                     std::chrono::steady_clock::time_point since = {});
+
+        // Listeners run on the monitor thread; they must not call
+        // remove_listener() or stop().
+        int  add_listener(EventListener l);
+        void remove_listener(int id);
+
+        // Drop every pending event.
+        void clear();
+
+    private:
+        struct Entry {
+            std::uint64_t seq;
+            std::chrono::steady_clock::time_point at; // received
+            PtpEvent ev;
+        };
+
+        void run_(unsigned slice_ms);
+        void push_(PtpEvent ev);
+
+        Transport& transport_;
+        const std::size_t backlog_;
+
+        mutable std::mutex mu_;
+        std::condition_variable cv_;
+        std::deque<Entry> queue_;
+        std::uint64_t next_seq_{1};
+        bool stop_{false};
+        std::thread thread_;
+
+        std::mutex listeners_mu_;
+        std::vector<std::pair<int, EventListener>> listeners_;
+        int next_listener_id_{1};
+};
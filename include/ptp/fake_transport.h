@@ -4,9 +4,13 @@
 #include "ptp/ptp.h"
 #include "ptp/transport.h"
 #include <algorithm>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 
@@ -21,6 +25,25 @@ public:
   // optional RX queue (useful for future data-in tests)
   void queue_read(const std::vector<uint8_t> &v);
 
+  // canned DATA phase: each command with `opcode` is answered with
+  // DATA(payload) + OK carrying the command's transaction id
+  void respond_data(uint16_t opcode, const std::vector<uint8_t> &payload);
+  // same, with the payload computed from the command parameters
+  using DataHandler = std::function<std::vector<uint8_t>(const std::vector<uint32_t> &params)>;
+  void respond_with(uint16_t opcode, DataHandler handler);
+
+  // answer the next command with `opcode` with a bare `response_code`;
+  // repeated fail_next/drop_next calls apply to successive commands
+  void fail_next(uint16_t opcode, uint16_t response_code);
+  // leave the next command with `opcode` unanswered (the host times out)
+  void drop_next(uint16_t opcode);
+
+  // number of COMMAND containers written with `opcode`
+  std::size_t command_count(uint16_t opcode) const;
+
+  // interrupt IN queue; read_intr blocks up to its timeout like libusb does
+  void queue_event(const std::vector<uint8_t> &v);
+
   // Transport API
   void open_first() override ;
   void open_vid_pid(uint16_t, uint16_t) override;
@@ -38,7 +61,16 @@ private:
 
   bool open_{true};
   std::deque<uint8_t> rx;
-  std::deque<uint8_t> ev_;
+  std::size_t rx_left_{0}; // bytes left in the container at the head of rx
+  std::size_t rx_len_{0};  // its total length; 0 for raw bytes
+  bool zlp_pending_{false};
+  static constexpr std::size_t kPacket = 512; // high-speed bulk packet
+  std::map<uint16_t, DataHandler> canned_;
+  std::map<uint16_t, std::deque<uint16_t>> fail_next_; // queued per opcode
+  std::deque<std::vector<uint8_t>> ev_;
+  std::mutex ev_mu_;
+  std::condition_variable ev_cv_;
   uint32_t last_txn{0};
+  uint32_t answered_txn_{0}; // auto OK is sent once per transaction
   bool auto_ok{true}; // always on; no setter needed
 };
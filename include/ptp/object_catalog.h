@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ptp/event_monitor.h"
+
+class CameraPTP;
+
+// ---------- ObjectInfo (decode-only, ISO 15740 5.5.2) ----------
+class ObjectInfo
+{
+public:
+    std::uint32_t StorageID{0};
+    std::uint16_t ObjectFormat{0};
+    std::uint16_t ProtectionStatus{0};
+    std::uint32_t ObjectCompressedSize{0};
+    std::uint16_t ThumbFormat{0};
+    std::uint32_t ThumbCompressedSize{0};
+    std::uint32_t ThumbPixWidth{0};
+    std::uint32_t ThumbPixHeight{0};
+    std::uint32_t ImagePixWidth{0};
+    std::uint32_t ImagePixHeight{0};
+    std::uint32_t ImageBitDepth{0};
+    std::uint32_t ParentObject{0};
+    std::uint16_t AssociationType{0};
+    std::uint32_t AssociationDesc{0};
+    std::uint32_t SequenceNumber{0};
+    std::string Filename;
+    std::string CaptureDate;      // "YYYYMMDDThhmmss[.s]"
+    std::string ModificationDate;
+    std::string Keywords;
+
+    void decode(const std::vector<std::uint8_t> &raw);
+};
+
+// Compact per-object record kept by the catalog.
+struct ObjectEntry
+{
+    std::uint32_t handle{0};
+    std::uint32_t storage{0};
+    std::uint16_t format{0};
+    std::uint32_t size{0};
+    std::string filename;
+    std::string capture_date;
+};
+
+// Cached listing of every object on the body.
+//
+// build() costs one GetObjectHandles per storage plus one GetObjectInfo per
+// object; afterwards ObjectAdded / ObjectRemoved / ObjectInfoChanged events
+// are queued by the EventMonitor and refresh() only touches those handles.
+// Store and reset events force a rebuild. Entries live in an open-addressing
+// table (linear probing, backward-shift delete), keyed by handle.
+class ObjectCatalog
+{
+public:
+    explicit ObjectCatalog(CameraPTP &cam);
+    ~ObjectCatalog();
+
+    ObjectCatalog(const ObjectCatalog &) = delete;
+    ObjectCatalog &operator=(const ObjectCatalog &) = delete;
+
+    void build();
+    // Apply queued events (or build() when stale). Returns the number of
+    // GetObjectInfo round trips it needed.
+    std::size_t refresh();
+
+    std::optional<ObjectEntry> find(std::uint32_t handle) const;
+    std::vector<ObjectEntry> list() const; // unordered snapshot
+    std::size_t size() const;
+    void for_each(const std::function<void(const ObjectEntry &)> &fn) const;
+
+private:
+    void on_event_(const PtpEvent &ev);
+    bool fetch_(std::uint32_t handle, ObjectEntry &out);
+
+    // flat table; caller holds mu_
+    std::size_t slot_(std::uint32_t handle) const;
+    void insert_(ObjectEntry e);
+    void erase_(std::uint32_t handle);
+    void rehash_(std::size_t cap);
+
+    CameraPTP &cam_;
+    int listener_id_{0};
+
+    mutable std::mutex mu_;
+    std::vector<ObjectEntry> slots_; // handle 0 marks an empty slot
+    std::size_t count_{0};
+    std::vector<std::uint32_t> pending_; // handles to (re)fetch or drop
+    bool stale_{true};
+};
@@ -1,8 +1,17 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 #include <cstdint>
+#include <functional>
 
+#include "ptp/device_info.h"
+#include "ptp/event_monitor.h"
 #include "ptp/transport.h"
 #include "utils/utils.h"
 
@@ -108,6 +117,10 @@ struct PtpContainerHeader {
 };
 #pragma pack(pop)
 
+// Fills `buf` with up to `max` bytes of an outgoing data phase and returns
+// how many it wrote; 0 means the source is exhausted.
+using DataProducer = std::function<std::size_t(std::uint8_t* buf, std::size_t max)>;
+
 class CameraPTP {
     public:
         virtual ~CameraPTP() = default;
@@ -120,15 +133,85 @@ class CameraPTP {
             std::uint16_t response_code{0};
             std::vector<std::uint32_t> params;
             std::vector<std::uint8_t>  data;
+            std::size_t data_offset{0}; // payload start in `data`; see transact_in_place
         };
 
-        // core transaction
+        // core transaction; serialised, so helper threads (thumbnail
+        // prefetch, catalog refresh) may share the session. On SessionNotOpen
+        // or IncompleteTransfer the session is recovered and the op replayed
+        // once when safe. A transport error (e.g. a timeout) during an
+        // idempotent op first gets a resync and one retry; only if that
+        // fails too is the session recovered.
         virtual Response transact(std::uint16_t opcode,
                                     const std::vector<std::uint32_t>& params = {},
                                     const std::vector<std::uint8_t>* data_out = nullptr,
                                     bool expect_data_in = false);
+        // Same for an op with a data-in phase read where it lands: a big
+        // DATA container is handed over whole, header included, and the
+        // payload starts at `data_offset` (0 when a small one was copied).
+        Response transact_in_place(std::uint16_t opcode,
+                                   const std::vector<std::uint32_t>& params = {});
+        // Same, with a `size`-byte data phase pulled from `fill` piece by
+        // piece instead of held in memory.
+        virtual Response transact_stream(std::uint16_t opcode,
+                                         const std::vector<std::uint32_t>& params,
+                                         std::uint64_t size, const DataProducer& fill);
+
+        // One operation of a batch. Plain data so a batch can be built once
+        // (e.g. from a stored profile) and submitted any number of times.
+        struct Request {
+            std::uint16_t opcode{0};
+            std::uint8_t  nparams{0};
+            std::uint32_t params[5]{};
+            const std::uint8_t* data{nullptr}; // outgoing data phase; must outlive the call
+            std::size_t   data_size{0};
+        };
+        enum class BatchMode { StopOnError, ContinueOnError };
+
+        // Run `n` operations back to back under a single lock. All command
+        // and data containers are encoded into one reused arena first, and
+        // responses land in the caller's `results` (n entries, reused
+        // between calls). A non-OK response stops the batch unless
+        // ContinueOnError; a transport error always throws. Nothing is
+        // replayed: a lost session is restored after the batch and the
+        // affected response is left for the caller. Returns how many ran.
+        std::size_t run_batch(const Request* reqs, std::size_t n, Response* results,
+                              BatchMode mode = BatchMode::StopOnError);
+        std::size_t run_batch(const std::vector<Request>& reqs, std::vector<Response>& results,
+                              BatchMode mode = BatchMode::StopOnError);
+
+        // Reopen the session and let the subclass restore its state. Skipped
+        // if another thread finished a recovery while this one waited.
+        void recover_session();
+        void set_auto_recover(bool on) { auto_recover_ = on; }
+        std::uint32_t recoveries() const { return recoveries_.load(); }
+        std::uint32_t resyncs() const { return resyncs_; }
 
+        // events (interrupt pipe, read by a background EventMonitor)
+        EventMonitor& events();
+        void start_event_monitor(unsigned slice_ms = 100);
+        void stop_event_monitor();
+
+        // Block until an ObjectAdded event arrives and return its handle.
+        // `pred` may filter on the event (e.g. a storage ID check); the
+        // monitor is started on demand. Events received before `since`
+        // (default: the call) belong to earlier captures and are skipped;
+        // pass the time taken just before triggering the capture so an
+        // event that beats the wait still counts.
+        std::optional<uint32_t> wait_object_added(std::chrono::milliseconds timeout,
+                                                  const EventPredicate& pred = {},
+                                                  std::optional<std::chrono::steady_clock::time_point> since = {});
+        // poll_ms is kept for compatibility; it only sets the monitor slice.
         std::optional<uint32_t> wait_object_added(int timeout_ms, int poll_ms);
+        // Predicate accepting objects stored on `storage_id` (one GetObjectInfo
+        // per candidate event).
+        EventPredicate object_in_storage(std::uint32_t storage_id);
+
+        // Parsed DeviceInfo, fetched once. With a cache dir and a body key
+        // (model, firmware and serial, set by SigmaCamera::config_api) it is
+        // loaded from disk instead.
+        const DeviceInfo& device_info();
+        void set_device_info_cache_dir(std::string dir) { devinfo_cache_dir_ = std::move(dir); }
 
         // convenience (raw datasets; you can parse later)
         virtual std::vector<std::uint8_t>  get_device_info();
@@ -143,6 +226,9 @@ class CameraPTP {
         virtual std::vector<std::uint8_t>  get_thumb(std::uint32_t handle);
         virtual void                       send_object_info(const std::vector<std::uint8_t>& info_dataset);
         virtual void                       send_object(const std::vector<std::uint8_t>& object_bytes);
+        // Streaming uploads in constant memory; `size` bytes must follow.
+        virtual void                       send_object(std::uint64_t size, const DataProducer& fill);
+        virtual void                       send_object(int fd, std::uint64_t size);
         virtual void                       delete_object(std::uint32_t handle);
         virtual void                       move_object(std::uint32_t handle, std::uint32_t storage, std::uint32_t parent);
         virtual void                       copy_object(std::uint32_t handle, std::uint32_t storage, std::uint32_t parent);
@@ -159,12 +245,58 @@ class CameraPTP {
         // transport-level helpers to mirror PTPy
         virtual std::vector<std::uint8_t> mesg(std::uint16_t opcode,
                                                 const std::vector<std::uint32_t>& params={});
+        // Reads the interrupt pipe directly; do not mix with a running monitor.
         virtual std::vector<std::uint8_t> event(unsigned timeout_ms=50);
 
     protected:
         explicit CameraPTP(Transport& t) : transport_(t) {}
         std::vector<std::uint8_t> read_full_container_();
+        Response transact_(std::uint16_t opcode, const std::vector<std::uint32_t>& params,
+                           const std::vector<std::uint8_t>* data_out, bool in_place);
+        Response transact_once_(std::uint16_t opcode, const std::vector<std::uint32_t>& params,
+                                const std::vector<std::uint8_t>* data_out, bool in_place = false);
+
+        // Safe to issue twice (reads). Subclasses add their vendor getters.
+        virtual bool is_idempotent_(std::uint16_t opcode) const;
+        // Runs after recover_session() reopened the session.
+        virtual void on_session_restored_() {}
+        // Recovers unless recoveries() has moved past `seen`, the count read
+        // before the failed attempt (another thread already recovered).
+        void recover_session_(std::uint32_t seen);
+        // transaction phases; caller holds txn_mu_
+        std::uint32_t write_command_(std::uint16_t opcode, const std::vector<std::uint32_t>& params);
+        void write_data_(std::uint16_t opcode, std::uint32_t tid, std::uint64_t size,
+                         const DataProducer& fill);
+        // Skips events and containers of other transactions; a timeout or
+        // a stream it can't make sense of flags the pipe for resync_().
+        Response read_response_(std::uint32_t tid, bool in_place = false);
+        // Drain bulk IN so the next transaction starts in lockstep.
+        void resync_();
+
+        static constexpr std::size_t kDataPiece = 1 << 20; // bulk OUT write size
+        static constexpr int kMaxStaleContainers = 16;
+        // DATA payloads at least this big are moved, not copied, into Response
+        static constexpr std::size_t kMoveDataMin = 64 * 1024;
+        // first bulk IN read of a container: a multiple of every bulk max
+        // packet size (64/512/1024), so it can't overflow
+        static constexpr std::size_t kHeadRead = 1024;
+        static constexpr unsigned kResyncDrainMs = 20;
 
         Transport& transport_;
+        std::mutex txn_mu_; // one transaction on the pipes at a time
         std::uint32_t next_tid_{1};
+        bool needs_resync_{false}; // set after a timeout / tid mismatch; guarded by txn_mu_
+        std::uint32_t resyncs_{0};
+        std::uint32_t session_id_{0}; // last opened; 0 = never
+        bool auto_recover_{true};
+        std::mutex recover_mu_;
+        std::atomic<std::thread::id> recover_owner_{}; // no nested recovery
+        std::atomic<std::uint32_t> recoveries_{0};
+        std::unique_ptr<EventMonitor> events_;
+        std::vector<std::uint8_t> batch_arena_;  // run_batch encoding; guarded by txn_mu_
+        std::vector<std::size_t>  batch_offset_; // start of each request in the arena
+
+        std::optional<DeviceInfo> device_info_;
+        std::string devinfo_cache_dir_;
+        std::string devinfo_cache_key_; // empty: body identity unknown, no disk cache
 };
\ No newline at end of file
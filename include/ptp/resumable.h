@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "utils/sink.h"
+
+// Sidecar record of a partially downloaded file: which object it is and
+// how many bytes are known to be on disk.
+struct DownloadCheckpoint
+{
+    std::string kind;        // "ptp" (handle) or "sigma" (file address)
+    std::uint32_t id{0};
+    std::uint64_t size{0};
+    std::string name;
+    std::uint64_t offset{0}; // fsynced prefix length
+
+    bool same_file(const DownloadCheckpoint &o) const
+    {
+        return kind == o.kind && id == o.id && size == o.size && name == o.name;
+    }
+
+    static std::optional<DownloadCheckpoint> load(const std::string &path);
+    // Atomic replace (tmp + fsync + rename).
+    void save(const std::string &path) const;
+};
+
+// Output file that can be resumed after a broken transfer.
+//
+// Opening it looks for "<path>.part"; if that sidecar describes the same
+// object, offset() is where the previous attempt stopped and writes continue
+// from there. Every `sync_every` bytes the data is fsynced and the sidecar
+// updated, so at most that much is fetched again after a failure.
+class ResumableFile : public ByteSink
+{
+public:
+    ResumableFile(const std::string &path, DownloadCheckpoint identity,
+                  std::uint64_t sync_every = 8 * 1024 * 1024);
+    ~ResumableFile() override;
+
+    ResumableFile(const ResumableFile &) = delete;
+    ResumableFile &operator=(const ResumableFile &) = delete;
+
+    std::uint64_t offset() const { return cp_.offset + pending_; }
+    bool resumed() const { return resumed_; }
+
+    void write(const std::uint8_t *data, std::size_t len) override;
+    void reserve(std::uint64_t total) override;
+    void sync() override; // fsync + checkpoint
+
+    // Everything arrived: fsync, trim to size and drop the sidecar.
+    void finish();
+
+private:
+    std::string path_;
+    std::string sidecar_;
+    DownloadCheckpoint cp_;
+    std::uint64_t sync_every_;
+    std::uint64_t pending_{0}; // written but not yet checkpointed
+    bool resumed_{false};
+    int fd_{-1};
+};
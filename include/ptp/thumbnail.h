@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class CameraPTP;
+class ObjectCatalog;
+struct ObjectEntry;
+
+using Thumbnail = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+struct ThumbnailOptions
+{
+    std::size_t memory_bytes{64 * 1024 * 1024}; // LRU budget
+    std::string cache_dir;                      // empty: no disk cache
+    std::chrono::milliseconds prefetch_gap{2};  // pause between background fetches
+};
+
+struct ThumbnailStats
+{
+    std::uint64_t memory_hits{0};
+    std::uint64_t disk_hits{0};
+    std::uint64_t fetched{0}; // GetThumb round trips
+};
+
+// Thumbnails for the objects of an ObjectCatalog.
+//
+// get() looks in a byte-bounded LRU, then in the disk cache, and only then
+// issues GetThumb. Disk entries are keyed by handle + capture date + size, so
+// a reused handle never serves a stale image. prefetch() walks the catalog on
+// a background thread; it backs off whenever get() is waiting on the camera
+// and only fills memory up to the budget, without evicting anything; with no
+// disk cache it stops once the budget is full. A busy or failed GetThumb is
+// never cached, so the next get() asks again.
+class ThumbnailService
+{
+public:
+    ThumbnailService(CameraPTP &cam, ObjectCatalog &catalog, ThumbnailOptions opt = {});
+    ~ThumbnailService();
+
+    ThumbnailService(const ThumbnailService &) = delete;
+    ThumbnailService &operator=(const ThumbnailService &) = delete;
+
+    // Empty (not null) when the object has no thumbnail or the fetch failed.
+    Thumbnail get(std::uint32_t handle);
+
+    void prefetch(); // restarts the walk if one is running
+    void stop();
+    // Block until the current walk has finished; false on timeout.
+    bool wait_prefetch(std::chrono::milliseconds timeout);
+
+    std::size_t memory_bytes() const;
+    ThumbnailStats stats() const;
+
+private:
+    struct Node
+    {
+        std::uint32_t handle;
+        std::string key;
+        Thumbnail data;
+    };
+
+    Thumbnail lookup_(std::uint32_t handle, const std::string &key);
+    // false when the LRU did not take it
+    bool insert_(std::uint32_t handle, const std::string &key, Thumbnail data,
+                 bool evict);
+    Thumbnail load_(const ObjectEntry &e, const std::string &key, bool evict,
+                    bool use_disk, bool *kept = nullptr);
+    std::string disk_path_(const std::string &key) const;
+    void run_();
+
+    static std::string key_(const ObjectEntry &e);
+
+    CameraPTP &cam_;
+    ObjectCatalog &catalog_;
+    ThumbnailOptions opt_;
+
+    mutable std::mutex mu_;
+    std::list<Node> lru_; // front = most recently used
+    std::unordered_map<std::uint32_t, std::list<Node>::iterator> index_;
+    std::size_t bytes_{0};
+    ThumbnailStats stats_;
+
+    std::atomic<int> foreground_{0}; // get() calls waiting on the camera
+    std::mutex run_mu_;
+    std::condition_variable run_cv_;
+    std::thread thread_;
+    bool stop_{false};
+    bool walking_{false};
+};
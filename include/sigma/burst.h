@@ -0,0 +1,88 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sigma/sigma_ptp.h"
+
+struct BurstOptions
+{
+  unsigned frames{10};
+  CaptureMode mode{CaptureMode::NonAFCapt};
+  std::string dir{"."};           // files keep the body's FileName
+  unsigned depth{4};              // frames allowed in the image DB at once
+  unsigned clear_batch{2};        // ClearImageDBSingle calls sent together (<= depth)
+  std::uint32_t chunk{SigmaCamera::kAdaptiveChunk};
+  WaitPolicy wait;                // per frame, for ImageGenCompleted
+};
+
+struct BurstFrame
+{
+  std::uint8_t image_id{0};
+  PictFileInfo2 info;
+  std::string path;
+  std::chrono::milliseconds ready_at{0}; // since run() started
+};
+
+struct BurstResult
+{
+  std::vector<BurstFrame> frames;
+  unsigned snapped{0};
+  std::chrono::milliseconds elapsed{0};
+  std::uint64_t bytes{0};
+
+  double fps() const
+  {
+    return elapsed.count() ? frames.size() * 1000.0 / elapsed.count() : 0.0;
+  }
+};
+
+// Overlapped burst: keeps shooting while earlier frames download.
+//
+// A shooter thread snaps one frame at a time and takes its id from the
+// ImageDBTail of CamCaptStatus once the tail moves. The image DB is a ring
+// of image ids and Head/Tail are the ids of its oldest and newest entries,
+// so the tail is the same id GetCamCaptStatus, GetPictFileInfo2 and
+// ClearImageDBSingle take; it wraps, and 0 is never an image. The shooter
+// stops once `depth` frames are in the DB and resumes as they are cleared;
+// if the body reports BufferFull first, it waits for a clear instead of
+// snapping again. The calling thread waits for each id in order, fetches
+// its PictFileInfo2, streams the file to `dir` and clears finished ids in
+// batches (also when run() throws, or early while the shooter is stalled).
+// Both threads share the session, so snaps slot in between download chunks.
+class BurstCapture
+{
+public:
+  BurstCapture(SigmaCamera &cam, BurstOptions opt = {});
+
+  // Called on the calling thread after each frame hits the disk.
+  std::function<void(const BurstFrame &)> on_frame;
+
+  BurstResult run();
+
+private:
+  void shoot_();
+  CamCaptStatus wait_new_tail_(std::uint8_t tail);
+  void clear_(bool all);
+
+  SigmaCamera &cam_;
+  BurstOptions opt_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::uint8_t> shot_; // ids snapped, not yet downloaded
+  unsigned in_db_{0};             // snapped and not yet cleared
+  unsigned snapped_{0};
+  bool shooting_{false};
+  bool stalled_{false};           // shooter waiting for a clear after BufferFull
+  bool abort_{false};
+  std::exception_ptr error_;
+
+  std::vector<std::uint8_t> to_clear_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "sigma/sigma_ptp.h"
+
+// Group fields a CamCanSetInfo5 tag can be bound to.
+enum class CanSetField : std::uint8_t
+{
+  ShutterSpeed,  // CamDataGroup1
+  Aperture,
+  ISOSpeed,
+  ExpComp,
+  ABValue,
+  DriveMode,     // CamDataGroup2
+  ExposureMode,
+  WhiteBalance,
+  Resolution,
+  ImageQuality,
+  ColorTemp,     // CamDataGroup5
+  AspectRatio,
+  Count_,
+};
+
+enum class CanSetAction
+{
+  Reject, // leave the value, report it
+  Clamp,  // move it to the nearest settable code (ordinal fields only)
+};
+
+struct CanSetVerdict
+{
+  std::vector<CanSetField> rejected;
+  std::vector<CanSetField> clamped;
+
+  bool ok() const { return rejected.empty(); }
+};
+
+// Checks group values against a cached CamCanSetInfo5 before they go to
+// the body, so a value the current mode can't take is caught locally
+// instead of by a refused (or silently ignored) Set*.
+//
+// Which tag describes which field is not fixed by anything in this tree,
+// so fields are checked only once bound with bind(); dump to_string() of
+// the body's answer to find its tags. A bound tag the body doesn't list, or
+// lists with no integer values, lets every value through.
+//
+// The info is fetched on first use and again after invalidate(), a
+// session recovery, or a Group2 write through set() (the exposure and drive
+// modes change what is settable). Writes made with SigmaCamera::set_group
+// directly don't invalidate it.
+class CanSetValidator
+{
+public:
+  explicit CanSetValidator(SigmaCamera &cam);
+
+  void bind(CanSetField field, std::uint16_t tag);
+  void unbind(CanSetField field);
+
+  CamCanSetInfo5 info();
+  void invalidate();
+
+  // Checks the bound fields `g` carries; with Clamp, moves ordinal ones
+  // (shutter, aperture, ISO, exposure compensation, colour temperature) to
+  // the nearest settable code and reports them as clamped. The other
+  // fields (modes, white balance, resolution, quality, aspect, bracketing)
+  // are never clamped, only rejected.
+  CanSetVerdict check(CamDataGroup1 &g, CanSetAction action = CanSetAction::Reject);
+  CanSetVerdict check(CamDataGroup2 &g, CanSetAction action = CanSetAction::Reject);
+  CanSetVerdict check(CamDataGroup5 &g, CanSetAction action = CanSetAction::Reject);
+
+  // check() then set_group(). Throws std::runtime_error, without sending
+  // anything, if a value is rejected.
+  template <class GroupT>
+  CameraPTP::Response set(GroupT g, CanSetAction action = CanSetAction::Reject);
+
+private:
+  void refresh_(); // mu_ held
+  template <class T>
+  void check_(std::optional<T> &v, CanSetField f, CanSetAction action, CanSetVerdict &out);
+
+  SigmaCamera &cam_;
+  std::mutex mu_;
+  std::optional<CamCanSetInfo5> info_;
+  std::uint32_t recoveries_seen_{0};
+  std::array<std::optional<std::uint16_t>, std::size_t(CanSetField::Count_)> tags_;
+  // bound field -> its entry in info_, resolved once per fetch
+  std::array<const CamCanSetInfo5::Entry *, std::size_t(CanSetField::Count_)> entry_{};
+};
+
+// explicit instantiations (built in .cpp)
+extern template CameraPTP::Response CanSetValidator::set<CamDataGroup1>(CamDataGroup1, CanSetAction);
+extern template CameraPTP::Response CanSetValidator::set<CamDataGroup2>(CamDataGroup2, CanSetAction);
+extern template CameraPTP::Response CanSetValidator::set<CamDataGroup5>(CamDataGroup5, CanSetAction);
@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sigma/sigma_ptp.h"
+#include "utils/jpeg.h"
+#include "utils/jpeg_decode.h"
+#include "utils/shm_ring.h"
+
+enum class LiveViewDrop
+{
+  DropOldest, // an unread frame is replaced by the newer one
+  DropNewest, // a new frame is discarded while the last one is unread
+};
+
+struct LiveViewOptions
+{
+  double target_fps{30.0};
+  LiveViewDrop drop{LiveViewDrop::DropOldest};
+  std::chrono::milliseconds error_backoff{100}; // after a failed GetViewFrame
+  // Don't publish frames that repeat the previous one, are not a complete
+  // JPEG, or match a known placeholder scan hash (see FrameFilter).
+  bool skip_repeats{true};
+  std::vector<std::uint64_t> placeholders;
+  // Optional decode stage: every published frame is also queued here, with
+  // its seq as the tag. Not owned; must outlive the engine.
+  JpegDecodePool *decoder{nullptr};
+  // Optional: every published frame is also written to this shared-memory
+  // ring for other processes (ShmRingReader). Not owned.
+  ShmRingWriter *shm{nullptr};
+};
+
+struct LiveFrame
+{
+  std::uint64_t seq{0}; // 1, 2, ... per published frame; 0 = none yet
+  std::chrono::steady_clock::time_point captured{};
+  std::chrono::microseconds fetch_latency{0};
+  ViewFrameView jpeg; // owns the response buffer
+  JpegInfo info;      // dimensions and scan hash, when skip_repeats is on
+
+  const std::uint8_t *data() const { return jpeg.data(); }
+  std::size_t size() const { return jpeg.size(); }
+};
+
+struct LiveViewStats
+{
+  std::uint64_t fetched{0};   // GetViewFrame round trips that returned data
+  std::uint64_t published{0};
+  std::uint64_t dropped{0};   // per the drop policy
+  std::uint64_t errors{0};
+  std::uint64_t repeats{0};   // skipped: same scan as the last frame
+  std::uint64_t rejected{0};  // skipped: placeholder or not a complete JPEG
+  std::uint64_t decode_dropped{0}; // decoder backlog was full
+  double fps{0};              // frames fetched per second, smoothed
+  std::chrono::microseconds fetch_latency{0}; // smoothed
+};
+
+// Fetches live-view frames on its own thread and hands the newest one to a
+// reader through a triple buffer: the producer fills the back slot and
+// swaps it with the middle one, the reader swaps the middle one into the
+// front. Both swaps are a single atomic exchange, so neither side ever
+// waits for the other. Frames are ViewFrameViews, so the JPEG bytes are
+// never copied.
+//
+// One reader thread at a time may call acquire().
+class LiveViewEngine
+{
+public:
+  explicit LiveViewEngine(SigmaCamera &cam, LiveViewOptions opt = {});
+  ~LiveViewEngine();
+
+  LiveViewEngine(const LiveViewEngine &) = delete;
+  LiveViewEngine &operator=(const LiveViewEngine &) = delete;
+
+  void start();
+  void stop();
+  bool running() const { return running_.load(); }
+
+  // Newest published frame, or null before the first one. The frame stays
+  // valid until the next acquire(). `is_new` tells whether it changed.
+  const LiveFrame *acquire(bool *is_new = nullptr);
+
+  LiveViewStats stats() const;
+
+private:
+  static constexpr std::uint8_t kFresh = 0x4; // middle slot holds an unread frame
+
+  void run_();
+  void publish_();
+
+  SigmaCamera &cam_;
+  LiveViewOptions opt_;
+  FrameFilter filter_; // producer thread only
+
+  std::array<LiveFrame, 3> slots_;
+  std::atomic<std::uint8_t> middle_{1}; // slot index | kFresh
+  std::uint8_t back_{0};                // producer's
+  std::uint8_t front_{2};               // reader's
+
+  std::atomic<bool> running_{false};
+  std::mutex run_mu_;
+  std::condition_variable run_cv_; // wakes the pacing sleep on stop()
+  bool stop_{false};
+  std::thread thread_;
+
+  mutable std::mutex stats_mu_;
+  LiveViewStats stats_;
+  std::chrono::steady_clock::time_point last_fetch_{};
+};
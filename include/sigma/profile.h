@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include "sigma/sigma_ptp.h"
+
+struct ProfileOpResult
+{
+  std::uint16_t opcode{0};
+  std::uint16_t response_code{0};
+};
+
+struct ProfileApplyResult
+{
+  std::size_t planned{0};               // Set* operations in the profile
+  std::size_t sent{0};                  // of those, how many went out
+  std::vector<ProfileOpResult> refused; // non-OK responses
+  std::vector<std::uint16_t> clamped;   // Set* opcodes whose read-back differs
+
+  bool ok() const { return refused.empty() && sent == planned; }
+};
+
+// Target settings across CamDataGroup1-5 and CamDataGroupFocus, applied
+// in dependency order with one Set* per group.
+//
+// Group2 goes first: its exposure mode decides which Group1 values
+// (shutter, aperture, ISO) the body accepts, and its drive mode and quality
+// bound what Groups 3-5 mean. Focus goes last. The payloads are encoded
+// once, on the first apply() after a change, and sent as a single batch.
+// Groups 1, 5 and Focus carry values the body may clamp (exposure to the
+// lens and mode, colour temperature and DMF position to their ranges); only
+// those are read back, again in one batch, and compared field by field.
+class CameraProfile
+{
+public:
+  // Merged into what the profile already holds; later fields win.
+  template <class GroupT>
+  CameraProfile &set(const GroupT &g)
+  {
+    auto &slot = std::get<std::optional<GroupT>>(groups_);
+    if (slot)
+      slot->merge(g);
+    else
+      slot = g;
+    encoded_ = false;
+    return *this;
+  }
+
+  template <class GroupT>
+  const std::optional<GroupT> &get() const { return std::get<std::optional<GroupT>>(groups_); }
+
+  void clear();
+
+  // Stops at the first refused Set*, since later groups may depend on it.
+  // Read-back runs only when every Set* succeeded.
+  ProfileApplyResult apply(SigmaCamera &cam, bool verify = true);
+
+  // Set* operations apply() will send.
+  std::size_t transactions();
+
+private:
+  void encode_();
+  template <class F>
+  void each_(F &&f); // dependency order
+
+  std::tuple<std::optional<CamDataGroup1>, std::optional<CamDataGroup2>,
+             std::optional<CamDataGroup3>, std::optional<CamDataGroup4>,
+             std::optional<CamDataGroup5>, std::optional<CamDataGroupFocus>>
+      groups_;
+
+  bool encoded_{false};
+  std::vector<std::vector<std::uint8_t>> payloads_;
+  std::vector<CameraPTP::Request> sets_;
+  std::vector<CameraPTP::Request> gets_;
+  std::vector<CameraPTP::Response> results_; // reused between applies
+};
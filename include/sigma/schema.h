@@ -30,6 +30,11 @@ public:
 
     std::vector<std::uint8_t> encode() const;
     void decode(const std::vector<std::uint8_t> &rawdata);
+    // Overlay the settable fields `o` carries (what encode() would send).
+    void merge(const CamDataGroup1 &o);
+    // The settable fields of this that `known` doesn't already hold, or
+    // nullopt if sending this would change nothing.
+    std::optional<CamDataGroup1> diff(const CamDataGroup1 &known) const;
 
 private:
     enum : std::uint16_t
@@ -69,6 +74,11 @@ public:
 
     std::vector<std::uint8_t> encode() const;
     void decode(const std::vector<std::uint8_t> &raw);
+    // Overlay the settable fields `o` carries (what encode() would send).
+    void merge(const CamDataGroup2 &o);
+    // The settable fields of this that `known` doesn't already hold, or
+    // nullopt if sending this would change nothing.
+    std::optional<CamDataGroup2> diff(const CamDataGroup2 &known) const;
 
 private:
     enum : std::uint16_t
@@ -107,6 +117,11 @@ public:
 
     std::vector<std::uint8_t> encode() const;
     void decode(const std::vector<std::uint8_t> &raw);
+    // Overlay the settable fields `o` carries (what encode() would send).
+    void merge(const CamDataGroup3 &o);
+    // The settable fields of this that `known` doesn't already hold, or
+    // nullopt if sending this would change nothing.
+    std::optional<CamDataGroup3> diff(const CamDataGroup3 &known) const;
 
 private:
     enum : std::uint16_t
@@ -151,6 +166,11 @@ public:
 
     std::vector<std::uint8_t> encode() const;
     void decode(const std::vector<std::uint8_t> &raw);
+    // Overlay the settable fields `o` carries (what encode() would send).
+    void merge(const CamDataGroup4 &o);
+    // The settable fields of this that `known` doesn't already hold, or
+    // nullopt if sending this would change nothing.
+    std::optional<CamDataGroup4> diff(const CamDataGroup4 &known) const;
 
 private:
     enum : std::uint16_t
@@ -188,6 +208,11 @@ public:
 
     std::vector<std::uint8_t> encode() const;
     void decode(const std::vector<std::uint8_t> &raw);
+    // Overlay the settable fields `o` carries (what encode() would send).
+    void merge(const CamDataGroup5 &o);
+    // The settable fields of this that `known` doesn't already hold, or
+    // nullopt if sending this would change nothing.
+    std::optional<CamDataGroup5> diff(const CamDataGroup5 &known) const;
 
 private:
     enum : std::uint16_t
@@ -269,6 +294,45 @@ public:
     void decode(const std::vector<std::uint8_t> &raw);
 };
 
+// ---------- zero-copy views (decode-only) ----------
+// Same layouts as above, but the decoded bytes stay inside the response
+// buffer, which the view takes over: no copy between transact_in_place()
+// and the consumer. The layout starts `at` bytes into `raw` (the kept PTP
+// container header). The buffer moves with the view.
+class BigPartialPictFileView
+{
+public:
+    std::uint32_t AcquiredSize{0};
+
+    void decode(std::vector<std::uint8_t> &&raw, std::size_t at = 0);
+
+    const std::uint8_t *data() const { return buf_.data() + off_; }
+    std::size_t size() const { return len_; }
+    bool empty() const { return len_ == 0; }
+
+private:
+    static constexpr std::size_t kOffset = 4;
+    std::vector<std::uint8_t> buf_;
+    std::size_t off_{0};
+    std::size_t len_{0};
+};
+
+class ViewFrameView
+{
+public:
+    void decode(std::vector<std::uint8_t> &&raw, std::size_t at = 0);
+
+    const std::uint8_t *data() const { return buf_.data() + off_; } // JPEG bytes
+    std::size_t size() const { return len_; }
+    bool empty() const { return len_ == 0; }
+
+private:
+    static constexpr std::size_t kOffset = 10;
+    std::vector<std::uint8_t> buf_;
+    std::size_t off_{0};
+    std::size_t len_{0};
+};
+
 class ApiConfig
 {
 public:
@@ -311,6 +375,12 @@ public:
     // Parse a directory blob
     void decode(const std::vector<uint8_t> &raw);
 
+    // Overlay the settable fields `o` carries (what encode() would send).
+    void merge(const CamDataGroupFocus &o);
+    // The settable fields of this that `known` doesn't already hold, or
+    // nullopt if sending this would change nothing.
+    std::optional<CamDataGroupFocus> diff(const CamDataGroupFocus &known) const;
+
     std::string to_string() const;
 
 private:
@@ -336,4 +406,29 @@ private:
         preConstAF.reset();
         focusLimit.reset();
     }
-};
\ No newline at end of file
+};
+
+// ---------- CamCanSetInfo5 (decode-only) ----------
+// What the body accepts in its current mode, as a directory in the same
+// container as CamDataGroupFocus: DataLength, DirectoryCount, then 12-byte
+// entries (tag, type, count, value or offset). Each entry is read as the
+// list of values its tag may be set to; the tag numbering is per body and
+// not interpreted here (see CanSetValidator for binding tags to fields).
+class CamCanSetInfo5
+{
+public:
+    struct Entry
+    {
+        std::uint16_t tag{0};
+        DirectoryType type{DirectoryType::UInt8};
+        std::vector<std::int64_t> values; // sorted; integer types only
+        std::vector<std::uint8_t> raw;    // as sent, for the other types
+    };
+
+    void decode(const std::vector<std::uint8_t> &raw);
+    // Binary search by tag; null if the body didn't list it.
+    const Entry *find(std::uint16_t tag) const;
+    std::string to_string() const;
+
+    std::vector<Entry> entries; // sorted by tag
+};
@@ -1,6 +1,13 @@
 #pragma once
 #include "ptp/ptp.h"
+#include "utils/chunk_controller.h"
+#include "utils/sink.h"
+#include <chrono>
 #include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
 #include <vector>
 
 // data groups
@@ -72,11 +79,39 @@ struct SigmaGroupMap<CamDataGroup5>
   static constexpr SigmaOp Set = SigmaOp::SetCamDataGroup5;
 };
 
+// How wait_completion polls GetCamCaptStatus. The first poll is immediate;
+// the gap then doubles from `initial_interval` up to `max_interval` and
+// starts over whenever the status changes. Any PTP event cuts a gap short.
+struct WaitPolicy
+{
+  std::chrono::milliseconds initial_interval{10};
+  std::chrono::milliseconds max_interval{250};
+  unsigned backoff{2};                    // gap multiplier per unchanged poll
+  std::chrono::milliseconds timeout{30000};
+  int max_polls{0};                       // 0: bounded by timeout only
+  int max_errors{15};                     // unexpected status codes tolerated
+  bool wake_on_event{true};               // starts the event monitor if needed
+};
+
+// Where the wait went. Phase times are measured between polls, so they are
+// accurate to one poll gap.
+struct WaitStats
+{
+  std::chrono::milliseconds total{0};
+  std::chrono::milliseconds shoot_ms{0};     // seen ShootInProgress
+  std::chrono::milliseconds image_gen_ms{0}; // seen ImageGenInProgress
+  int polls{0};
+  int event_wakeups{0};
+  bool completed{false};
+};
+
 class SigmaCamera : public CameraPTP
 {
 public:
   explicit SigmaCamera(Transport &t) : CameraPTP(t) {}
 
+  // Resets the body to API defaults, so it also forgets the settings that
+  // session recovery would re-apply.
   ApiConfig config_api();
   void close_application();
 
@@ -92,11 +127,16 @@ public:
 
   CamCaptStatus get_cam_capt_status();
   CamCaptStatus get_cam_capt_status(std::uint8_t image_id);
+  CamCaptStatus wait_completion(std::uint8_t image_id, const WaitPolicy &policy,
+                                WaitStats *stats = nullptr);
+  // Fixed `sleep_ms` gaps, at most `polls` polls.
   CamCaptStatus wait_completion(std::uint8_t image_id, int polls = 30,
                                 int sleep_ms = 1000);
 
   CameraPTP::Response set_cam_data_group_focus(const CamDataGroupFocus& focus);
   CamDataGroupFocus get_cam_data_group_focus();
+  // Values settable in the current mode; see CanSetValidator for a cache.
+  CamCanSetInfo5 get_cam_can_set_info5();
 
   uint16_t snap(const SnapCommand &cmd);
   uint16_t snap(CaptureMode mode, std::uint8_t amount); // convenience
@@ -109,11 +149,65 @@ public:
                                                std::uint32_t start,
                                                std::uint32_t max_bytes);
   ViewFrame get_view_frame();
+  // Same data, left in the response buffer (no copy on decode).
+  BigPartialPictFileView get_big_partial_pict_file_view(std::uint32_t address,
+                                                        std::uint32_t start,
+                                                        std::uint32_t max_bytes);
+  ViewFrameView get_view_frame_view();
+
+  // Chunk size 0 lets chunk_controller() size each GetBigPartialPictFile
+  // from the throughput and latency of the previous ones.
+  static constexpr std::uint32_t kAdaptiveChunk = 0;
+  ChunkController &chunk_controller() { return chunks_; }
 
   // vendor-chunked download using the two calls above
   std::vector<std::uint8_t> get_object_vendor(std::uint32_t object_handle,
-                                              std::uint32_t chunk = 1024 * 1024);
+                                              std::uint32_t chunk = kAdaptiveChunk);
+  // Same, each chunk written to `sink` as it arrives, so memory stays at
+  // about one chunk whatever the file size. `preallocate` passes
+  // PictFileInfo2::FileSize to sink.reserve() (posix_fallocate for FdSink).
+  // Returns the bytes written; throws std::runtime_error if the body ends
+  // the object short of FileSize.
+  std::uint64_t get_object_vendor(std::uint32_t object_handle, ByteSink &sink,
+                                  std::uint32_t chunk = kAdaptiveChunk,
+                                  bool preallocate = true);
+  // Writes at the current offset of `fd` (not closed). Preallocated space
+  // the data didn't fill is released; the file never ends up shorter than
+  // it was.
+  std::uint64_t get_object_vendor(std::uint32_t object_handle, int fd,
+                                  std::uint32_t chunk = kAdaptiveChunk,
+                                  bool preallocate = true);
+  // GetBigPartialPictFile download into `path`, resumable through
+  // "<path>.part" (see ResumableFile). Returns the bytes fetched by this call.
+  std::uint64_t download_pict_file(const PictFileInfo2 &info,
+                                   const std::string &path,
+                                   std::uint32_t chunk = kAdaptiveChunk,
+                                   std::uint64_t checkpoint_bytes = 8 * 1024 * 1024);
   std::vector<uint8_t> get_latest_image(DestToSave mode, int timeout = 5000);
+
+protected:
+  bool is_idempotent_(std::uint16_t opcode) const override;
+  // ConfigApi again, then the merged settings applied so far (Group2 first:
+  // the exposure mode decides which Group1 values the body accepts).
+  void on_session_restored_() override;
+
+private:
+  friend class CameraProfile; // batches its Set* ops and records them here
+
+  ApiConfig config_api_();
+  template <class GroupT>
+  void remember_(const GroupT &g);
+
+  // next GetBigPartialPictFile size for `left` bytes to go
+  std::uint32_t chunk_for_(std::uint32_t chunk, std::uint32_t left) const;
+
+  bool api_configured_{false};
+  ChunkController chunks_;
+  std::mutex applied_mu_;
+  std::tuple<std::optional<CamDataGroup1>, std::optional<CamDataGroup2>,
+             std::optional<CamDataGroup3>, std::optional<CamDataGroup4>,
+             std::optional<CamDataGroup5>, std::optional<CamDataGroupFocus>>
+      applied_;
 };
 
 // explicit instantiations (built in .cpp)
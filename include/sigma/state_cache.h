@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <tuple>
+
+#include "sigma/sigma_ptp.h"
+
+struct StateCacheStats
+{
+  std::uint64_t reads{0};          // GetCamDataGroup* sent
+  std::uint64_t read_hits{0};      // served from the mirror
+  std::uint64_t writes{0};         // SetCamDataGroup* sent
+  std::uint64_t writes_skipped{0}; // nothing to change
+};
+
+// Mirror of CamDataGroup1-5 and CamDataGroupFocus as last read from or
+// written to the body.
+//
+// While the last read of a group is younger than `max_age`, get() answers
+// from the mirror and set() sends only the fields that differ from it (see
+// diff()), or no transaction at all when none do. Past that age the body
+// may have changed under it (a dial, another client), so set() sends the
+// whole group. A write updates the mirror but not its age, since the
+// read-only fields (battery, media space, ...) only change on the body's
+// side. Groups whose values the body may clamp (1, 5 and Focus) are marked
+// stale by a write instead, so a repeat of the same set() is sent again
+// rather than skipped against a value the body never took.
+//
+// The mirror is dropped after session recovery and after a failed set.
+// Writes that bypass it (SigmaCamera::set_group, CameraProfile::apply,
+// CanSetValidator::set) leave it stale for up to `max_age`: call
+// invalidate() after them, and after config_api(), which resets the body.
+class CameraStateCache
+{
+public:
+  explicit CameraStateCache(SigmaCamera &cam,
+                            std::chrono::milliseconds max_age = std::chrono::milliseconds(500));
+
+  template <class GroupT>
+  GroupT get();
+  // Always reads the body.
+  template <class GroupT>
+  GroupT refresh();
+  template <class GroupT>
+  CameraPTP::Response set(const GroupT &want);
+
+  // What the mirror holds, regardless of age.
+  template <class GroupT>
+  std::optional<GroupT> cached() const
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    return entry_<GroupT>().value;
+  }
+
+  template <class GroupT>
+  void invalidate()
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    entry_<GroupT>() = {};
+  }
+  void invalidate();
+
+  void set_max_age(std::chrono::milliseconds age);
+  StateCacheStats stats() const;
+
+private:
+  template <class GroupT>
+  struct Entry
+  {
+    std::optional<GroupT> value;
+    std::chrono::steady_clock::time_point read_at{}; // epoch: never read
+  };
+
+  template <class GroupT>
+  Entry<GroupT> &entry_() { return std::get<Entry<GroupT>>(entries_); }
+  template <class GroupT>
+  const Entry<GroupT> &entry_() const { return std::get<Entry<GroupT>>(entries_); }
+  void check_session_();
+  template <class GroupT>
+  bool fresh_(const Entry<GroupT> &e) const; // mu_ held
+  // GetCamDataGroup* into the mirror; mu_ held
+  template <class GroupT>
+  GroupT read_();
+
+  SigmaCamera &cam_;
+  std::chrono::milliseconds max_age_;
+  std::uint32_t recoveries_seen_{0};
+
+  // held across the transactions, so a diff is never taken against a
+  // mirror another thread is about to change
+  mutable std::mutex mu_;
+  std::tuple<Entry<CamDataGroup1>, Entry<CamDataGroup2>, Entry<CamDataGroup3>,
+             Entry<CamDataGroup4>, Entry<CamDataGroup5>, Entry<CamDataGroupFocus>>
+      entries_;
+  StateCacheStats stats_;
+};
+
+// explicit instantiations (built in .cpp)
+extern template CamDataGroup1 CameraStateCache::get<CamDataGroup1>();
+extern template CamDataGroup2 CameraStateCache::get<CamDataGroup2>();
+extern template CamDataGroup3 CameraStateCache::get<CamDataGroup3>();
+extern template CamDataGroup4 CameraStateCache::get<CamDataGroup4>();
+extern template CamDataGroup5 CameraStateCache::get<CamDataGroup5>();
+extern template CamDataGroupFocus CameraStateCache::get<CamDataGroupFocus>();
+
+extern template CamDataGroup1 CameraStateCache::refresh<CamDataGroup1>();
+extern template CamDataGroup2 CameraStateCache::refresh<CamDataGroup2>();
+extern template CamDataGroup3 CameraStateCache::refresh<CamDataGroup3>();
+extern template CamDataGroup4 CameraStateCache::refresh<CamDataGroup4>();
+extern template CamDataGroup5 CameraStateCache::refresh<CamDataGroup5>();
+extern template CamDataGroupFocus CameraStateCache::refresh<CamDataGroupFocus>();
+
+extern template CameraPTP::Response CameraStateCache::set<CamDataGroup1>(const CamDataGroup1 &);
+extern template CameraPTP::Response CameraStateCache::set<CamDataGroup2>(const CamDataGroup2 &);
+extern template CameraPTP::Response CameraStateCache::set<CamDataGroup3>(const CamDataGroup3 &);
+extern template CameraPTP::Response CameraStateCache::set<CamDataGroup4>(const CamDataGroup4 &);
+extern template CameraPTP::Response CameraStateCache::set<CamDataGroup5>(const CamDataGroup5 &);
+extern template CameraPTP::Response CameraStateCache::set<CamDataGroupFocus>(const CamDataGroupFocus &);
@@ -0,0 +1,81 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Blocking FIFO with a fixed capacity, for handing work between one stage
+// and the next. close() wakes everyone: push() then fails and pop() drains
+// what is left before returning std::nullopt.
+template <class T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(std::size_t capacity) : cap_(capacity ? capacity : 1) {}
+
+  // Returns false if the queue was closed.
+  bool push(T v)
+  {
+    std::unique_lock<std::mutex> lk(mu_);
+    not_full_.wait(lk, [&]
+                   { return closed_ || q_.size() < cap_; });
+    if (closed_)
+      return false;
+    q_.push_back(std::move(v));
+    lk.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  std::optional<T> pop()
+  {
+    std::unique_lock<std::mutex> lk(mu_);
+    not_empty_.wait(lk, [&]
+                    { return closed_ || !q_.empty(); });
+    return take_(lk);
+  }
+
+  std::optional<T> pop_for(std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lk(mu_);
+    not_empty_.wait_for(lk, timeout, [&]
+                        { return closed_ || !q_.empty(); });
+    return take_(lk);
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    return q_.size();
+  }
+
+private:
+  std::optional<T> take_(std::unique_lock<std::mutex> &lk)
+  {
+    if (q_.empty())
+      return std::nullopt;
+    T v = std::move(q_.front());
+    q_.pop_front();
+    lk.unlock();
+    not_full_.notify_one();
+    return v;
+  }
+
+  const std::size_t cap_;
+  mutable std::mutex mu_;
+  std::condition_variable not_full_, not_empty_;
+  std::deque<T> q_;
+  bool closed_{false};
+};
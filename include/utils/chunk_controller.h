@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+struct ChunkPolicy
+{
+    std::uint32_t min_bytes{64 * 1024};
+    std::uint32_t max_bytes{16 * 1024 * 1024}; // GetBigPartialPictFile caps at 0x8000000
+    std::uint32_t start_bytes{1024 * 1024};
+    std::uint32_t step_bytes{512 * 1024};      // additive increase
+    double        decrease{0.5};               // multiplicative decrease
+    // A chunk slower than this blocks other operations for too long.
+    std::chrono::milliseconds latency_target{150};
+};
+
+// AIMD request size for chunked transfers.
+//
+// Starts by doubling (slow start) until a chunk misses the latency target
+// or stops improving throughput, then grows by `step_bytes` per chunk and
+// cuts by `decrease` whenever a chunk runs over the target. Sizes are 4 KiB
+// multiples within [min_bytes, max_bytes]. Safe to share between threads.
+class ChunkController
+{
+public:
+    explicit ChunkController(ChunkPolicy p = {});
+
+    std::uint32_t next() const;
+    // `asked` is what next() returned (or less, at the end of a file);
+    // short tails are not used for tuning.
+    void record(std::uint32_t asked, std::uint32_t got, std::chrono::nanoseconds elapsed);
+
+    double bytes_per_sec() const; // smoothed
+    const ChunkPolicy &policy() const { return p_; }
+
+private:
+    std::uint32_t clamp_(double bytes) const;
+
+    ChunkPolicy p_;
+    mutable std::mutex mu_;
+    std::uint32_t chunk_;
+    bool slow_start_{true};
+    double rate_{0};      // EWMA, bytes/s
+    double best_rate_{0}; // best single-chunk rate during slow start
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+
+// What a quick walk over the JPEG markers tells about a frame, without
+// decoding it.
+struct JpegInfo
+{
+    bool valid{false};        // SOI, a SOF, SOS and EOI all present
+    std::uint16_t width{0};
+    std::uint16_t height{0};
+    std::uint8_t components{0};
+    std::size_t scan_offset{0}; // first byte of entropy-coded data
+    std::size_t scan_size{0};   // up to (not including) EOI
+    std::uint64_t scan_hash{0}; // hash64 of the scan bytes; 0 if invalid
+};
+
+// Parses markers up to the first SOS and finds EOI from the end; hashes the
+// scan bytes in between. Cost is the hash, about memory bandwidth.
+JpegInfo jpeg_sniff(const std::uint8_t *p, std::size_t n);
+
+// XXH64 (same output as the reference implementation). Plain 64-bit
+// arithmetic over four independent lanes; no intrinsics needed.
+std::uint64_t hash64(const void *data, std::size_t n, std::uint64_t seed = 0);
+
+// Flags frames not worth passing on to a decoder or encoder.
+class FrameFilter
+{
+public:
+    enum Verdict { Fresh, Duplicate, Placeholder, Invalid };
+
+    // Compares against the last Fresh frame only.
+    Verdict classify(const JpegInfo &info);
+    // Scan hash of a known "no image" frame (e.g. from a capture of one).
+    void add_placeholder(std::uint64_t scan_hash) { placeholders_.insert(scan_hash); }
+    void reset() { last_ = 0; }
+
+private:
+    std::uint64_t last_{0};
+    std::unordered_set<std::uint64_t> placeholders_;
+};
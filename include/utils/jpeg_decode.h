@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// DCT-domain scaling: the decoder skips the high-frequency coefficients
+// instead of decoding full size and resampling, so 1/8 is far cheaper than
+// a full decode.
+enum class JpegScale : std::uint8_t
+{
+    Full = 1,
+    Half = 2,
+    Quarter = 4,
+    Eighth = 8,
+};
+
+struct RgbImage
+{
+    std::uint64_t order{0};        // 1, 2, ... in submission order
+    std::uint64_t tag{0};          // caller's, e.g. LiveFrame::seq
+    std::uint32_t width{0};
+    std::uint32_t height{0};
+    std::vector<std::uint8_t> rgb; // packed RGB24 rows, width * 3 apart
+    bool ok{false};
+    std::string error;             // when !ok
+};
+
+// Returned to the pool's free list when the last reference goes away.
+using RgbImagePtr = std::shared_ptr<const RgbImage>;
+
+struct JpegDecodeOptions
+{
+    unsigned workers{2};
+    JpegScale scale{JpegScale::Full};
+    std::size_t max_pending{4}; // submitted but not yet taken by next()
+    bool fast{true};            // integer IDCT, plain upsampling
+};
+
+// Decodes JPEGs on a few worker threads and hands the results back in the
+// order they were submitted, whatever order the workers finish in. Input
+// and output buffers are recycled, so once warm the pool does not allocate.
+//
+// Needs libjpeg-turbo (configure with -DWITH_JPEG_DECODE=ON); without it
+// available() is false and the constructor throws.
+class JpegDecodePool
+{
+public:
+    static bool available();
+
+    explicit JpegDecodePool(JpegDecodeOptions opt = {});
+    ~JpegDecodePool();
+
+    JpegDecodePool(const JpegDecodePool &) = delete;
+    JpegDecodePool &operator=(const JpegDecodePool &) = delete;
+
+    // Copies the JPEG and queues it. Returns its order number, or 0 if
+    // max_pending images are already outstanding (the frame is dropped).
+    std::uint64_t submit(const std::uint8_t *p, std::size_t n, std::uint64_t tag = 0);
+
+    // The next image in submission order, or null if it isn't decoded
+    // within `timeout`. Failed decodes come back with ok == false.
+    RgbImagePtr next(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    // Applies to frames submitted afterwards.
+    void set_scale(JpegScale s);
+    std::size_t pending() const;
+
+    // Synchronous decode into `out`, reusing its buffer.
+    static bool decode(const std::uint8_t *p, std::size_t n, JpegScale scale, RgbImage &out,
+                       bool fast = true);
+
+private:
+    struct Job
+    {
+        std::uint64_t order;
+        std::uint64_t tag;
+        JpegScale scale;
+        std::vector<std::uint8_t> jpeg;
+    };
+    struct Shelf; // free RgbImages, shared with the handed-out pointers
+
+    void work_();
+
+    JpegDecodeOptions opt_;
+    std::shared_ptr<Shelf> shelf_;
+
+    mutable std::mutex mu_;
+    std::condition_variable work_cv_; // jobs queued or stopping
+    std::condition_variable done_cv_; // an image finished
+    std::deque<Job> jobs_;
+    std::map<std::uint64_t, std::unique_ptr<RgbImage>> done_; // by order
+    std::vector<std::vector<std::uint8_t>> spare_in_;         // recycled inputs
+    std::uint64_t submitted_{0};
+    std::uint64_t next_out_{1};
+    bool stop_{false};
+    std::vector<std::thread> threads_;
+};
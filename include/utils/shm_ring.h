@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Frame ring in POSIX shared memory: one writer process, any number of
+// readers. Each slot is guarded by a seqlock (odd while being written), so
+// readers never block the writer and can use the bytes in place, checking
+// afterwards that the slot wasn't overwritten meanwhile.
+//
+// Layout: ShmRingHeader, then `slots` ShmSlotHeaders, then the slot data,
+// each `slot_bytes` long and 64-byte aligned.
+struct ShmRingHeader
+{
+    static constexpr std::uint32_t kMagic = 0x53565231; // "SVR1"
+    static constexpr std::uint32_t kVersion = 1;
+
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t slots;
+    std::uint32_t writer_pid;
+    std::uint64_t slot_bytes;
+    std::uint64_t data_offset;
+    std::atomic<std::uint64_t> latest; // seq of the newest complete frame, 0 = none
+};
+
+struct ShmSlotHeader
+{
+    std::atomic<std::uint64_t> lock; // seqlock counter
+    std::uint64_t seq;
+    std::uint64_t size;
+    std::int64_t captured_ns;        // CLOCK_MONOTONIC, same in every process
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "shared-memory seqlock needs lock-free 64-bit atomics");
+
+class ShmRingWriter
+{
+public:
+    // `name` as for shm_open ("/sigma_liveview"). Replaces a segment of the
+    // same name only if its writer process has exited; throws
+    // std::runtime_error if that writer is still running, or on failure.
+    explicit ShmRingWriter(std::string name, std::uint32_t slots = 4,
+                           std::size_t slot_bytes = 2 << 20);
+    ~ShmRingWriter(); // unmaps and unlinks
+
+    ShmRingWriter(const ShmRingWriter &) = delete;
+    ShmRingWriter &operator=(const ShmRingWriter &) = delete;
+
+    // Copies the frame into the next slot. Returns its seq, or 0 if it
+    // doesn't fit in a slot.
+    std::uint64_t publish(const std::uint8_t *p, std::size_t n,
+                          std::chrono::steady_clock::time_point captured =
+                              std::chrono::steady_clock::now());
+
+    const std::string &name() const { return name_; }
+
+private:
+    std::string name_;
+    void *base_{nullptr};
+    std::size_t bytes_{0};
+    std::uint64_t seq_{0};
+};
+
+struct ShmFrame
+{
+    std::uint64_t seq{0};
+    std::int64_t captured_ns{0};
+    const std::uint8_t *data{nullptr}; // points into the mapping
+    std::size_t size{0};
+
+    // for still_valid(): the slot and the seqlock value seen when taken
+    std::uint32_t slot_{0};
+    std::uint64_t lock_{0};
+};
+
+class ShmRingReader
+{
+public:
+    // Maps an existing ring read-only. Throws std::runtime_error if it
+    // doesn't exist or isn't a ring of this version.
+    explicit ShmRingReader(const std::string &name);
+    ~ShmRingReader();
+
+    ShmRingReader(const ShmRingReader &) = delete;
+    ShmRingReader &operator=(const ShmRingReader &) = delete;
+
+    // Newest complete frame, in place. False if there is none yet or the
+    // writer is in the middle of that slot. Check still_valid() after
+    // using the bytes; the writer reuses the slot `slots()` frames later.
+    bool latest(ShmFrame &out) const;
+    bool still_valid(const ShmFrame &f) const;
+
+    // Copies the newest frame, retrying if it is overwritten mid-copy.
+    bool copy_latest(std::vector<std::uint8_t> &out, ShmFrame *meta = nullptr) const;
+
+    // Polls for a frame newer than `after`; false on timeout.
+    bool wait_next(std::uint64_t after, ShmFrame &out,
+                   std::chrono::milliseconds timeout) const;
+
+    std::uint64_t latest_seq() const;
+    std::uint32_t slots() const { return hdr_->slots; }
+    // False once the writer process has gone; reopen the ring to follow a
+    // new one.
+    bool writer_alive() const;
+
+private:
+    const ShmRingHeader *hdr_{nullptr};
+    const ShmSlotHeader *slot_hdr_{nullptr};
+    const std::uint8_t *data_{nullptr};
+    std::size_t bytes_{0};
+};
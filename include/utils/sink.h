@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Destination for streamed object bytes.
+class ByteSink {
+    public:
+        virtual ~ByteSink() = default;
+
+        virtual void write(const std::uint8_t* data, std::size_t len) = 0;
+        // Hint: total size of the object about to be written.
+        virtual void reserve(std::uint64_t /*total*/) {}
+        // Make everything written so far durable.
+        virtual void sync() {}
+};
+
+// Writes to a file descriptor (not owned).
+class FdSink : public ByteSink {
+    public:
+        explicit FdSink(int fd) : fd_(fd) {}
+
+        void write(const std::uint8_t* data, std::size_t len) override;
+        void reserve(std::uint64_t total) override; // posix_fallocate, best effort
+        void sync() override;                       // fsync
+
+        int fd() const { return fd_; }
+
+    private:
+        int fd_;
+};
+
+// Appends to a caller-owned vector.
+class VectorSink : public ByteSink {
+    public:
+        explicit VectorSink(std::vector<std::uint8_t>& out) : out_(out) {}
+
+        void write(const std::uint8_t* data, std::size_t len) override {
+            out_.insert(out_.end(), data, data + len);
+        }
+        void reserve(std::uint64_t total) override { out_.reserve(out_.size() + total); }
+
+    private:
+        std::vector<std::uint8_t>& out_;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Opt-in timeline tracer.
+//
+// Each TRACE_SCOPE records one complete event (begin time + duration, thread,
+// up to six numeric args) into a buffer held by the calling thread; no lock
+// is taken on the hot path. trace_dump_json() writes the Chrome trace format
+// that chrome://tracing and ui.perfetto.dev open directly.
+//
+// While tracing is off a scope costs a relaxed load and branch on entry and
+// one more branch on exit; arg() re-tests too, but its value expressions are
+// still evaluated, so guard any that cost more than a load with `if (scope)`.
+
+extern std::atomic<bool> g_trace_on;
+
+inline bool trace_enabled() { return g_trace_on.load(std::memory_order_relaxed); }
+void        trace_enable(bool on);
+
+// Label the calling thread in the exported timeline.
+void        trace_thread_name(const char* name);
+
+// Drop recorded events. Only call while no traced work is running.
+void        trace_clear();
+std::size_t trace_event_count();
+// Event buffers allocated so far. A thread's buffer is reused by later
+// threads once it exits, so this follows the most threads tracing at once.
+std::size_t trace_buffer_count();
+
+// Chrome trace JSON ({"traceEvents": [...]}); false if the file can't be written.
+bool        trace_dump_json(const std::string& path);
+std::string trace_json();
+
+class TraceScope {
+public:
+    static constexpr int kMaxArgs = 6;
+
+    // `name` and `cat` must be string literals (they are stored by pointer).
+    TraceScope(const char* name, const char* cat)
+    {
+        if (trace_enabled())
+            begin_(name, cat);
+    }
+    ~TraceScope()
+    {
+        if (active_)
+            end_();
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // True while this scope is recording.
+    explicit operator bool() const { return active_; }
+
+    // `key` must be a string literal.
+    void arg(const char* key, std::uint64_t value)
+    {
+        if (active_ && nargs_ < kMaxArgs)
+        {
+            keys_[nargs_] = key;
+            vals_[nargs_++] = value;
+        }
+    }
+
+private:
+    void begin_(const char* name, const char* cat);
+    void end_();
+
+    bool active_{false};
+    int nargs_{0};
+    const char* name_{nullptr};
+    const char* cat_{nullptr};
+    std::uint64_t t0_ns_{0};
+    const char* keys_[kMaxArgs];
+    std::uint64_t vals_[kMaxArgs];
+};
+
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+// Anonymous scope; use a named TraceScope when args are needed.
+#define TRACE_SCOPE(name, cat) TraceScope TRACE_CAT(trace_scope_, __LINE__)(name, cat)
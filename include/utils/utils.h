@@ -73,6 +73,17 @@ static inline void put_32le_at(std::vector<std::uint8_t> &b, std::uint32_t v, si
   b[pos+3] = v >> 24;
 }
 
+// Get 32 bits, 4 bytes (little endian)
+static inline std::uint32_t get_32le(const std::vector<std::uint8_t> &v,
+                                     size_t &i) {
+  if (i + 4 > v.size())
+    throw std::out_of_range("get_32le");
+  auto x = std::uint32_t(v[i]) | (std::uint32_t(v[i + 1]) << 8) |
+           (std::uint32_t(v[i + 2]) << 16) | (std::uint32_t(v[i + 3]) << 24);
+  i += 4;
+  return x;
+}
+
 // Read 32 bits, 4 bytes (little endian)
 static inline std::uint32_t read_32le(const std::uint8_t *p) {
   return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) |
@@ -106,6 +117,79 @@ static inline std::string read_cstr(const std::vector<std::uint8_t> &raw,
   return s;
 }
 
+// Read PTP String: u8 NumChars (incl. NUL) then UTF-16LE code units.
+// Non-ASCII code units are emitted as UTF-8.
+static inline std::string read_ptp_str(const std::vector<std::uint8_t> &raw,
+                                       size_t &i) {
+  const std::uint8_t n = get_8(raw, i);
+  if (i + size_t(n) * 2 > raw.size())
+    throw std::runtime_error("PTP string out of range");
+  std::string s;
+  s.reserve(n);
+  for (std::uint8_t k = 0; k < n; ++k) {
+    const std::uint16_t c = get_16le(raw, i);
+    if (c == 0)
+      continue;
+    if (c < 0x80) {
+      s.push_back(char(c));
+    } else if (c < 0x800) {
+      s.push_back(char(0xC0 | (c >> 6)));
+      s.push_back(char(0x80 | (c & 0x3F)));
+    } else {
+      s.push_back(char(0xE0 | (c >> 12)));
+      s.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+      s.push_back(char(0x80 | (c & 0x3F)));
+    }
+  }
+  return s;
+}
+
+// Write PTP String (inverse of read_ptp_str; BMP code points only).
+// An empty string is the single byte 0.
+static inline void put_ptp_str(std::vector<std::uint8_t> &b,
+                               const std::string &s) {
+  std::vector<std::uint16_t> units;
+  for (size_t k = 0; k < s.size();) {
+    const std::uint8_t c = std::uint8_t(s[k]);
+    if (c < 0x80) {
+      units.push_back(c);
+      k += 1;
+    } else if ((c & 0xE0) == 0xC0 && k + 1 < s.size()) {
+      units.push_back(std::uint16_t(((c & 0x1F) << 6) | (s[k + 1] & 0x3F)));
+      k += 2;
+    } else if (k + 2 < s.size()) {
+      units.push_back(std::uint16_t(((c & 0x0F) << 12) |
+                                    ((s[k + 1] & 0x3F) << 6) | (s[k + 2] & 0x3F)));
+      k += 3;
+    } else {
+      break; // truncated sequence
+    }
+  }
+  if (units.size() > 254)
+    throw std::runtime_error("PTP string too long");
+  if (units.empty()) {
+    put_8(b, 0);
+    return;
+  }
+  put_8(b, std::uint8_t(units.size() + 1));
+  for (auto u : units)
+    put_16le(b, u);
+  put_16le(b, 0);
+}
+
+// Read PTP AUINT16 array: u32 count then u16 elements (little endian)
+static inline std::vector<std::uint16_t>
+read_ptp_u16_array(const std::vector<std::uint8_t> &raw, size_t &i) {
+  const std::uint32_t n = get_32le(raw, i);
+  if (i + size_t(n) * 2 > raw.size())
+    throw std::runtime_error("PTP array out of range");
+  std::vector<std::uint16_t> out;
+  out.reserve(n);
+  for (std::uint32_t k = 0; k < n; ++k)
+    out.push_back(get_16le(raw, i));
+  return out;
+}
+
 // ----------------------------------------------------------------------------
 //                            Tests utility
 // ----------------------------------------------------------------------------
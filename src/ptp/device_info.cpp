@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "ptp/device_info.h"
+#include "utils/log.h"
+#include "utils/utils.h"
+
+// ---------- DeviceInfo ----------
+void DeviceInfo::decode(const std::vector<std::uint8_t> &raw)
+{
+  ops_.reset();
+  events_.reset();
+  props_.reset();
+
+  size_t i = 0;
+  StandardVersion = get_16le(raw, i);
+  VendorExtensionID = get_32le(raw, i);
+  VendorExtensionVersion = get_16le(raw, i);
+  VendorExtensionDesc = read_ptp_str(raw, i);
+  FunctionalMode = get_16le(raw, i);
+  OperationsSupported = read_ptp_u16_array(raw, i);
+  EventsSupported = read_ptp_u16_array(raw, i);
+  DevicePropertiesSupported = read_ptp_u16_array(raw, i);
+  CaptureFormats = read_ptp_u16_array(raw, i);
+  ImageFormats = read_ptp_u16_array(raw, i);
+  Manufacturer = read_ptp_str(raw, i);
+  Model = read_ptp_str(raw, i);
+  DeviceVersion = read_ptp_str(raw, i);
+  SerialNumber = read_ptp_str(raw, i);
+
+  for (auto op : OperationsSupported)
+    ops_.set(op);
+  for (auto ev : EventsSupported)
+    events_.set(ev);
+  for (auto prop : DevicePropertiesSupported)
+    props_.set(prop);
+}
+
+// ---------- DeviceInfoCache ----------
+std::string DeviceInfoCache::make_key(const std::string &model,
+                                      const std::string &firmware,
+                                      const std::string &serial)
+{
+  std::string key = model + "_" + firmware + "_" + serial;
+  for (auto &c : key)
+  {
+    const bool ok = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                    (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-';
+    if (!ok)
+      c = '_';
+  }
+  return key;
+}
+
+std::string DeviceInfoCache::path_(const std::string &key) const
+{
+  return dir_ + "/" + key + ".devinfo";
+}
+
+std::optional<std::vector<std::uint8_t>>
+DeviceInfoCache::load(const std::string &key) const
+{
+  std::ifstream f(path_(key), std::ios::binary);
+  if (!f)
+    return std::nullopt;
+  std::vector<std::uint8_t> raw((std::istreambuf_iterator<char>(f)),
+                                std::istreambuf_iterator<char>());
+  if (raw.empty())
+    return std::nullopt;
+  return raw;
+}
+
+void DeviceInfoCache::store(const std::string &key,
+                            const std::vector<std::uint8_t> &raw) const
+{
+  // write-then-rename so a concurrent reader never sees a torn file
+  const std::string path = path_(key);
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    if (!f)
+    {
+      LOG_WARN("DeviceInfoCache: cannot write %s", tmp.c_str());
+      return;
+    }
+    f.write(reinterpret_cast<const char *>(raw.data()),
+            (std::streamsize)raw.size());
+    if (!f)
+    {
+      LOG_WARN("DeviceInfoCache: short write to %s", tmp.c_str());
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    LOG_WARN("DeviceInfoCache: cannot rename %s", tmp.c_str());
+    std::remove(tmp.c_str());
+  }
+}
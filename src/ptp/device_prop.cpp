@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "ptp/device_prop.h"
+#include "ptp/ptp.h"
+#include "utils/log.h"
+#include "utils/utils.h"
+
+// byte width of a scalar datatype, 0 if unknown
+static std::size_t scalar_size(std::uint16_t type)
+{
+  switch (type)
+  {
+  case PTP_DTC_INT8:
+  case PTP_DTC_UINT8:
+    return 1;
+  case PTP_DTC_INT16:
+  case PTP_DTC_UINT16:
+    return 2;
+  case PTP_DTC_INT32:
+  case PTP_DTC_UINT32:
+    return 4;
+  case PTP_DTC_INT64:
+  case PTP_DTC_UINT64:
+    return 8;
+  case PTP_DTC_INT128:
+  case PTP_DTC_UINT128:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+// ---------- PropValue ----------
+bool PropValue::is_signed() const
+{
+  // INT8, INT16, ... are the odd codes
+  const std::uint16_t base = is_array() ? std::uint16_t(Type & ~PTP_DTC_ARRAY) : Type;
+  return base != PTP_DTC_STR && base != PTP_DTC_UNDEF && (base & 1);
+}
+
+PropValue PropValue::decode(std::uint16_t type, const std::vector<std::uint8_t> &raw,
+                            std::size_t &i)
+{
+  PropValue v;
+  v.Type = type;
+  if (type == PTP_DTC_STR)
+  {
+    v.Str = read_ptp_str(raw, i);
+    return v;
+  }
+  if (type & PTP_DTC_ARRAY)
+  {
+    const std::uint16_t elem = type & ~PTP_DTC_ARRAY;
+    const std::size_t w = scalar_size(elem);
+    if (!w)
+      throw std::runtime_error("PropValue: unknown array datatype");
+    const std::uint32_t n = get_32le(raw, i);
+    if (i + std::size_t(n) * w > raw.size())
+      throw std::runtime_error("PropValue: array out of range");
+    v.Elements.reserve(n);
+    for (std::uint32_t k = 0; k < n; ++k)
+      v.Elements.push_back(decode(elem, raw, i));
+    return v;
+  }
+
+  const std::size_t w = scalar_size(type);
+  if (!w)
+    throw std::runtime_error("PropValue: unknown datatype");
+  if (i + w > raw.size())
+    throw std::runtime_error("PropValue: value out of range");
+  const std::size_t lo = std::min<std::size_t>(w, 8);
+  for (std::size_t k = 0; k < lo; ++k)
+    v.Bits |= std::uint64_t(raw[i + k]) << (8 * k);
+  for (std::size_t k = 8; k < w; ++k)
+    v.High |= std::uint64_t(raw[i + k]) << (8 * (k - 8));
+  if (w < 8 && (type & 1) && (v.Bits >> (8 * w - 1)) & 1)
+    v.Bits |= ~std::uint64_t(0) << (8 * w); // sign-extend
+  i += w;
+  return v;
+}
+
+void PropValue::encode(std::vector<std::uint8_t> &out) const
+{
+  if (Type == PTP_DTC_STR)
+  {
+    put_ptp_str(out, Str);
+    return;
+  }
+  if (is_array())
+  {
+    put_32le(out, std::uint32_t(Elements.size()));
+    for (const auto &e : Elements)
+      e.encode(out);
+    return;
+  }
+  const std::size_t w = scalar_size(Type);
+  if (!w)
+    throw std::runtime_error("PropValue: cannot encode undefined datatype");
+  for (std::size_t k = 0; k < std::min<std::size_t>(w, 8); ++k)
+    out.push_back(std::uint8_t(Bits >> (8 * k)));
+  for (std::size_t k = 8; k < w; ++k)
+    out.push_back(std::uint8_t(High >> (8 * (k - 8))));
+}
+
+std::vector<std::uint8_t> PropValue::encode() const
+{
+  std::vector<std::uint8_t> out;
+  encode(out);
+  return out;
+}
+
+PropValue PropValue::of_int(std::uint16_t type, std::int64_t v)
+{
+  PropValue p;
+  p.Type = type;
+  p.Bits = std::uint64_t(v);
+  if (scalar_size(type) == 16 && v < 0)
+    p.High = ~std::uint64_t(0);
+  return p;
+}
+
+PropValue PropValue::of_uint(std::uint16_t type, std::uint64_t v)
+{
+  PropValue p;
+  p.Type = type;
+  p.Bits = v;
+  return p;
+}
+
+PropValue PropValue::of_str(std::string s)
+{
+  PropValue p;
+  p.Type = PTP_DTC_STR;
+  p.Str = std::move(s);
+  return p;
+}
+
+bool PropValue::operator==(const PropValue &o) const
+{
+  return Type == o.Type && Bits == o.Bits && High == o.High && Str == o.Str &&
+         Elements == o.Elements;
+}
+
+bool PropValue::less(const PropValue &o) const
+{
+  if (is_string())
+    return Str < o.Str;
+  if (High != o.High)
+    return is_signed() ? std::int64_t(High) < std::int64_t(o.High) : High < o.High;
+  if (scalar_size(Type) == 16)
+    return Bits < o.Bits; // low half of a 128-bit value is unsigned
+  return is_signed() ? as_int() < o.as_int() : Bits < o.Bits;
+}
+
+// ---------- DevicePropDesc ----------
+void DevicePropDesc::decode(const std::vector<std::uint8_t> &raw)
+{
+  Enumeration.clear();
+  RangeMin = RangeMax = RangeStep = PropValue{};
+
+  std::size_t i = 0;
+  PropertyCode = get_16le(raw, i);
+  DataType = get_16le(raw, i);
+  GetSet = get_8(raw, i);
+  FactoryDefaultValue = PropValue::decode(DataType, raw, i);
+  CurrentValue = PropValue::decode(DataType, raw, i);
+  FormFlag = get_8(raw, i);
+  if (FormFlag == FormRange)
+  {
+    RangeMin = PropValue::decode(DataType, raw, i);
+    RangeMax = PropValue::decode(DataType, raw, i);
+    RangeStep = PropValue::decode(DataType, raw, i);
+  }
+  else if (FormFlag == FormEnum)
+  {
+    const std::uint16_t n = get_16le(raw, i);
+    Enumeration.reserve(n);
+    for (std::uint16_t k = 0; k < n; ++k)
+      Enumeration.push_back(PropValue::decode(DataType, raw, i));
+  }
+}
+
+bool DevicePropDesc::accepts(const PropValue &v) const
+{
+  if (v.Type != DataType)
+    return false;
+  switch (FormFlag)
+  {
+  case FormRange:
+  {
+    if (v.less(RangeMin) || RangeMax.less(v))
+      return false;
+    // step check for 64-bit and narrower; 128-bit ranges only bound-check
+    if (scalar_size(DataType) == 16 || RangeStep.Bits == 0)
+      return true;
+    const std::uint64_t off = v.Bits - RangeMin.Bits; // two's complement distance
+    return off % RangeStep.Bits == 0;
+  }
+  case FormEnum:
+    return std::find(Enumeration.begin(), Enumeration.end(), v) != Enumeration.end();
+  default:
+    return true;
+  }
+}
+
+// ---------- DevicePropCache ----------
+DevicePropCache::DevicePropCache(CameraPTP &cam) : cam_(cam)
+{
+  recoveries_seen_ = cam_.recoveries();
+  auto &mon = cam_.events();
+  listener_id_ = mon.add_listener([this](const PtpEvent &ev)
+                                  { on_event_(ev); });
+  if (!mon.running())
+    mon.start();
+}
+
+DevicePropCache::~DevicePropCache() { cam_.events().remove_listener(listener_id_); }
+
+void DevicePropCache::on_event_(const PtpEvent &ev)
+{
+  switch (ev.code)
+  {
+  case PTP_EVENT_DevicePropChanged:
+    if (!ev.params.empty())
+      invalidate(std::uint16_t(ev.params[0]));
+    break;
+  case PTP_EVENT_DeviceInfoChanged:
+  case PTP_EVENT_DeviceReset:
+    clear();
+    break;
+  default:
+    break;
+  }
+}
+
+DevicePropDesc DevicePropCache::get(std::uint16_t code)
+{
+  std::uint64_t epoch;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (cam_.recoveries() != recoveries_seen_)
+    {
+      // new session: the body may have reset any of them
+      recoveries_seen_ = cam_.recoveries();
+      descs_.clear();
+      ++epoch_;
+    }
+    auto it = descs_.find(code);
+    if (it != descs_.end())
+      return it->second;
+    epoch = epoch_;
+  }
+
+  const auto raw = cam_.get_device_prop_desc(code);
+  if (raw.empty())
+    throw std::runtime_error("GetDevicePropDesc returned no data");
+  DevicePropDesc d;
+  d.decode(raw);
+
+  std::lock_guard<std::mutex> lk(mu_);
+  if (epoch == epoch_) // nothing was invalidated while we were on the wire
+    descs_[code] = d;
+  return d;
+}
+
+bool DevicePropCache::cached(std::uint16_t code) const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return descs_.count(code) != 0;
+}
+
+std::uint16_t DevicePropCache::set(std::uint16_t code, const PropValue &v)
+{
+  const DevicePropDesc d = get(code);
+  if (!d.writable())
+    throw std::runtime_error("device property is read-only");
+  if (!d.accepts(v))
+    throw std::runtime_error("value not accepted by the property descriptor");
+
+  const auto payload = v.encode();
+  const auto r = cam_.transact(PTP_OP_SetDevicePropValue, {code}, &payload, false);
+  if (r.response_code == PTP_RESP_OK)
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = descs_.find(code);
+    if (it != descs_.end())
+      it->second.CurrentValue = v;
+  }
+  else
+    LOG_WARN("SetDevicePropValue 0x%04X: resp=0x%04X", code, r.response_code);
+  return r.response_code;
+}
+
+void DevicePropCache::invalidate(std::uint16_t code)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  descs_.erase(code);
+  ++epoch_;
+}
+
+void DevicePropCache::clear()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  descs_.clear();
+  ++epoch_;
+}
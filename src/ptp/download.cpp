@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ptp/download.h"
+#include "ptp/object_catalog.h"
+#include "ptp/ptp.h"
+#include "ptp/resumable.h"
+#include "utils/bounded_queue.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+DownloadStats ObjectDownloader::download(std::uint32_t handle, ByteSink &sink)
+{
+  ObjectInfo oi;
+  oi.decode(cam_.get_object_info(handle));
+  return download(handle, oi.ObjectCompressedSize, sink);
+}
+
+DownloadStats ObjectDownloader::download_to_file(std::uint32_t handle,
+                                                 const std::string &path)
+{
+  ObjectInfo oi;
+  oi.decode(cam_.get_object_info(handle));
+
+  DownloadCheckpoint id;
+  id.kind = "ptp";
+  id.id = handle;
+  id.size = oi.ObjectCompressedSize;
+  id.name = oi.Filename;
+  ResumableFile file(path, id, opt_.checkpoint_bytes);
+
+  auto st = download(handle, oi.ObjectCompressedSize, file,
+                     std::uint32_t(file.offset()));
+  file.finish();
+  return st;
+}
+
+DownloadStats ObjectDownloader::download(std::uint32_t handle,
+                                         std::uint32_t size, ByteSink &sink,
+                                         std::uint32_t offset)
+{
+  DownloadStats st;
+  const auto t0 = Clock::now();
+  if (offset >= size)
+    return st;
+
+  BoundedQueue<std::vector<std::uint8_t>> q(opt_.queue_depth);
+  std::exception_ptr write_err;
+
+  std::thread writer([&]
+                     {
+    trace_thread_name("download writer");
+    try
+    {
+      for (;;)
+      {
+        auto tw = Clock::now();
+        auto chunk = q.pop();
+        st.write_stall_ms += ms_since(tw);
+        if (!chunk)
+          break;
+        tw = Clock::now();
+        TraceScope ts("chunk_write", "download");
+        ts.arg("bytes", chunk->size());
+        sink.write(chunk->data(), chunk->size());
+        st.write_ms += ms_since(tw);
+      }
+    }
+    catch (...)
+    {
+      write_err = std::current_exception();
+      q.close(); // unblock the reader
+    } });
+
+  std::exception_ptr read_err;
+  try
+  {
+    sink.reserve(size - offset);
+    const std::uint32_t step = std::max<std::uint32_t>(opt_.chunk_bytes, 1);
+    std::uint32_t pos = offset;
+    while (pos < size)
+    {
+      const std::uint32_t want = std::min(step, size - pos);
+      auto tu = Clock::now();
+      std::vector<std::uint8_t> data;
+      {
+        TraceScope ts("chunk_usb", "download");
+        ts.arg("offset", pos);
+        data = cam_.get_partial_object(handle, pos, want);
+        ts.arg("bytes", data.size());
+      }
+      st.usb_ms += ms_since(tu);
+      if (data.empty())
+        throw std::runtime_error("GetPartialObject returned no data");
+      if (data.size() > want)
+        data.resize(want);
+
+      pos += std::uint32_t(data.size());
+      st.bytes += data.size();
+      ++st.chunks;
+
+      tu = Clock::now();
+      const bool queued = q.push(std::move(data));
+      st.usb_stall_ms += ms_since(tu);
+      if (!queued)
+        break; // writer failed
+    }
+  }
+  catch (...)
+  {
+    read_err = std::current_exception();
+  }
+
+  q.close();
+  writer.join();
+  st.total_ms = ms_since(t0);
+
+  if (read_err)
+    std::rethrow_exception(read_err);
+  if (write_err)
+    std::rethrow_exception(write_err);
+
+  LOG_DEBUG("download 0x%08X: %llu B in %u chunks, %.1f MB/s "
+            "(usb %.1f ms, usb stall %.1f ms, write %.1f ms, write stall %.1f ms)",
+            handle, (unsigned long long)st.bytes, st.chunks, st.mb_per_s(),
+            st.usb_ms, st.usb_stall_ms, st.write_ms, st.write_stall_ms);
+  return st;
+}
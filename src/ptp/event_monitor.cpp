@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <exception>
+
+#include "ptp/event_monitor.h"
+#include "ptp/ptp.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+#include "utils/utils.h"
+
+std::optional<PtpEvent> PtpEvent::parse(const std::uint8_t *p, std::size_t n)
+{
+  if (n < sizeof(PtpContainerHeader))
+    return std::nullopt;
+  const std::uint32_t len = read_32le(p);
+  if (len < sizeof(PtpContainerHeader) || len > n)
+    return std::nullopt;
+  if (read_16le(p + 4) != PTP_CONTAINER_EVENT)
+    return std::nullopt;
+
+  PtpEvent ev;
+  ev.code = read_16le(p + 6);
+  ev.transaction_id = read_32le(p + 8);
+  for (std::size_t i = sizeof(PtpContainerHeader); i + 4 <= len && ev.params.size() < 3; i += 4)
+    ev.params.push_back(read_32le(p + i));
+  return ev;
+}
+
+EventMonitor::EventMonitor(Transport &t, std::size_t backlog)
+    : transport_(t), backlog_(backlog ? backlog : 1)
+{
+}
+
+EventMonitor::~EventMonitor() { stop(); }
+
+void EventMonitor::start(unsigned slice_ms)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  if (thread_.joinable())
+  {
+    if (!stop_)
+      return;
+    thread_.join(); // reader died on a transport error; restart it
+  }
+  stop_ = false;
+  thread_ = std::thread(&EventMonitor::run_, this, slice_ms ? slice_ms : 1);
+}
+
+void EventMonitor::stop()
+{
+  std::thread t;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+    t = std::move(thread_);
+  }
+  cv_.notify_all();
+  if (t.joinable())
+    t.join();
+}
+
+bool EventMonitor::running() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return thread_.joinable() && !stop_;
+}
+
+void EventMonitor::run_(unsigned slice_ms)
+{
+  trace_thread_name("event monitor");
+  std::uint8_t buf[64];
+  for (;;)
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (stop_)
+        return;
+    }
+
+    int n = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    try
+    {
+      n = transport_.read_intr(buf, sizeof(buf), slice_ms);
+    }
+    catch (const std::exception &e)
+    {
+      LOG_ERROR("EventMonitor: interrupt read failed: %s", e.what());
+      std::lock_guard<std::mutex> lk(mu_);
+      stop_ = true;
+      cv_.notify_all();
+      return;
+    }
+    if (n <= 0)
+    {
+      // a transport without an interrupt pipe returns at once; wait out the
+      // slice instead of spinning
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait_until(lk, t0 + std::chrono::milliseconds(slice_ms), [&]
+                     { return stop_; });
+      continue;
+    }
+
+    if (auto ev = PtpEvent::parse(buf, (std::size_t)n))
+    {
+      LOG_DEBUG("PTP event 0x%04X p0=0x%08X", ev->code,
+                ev->params.empty() ? 0u : ev->params[0]);
+      push_(std::move(*ev));
+    }
+    else
+    {
+      LOG_WARN("EventMonitor: dropping malformed event (%d bytes)", n);
+    }
+  }
+}
+
+void EventMonitor::push_(PtpEvent ev)
+{
+  {
+    std::lock_guard<std::mutex> lk(listeners_mu_);
+    for (auto &l : listeners_)
+      l.second(ev);
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (queue_.size() >= backlog_)
+      queue_.pop_front();
+    queue_.push_back({next_seq_++, std::chrono::steady_clock::now(), std::move(ev)});
+  }
+  cv_.notify_all();
+}
+
+std::optional<PtpEvent> EventMonitor::wait(const EventPredicate &pred,
+                                           std::chrono::milliseconds timeout,
+                                           std::chrono::steady_clock::time_point since)
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::uint64_t seen = 0; // highest seq already tested by this waiter
+  std::vector<Entry> fresh;
+  auto untested = [&](const Entry &e)
+  { return e.seq > seen && e.at >= since; };
+
+  std::unique_lock<std::mutex> lk(mu_);
+  for (;;)
+  {
+    fresh.clear();
+    for (const auto &e : queue_)
+      if (untested(e))
+        fresh.push_back(e);
+
+    if (!fresh.empty())
+    {
+      lk.unlock();
+      auto hit = std::find_if(fresh.begin(), fresh.end(), [&](const Entry &e)
+                              { return !pred || pred(e.ev); });
+      lk.lock();
+      // events after the hit were not tested; if another waiter takes the
+      // hit, the re-scan starts right after it
+      seen = hit != fresh.end() ? hit->seq : fresh.back().seq;
+      if (hit != fresh.end())
+      {
+        // consume it, unless another waiter was faster
+        auto it = std::find_if(queue_.begin(), queue_.end(), [&](const Entry &e)
+                               { return e.seq == hit->seq; });
+        if (it != queue_.end())
+        {
+          PtpEvent ev = std::move(it->ev);
+          queue_.erase(it);
+          return ev;
+        }
+      }
+      continue; // re-scan: new events may have landed while unlocked
+    }
+
+    if (stop_)
+      return std::nullopt;
+    if (cv_.wait_until(lk, deadline) == std::cv_status::timeout)
+    {
+      // last chance for events that raced with the timeout
+      bool more = std::any_of(queue_.begin(), queue_.end(), untested);
+      if (!more)
+        return std::nullopt;
+    }
+  }
+}
+
+int EventMonitor::add_listener(EventListener l)
+{
+  std::lock_guard<std::mutex> lk(listeners_mu_);
+  const int id = next_listener_id_++;
+  listeners_.emplace_back(id, std::move(l));
+  return id;
+}
+
+void EventMonitor::remove_listener(int id)
+{
+  std::lock_guard<std::mutex> lk(listeners_mu_);
+  listeners_.erase(std::remove_if(listeners_.begin(), listeners_.end(),
+                                  [&](const auto &l)
+                                  { return l.first == id; }),
+                   listeners_.end());
+}
+
+void EventMonitor::clear()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  queue_.clear();
+}
@@ -1,3 +1,5 @@
+#include <chrono>
+
 #include "ptp/fake_transport.h"
 
 inline std::vector<uint8_t>
@@ -20,6 +22,45 @@ void FakeTransport::queue_read(const std::vector<uint8_t> &v)
     rx.insert(rx.end(), v.begin(), v.end());
 }
 
+void FakeTransport::respond_data(uint16_t opcode,
+                                 const std::vector<uint8_t> &payload)
+{
+    canned_[opcode] = [payload](const std::vector<uint32_t> &)
+    { return payload; };
+}
+
+void FakeTransport::respond_with(uint16_t opcode, DataHandler handler)
+{
+    canned_[opcode] = std::move(handler);
+}
+
+void FakeTransport::fail_next(uint16_t opcode, uint16_t response_code)
+{
+    fail_next_[opcode].push_back(response_code);
+}
+
+void FakeTransport::drop_next(uint16_t opcode)
+{
+    fail_next_[opcode].push_back(0);
+}
+
+std::size_t FakeTransport::command_count(uint16_t opcode) const
+{
+    return std::count_if(writes.begin(), writes.end(), [&](const auto &w)
+                         { return w.size() >= 12 &&
+                                  read_16le(&w[4]) == PTP_CONTAINER_COMMAND &&
+                                  read_16le(&w[6]) == opcode; });
+}
+
+void FakeTransport::queue_event(const std::vector<uint8_t> &v)
+{
+    {
+        std::lock_guard<std::mutex> lk(ev_mu_);
+        ev_.push_back(v);
+    }
+    ev_cv_.notify_all();
+}
+
 void FakeTransport::open_first() { open_ = true; }
 void FakeTransport::open_vid_pid(uint16_t, uint16_t) { open_ = true; }
 bool FakeTransport::is_open() const { return open_; }
@@ -28,6 +69,7 @@ void FakeTransport::close()
     open_ = false;
     writes.clear();
     rx.clear();
+    rx_left_ = 0;
 }
 
 void FakeTransport::write_exact(const void *data, int len, unsigned)
@@ -36,35 +78,95 @@ void FakeTransport::write_exact(const void *data, int len, unsigned)
     writes.emplace_back(p, p + len);
     // capture txn from the Command to auto-reply later
     if (len >= 12 && read_16le(&writes.back()[4]) == PTP_CONTAINER_COMMAND)
+    {
         last_txn = read_32le(&writes.back()[8]);
+        auto fail = fail_next_.find(read_16le(&writes.back()[6]));
+        if (fail != fail_next_.end())
+        {
+            const uint16_t code = fail->second.front();
+            if (code != 0)
+                queue_read(build_resp(code, last_txn));
+            answered_txn_ = last_txn;
+            fail->second.pop_front();
+            if (fail->second.empty())
+                fail_next_.erase(fail);
+            return;
+        }
+        auto it = canned_.find(read_16le(&writes.back()[6]));
+        if (it != canned_.end())
+        {
+            std::vector<uint32_t> params;
+            for (int off = 12; off + 4 <= len; off += 4)
+                params.push_back(read_32le(p + off));
+            const auto payload = it->second(params);
+            std::vector<uint8_t> dc;
+            put_32le(dc, uint32_t(12 + payload.size()));
+            put_16le(dc, PTP_CONTAINER_DATA);
+            put_16le(dc, it->first);
+            put_32le(dc, last_txn);
+            dc.insert(dc.end(), payload.begin(), payload.end());
+            queue_read(dc);
+            queue_read(build_resp(PTP_RESP_OK, last_txn));
+            answered_txn_ = last_txn;
+        }
+    }
 }
 
 int FakeTransport::read_some(void *buf, int max, unsigned)
 {
+    if (zlp_pending_)
+    {
+        zlp_pending_ = false;
+        return 0;
+    }
     ensure_auto_ok(); // push OK response if nothing queued yet
     if (rx.empty())
         return 0;
-    const int n = std::min<int>(max, (int)rx.size());
+    // like a bulk pipe, never hand out more than the container at the head
+    if (rx_left_ == 0)
+    {
+        rx_left_ = rx.size(); // not a container: hand out raw bytes
+        if (rx.size() >= 4)
+        {
+            const uint32_t len = uint32_t(rx[0]) | (uint32_t(rx[1]) << 8) |
+                                 (uint32_t(rx[2]) << 16) | (uint32_t(rx[3]) << 24);
+            if (len >= 12 && len <= rx.size())
+                rx_left_ = rx_len_ = len;
+        }
+    }
+    const int n = std::min<int>(max, (int)rx_left_);
+    rx_left_ -= n;
+    // a container of whole packets ends with a ZLP; an exactly full read
+    // leaves it on the pipe
+    if (rx_left_ == 0 && rx_len_ != 0)
+    {
+        zlp_pending_ = rx_len_ % kPacket == 0 && n == max;
+        rx_len_ = 0;
+    }
     auto *out = static_cast<uint8_t *>(buf);
     std::copy_n(rx.begin(), n, out);
     rx.erase(rx.begin(), rx.begin() + n);
     return n;
 }
 
-int FakeTransport::read_intr(void *buf, int max, unsigned)
+int FakeTransport::read_intr(void *buf, int max, unsigned timeout_ms)
 {
-    if (ev_.empty())
+    std::unique_lock<std::mutex> lk(ev_mu_);
+    if (!ev_cv_.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+                         [&]
+                         { return !ev_.empty(); }))
         return 0;
-    const int n = std::min<int>(max, (int)ev_.size());
-    auto *out = static_cast<uint8_t *>(buf);
-    std::copy_n(ev_.begin(), n, out);
-    ev_.erase(ev_.begin(), ev_.begin() + n);
+    const auto ev = std::move(ev_.front());
+    ev_.pop_front();
+    const int n = std::min<int>(max, (int)ev.size());
+    std::copy_n(ev.begin(), n, static_cast<uint8_t *>(buf));
     return n;
 }
 
 void FakeTransport::ensure_auto_ok()
 {
-    if (!auto_ok || !rx.empty() || last_txn == 0)
+    if (!auto_ok || !rx.empty() || last_txn == 0 || last_txn == answered_txn_)
         return;
     queue_read(build_resp(PTP_RESP_OK, last_txn));
+    answered_txn_ = last_txn;
 }
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <exception>
+
+#include "ptp/object_catalog.h"
+#include "ptp/ptp.h"
+#include "utils/log.h"
+#include "utils/utils.h"
+
+// ---------- ObjectInfo ----------
+void ObjectInfo::decode(const std::vector<std::uint8_t> &raw)
+{
+  size_t i = 0;
+  StorageID = get_32le(raw, i);
+  ObjectFormat = get_16le(raw, i);
+  ProtectionStatus = get_16le(raw, i);
+  ObjectCompressedSize = get_32le(raw, i);
+  ThumbFormat = get_16le(raw, i);
+  ThumbCompressedSize = get_32le(raw, i);
+  ThumbPixWidth = get_32le(raw, i);
+  ThumbPixHeight = get_32le(raw, i);
+  ImagePixWidth = get_32le(raw, i);
+  ImagePixHeight = get_32le(raw, i);
+  ImageBitDepth = get_32le(raw, i);
+  ParentObject = get_32le(raw, i);
+  AssociationType = get_16le(raw, i);
+  AssociationDesc = get_32le(raw, i);
+  SequenceNumber = get_32le(raw, i);
+  Filename = read_ptp_str(raw, i);
+  CaptureDate = read_ptp_str(raw, i);
+  ModificationDate = read_ptp_str(raw, i);
+  // Keywords is the last field and some bodies leave it out entirely
+  Keywords = i < raw.size() ? read_ptp_str(raw, i) : std::string();
+}
+
+// ---------- ObjectCatalog ----------
+ObjectCatalog::ObjectCatalog(CameraPTP &cam) : cam_(cam)
+{
+  auto &mon = cam_.events();
+  listener_id_ = mon.add_listener([this](const PtpEvent &ev)
+                                  { on_event_(ev); });
+  if (!mon.running())
+    mon.start();
+}
+
+ObjectCatalog::~ObjectCatalog() { cam_.events().remove_listener(listener_id_); }
+
+void ObjectCatalog::on_event_(const PtpEvent &ev)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  switch (ev.code)
+  {
+  case PTP_EVENT_ObjectAdded:
+  case PTP_EVENT_ObjectRemoved:
+  case PTP_EVENT_ObjectInfoChanged:
+    if (!ev.params.empty() && ev.params[0] != 0)
+      pending_.push_back(ev.params[0]);
+    break;
+  case PTP_EVENT_StoreAdded:
+  case PTP_EVENT_StoreRemoved:
+  case PTP_EVENT_DeviceReset:
+  case PTP_EVENT_UnreportedStatus:
+    stale_ = true;
+    break;
+  default:
+    break;
+  }
+}
+
+bool ObjectCatalog::fetch_(std::uint32_t handle, ObjectEntry &out)
+{
+  const auto raw = cam_.get_object_info(handle);
+  if (raw.empty())
+    return false; // InvalidObjectHandle: the object is gone
+  try
+  {
+    ObjectInfo oi;
+    oi.decode(raw);
+    out.handle = handle;
+    out.storage = oi.StorageID;
+    out.format = oi.ObjectFormat;
+    out.size = oi.ObjectCompressedSize;
+    out.filename = std::move(oi.Filename);
+    out.capture_date = std::move(oi.CaptureDate);
+    return true;
+  }
+  catch (const std::exception &e)
+  {
+    LOG_WARN("ObjectCatalog: bad ObjectInfo for 0x%08X: %s", handle, e.what());
+    return false;
+  }
+}
+
+void ObjectCatalog::build()
+{
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    // events from here on are replayed by the next refresh()
+    pending_.clear();
+    stale_ = false;
+  }
+
+  std::vector<ObjectEntry> fresh;
+  for (auto sid : cam_.get_storage_ids())
+  {
+    for (auto h : cam_.get_object_handles(sid))
+    {
+      ObjectEntry e;
+      if (fetch_(h, e))
+        fresh.push_back(std::move(e));
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(mu_);
+  slots_.clear();
+  count_ = 0;
+  rehash_(std::max<std::size_t>(16, fresh.size() * 2));
+  for (auto &e : fresh)
+    insert_(std::move(e));
+  LOG_DEBUG("ObjectCatalog: built with %zu objects", count_);
+}
+
+std::size_t ObjectCatalog::refresh()
+{
+  std::vector<std::uint32_t> todo;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!stale_)
+    {
+      todo.swap(pending_);
+      std::sort(todo.begin(), todo.end());
+      todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+    }
+  }
+  if (todo.empty())
+  {
+    bool stale;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      stale = stale_;
+    }
+    if (stale)
+    {
+      build();
+      return size();
+    }
+    return 0;
+  }
+
+  // one GetObjectInfo per touched handle; a failure means it was removed
+  for (auto h : todo)
+  {
+    ObjectEntry e;
+    const bool ok = fetch_(h, e);
+    std::lock_guard<std::mutex> lk(mu_);
+    erase_(h);
+    if (ok)
+      insert_(std::move(e));
+  }
+  return todo.size();
+}
+
+std::optional<ObjectEntry> ObjectCatalog::find(std::uint32_t handle) const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  if (slots_.empty() || handle == 0)
+    return std::nullopt;
+  const auto s = slot_(handle);
+  if (slots_[s].handle != handle)
+    return std::nullopt;
+  return slots_[s];
+}
+
+std::vector<ObjectEntry> ObjectCatalog::list() const
+{
+  std::vector<ObjectEntry> out;
+  std::lock_guard<std::mutex> lk(mu_);
+  out.reserve(count_);
+  for (const auto &e : slots_)
+    if (e.handle)
+      out.push_back(e);
+  return out;
+}
+
+std::size_t ObjectCatalog::size() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return count_;
+}
+
+void ObjectCatalog::for_each(
+    const std::function<void(const ObjectEntry &)> &fn) const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  for (const auto &e : slots_)
+    if (e.handle)
+      fn(e);
+}
+
+// --- flat table ---
+static inline std::size_t hash_handle(std::uint32_t h)
+{
+  return std::size_t(h * 0x9E3779B1u);
+}
+
+std::size_t ObjectCatalog::slot_(std::uint32_t handle) const
+{
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t s = hash_handle(handle) & mask;
+  while (slots_[s].handle != 0 && slots_[s].handle != handle)
+    s = (s + 1) & mask;
+  return s;
+}
+
+void ObjectCatalog::rehash_(std::size_t cap)
+{
+  std::size_t n = 16;
+  while (n < cap)
+    n <<= 1;
+  std::vector<ObjectEntry> old;
+  old.swap(slots_);
+  slots_.resize(n);
+  count_ = 0;
+  for (auto &e : old)
+    if (e.handle)
+      insert_(std::move(e));
+}
+
+void ObjectCatalog::insert_(ObjectEntry e)
+{
+  if (slots_.empty() || (count_ + 1) * 10 > slots_.size() * 7)
+    rehash_(slots_.size() * 2);
+  const auto s = slot_(e.handle);
+  if (slots_[s].handle == 0)
+    ++count_;
+  slots_[s] = std::move(e);
+}
+
+void ObjectCatalog::erase_(std::uint32_t handle)
+{
+  if (slots_.empty())
+    return;
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t hole = slot_(handle);
+  if (slots_[hole].handle == 0)
+    return;
+  slots_[hole] = ObjectEntry{};
+  --count_;
+  // backward-shift following entries so probes never cross an empty slot
+  for (std::size_t s = (hole + 1) & mask; slots_[s].handle != 0; s = (s + 1) & mask)
+  {
+    const std::size_t home = hash_handle(slots_[s].handle) & mask;
+    const bool movable = (s > hole) ? (home <= hole || home > s)
+                                    : (home <= hole && home > s);
+    if (movable)
+    {
+      slots_[hole] = std::move(slots_[s]);
+      slots_[s] = ObjectEntry{};
+      hole = s;
+    }
+  }
+}
@@ -1,31 +1,61 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
+#include <unistd.h>
 
 #include "ptp/ptp.h"
+#include "utils/log.h"
+#include "utils/trace.h"
 
 std::vector<std::uint8_t> CameraPTP::read_full_container_()
 {
-  std::vector<std::uint8_t> buf(1 << 20);
-  int n = transport_.read_some(buf.data(), (int)buf.size(), 3000);
+  // The first read is just big enough for the header and any small
+  // container; the buffer is then sized from the header, so a big DATA
+  // payload moved into a Response carries no spare megabyte.
+  //
+  // A transfer that is a whole number of USB packets ends with a
+  // zero-length packet. A read with room to spare takes it in the same
+  // transfer; one that is filled exactly leaves it for the next read.
+  std::uint8_t head[kHeadRead];
+  int n = transport_.read_some(head, (int)sizeof(head), 3000);
   if (n < (int)sizeof(PtpContainerHeader))
     throw std::runtime_error("short PTP header");
-  buf.resize(n);
-  const auto *h = reinterpret_cast<const PtpContainerHeader *>(buf.data());
-  const std::uint32_t need = h->total_length_bytes;
-  if (need <= buf.size())
-    return buf;
-  std::vector<std::uint8_t> out = buf;
-  while (out.size() < need)
+  const std::uint32_t need = read_32le(head);
+  if (need <= std::size_t(n))
   {
-    std::vector<std::uint8_t> more(1 << 20);
-    int m = transport_.read_some(more.data(), (int)more.size(), 3000);
-    out.insert(out.end(), more.begin(), more.begin() + m);
+    // kHeadRead is a multiple of every packet size: a ZLP is pending
+    std::uint8_t zlp[kHeadRead];
+    if (need == sizeof(head) && transport_.read_some(zlp, (int)sizeof(zlp), 3000) != 0)
+      LOG_WARN("PTP: expected a zero-length packet after a %zu byte container", sizeof(head));
+    return std::vector<std::uint8_t>(head, head + n);
   }
-  out.resize(need);
-  return out;
+  // Read the rest in place. Room is whole 4 KiB, so a read is never smaller
+  // than a USB packet, and always more than `need`, so the last read ends
+  // on the short or zero-length packet.
+  std::size_t have = std::size_t(n);
+  std::vector<std::uint8_t> buf((std::size_t(need) + 4096) & ~std::size_t(4095));
+  std::memcpy(buf.data(), head, have);
+  while (have < need)
+  {
+    constexpr std::size_t kMaxRead = 1 << 20;
+    // a capped read must stop short of the end, or it too would be exact
+    const std::size_t want = need - have > kMaxRead ? kMaxRead : buf.size() - have;
+    int m = transport_.read_some(buf.data() + have, (int)want, 3000);
+    if (m <= 0)
+      throw std::runtime_error("short PTP container");
+    have += std::size_t(m);
+  }
+  buf.resize(need);
+  return buf;
 }
 
 void CameraPTP::open_session(std::uint32_t sid)
 {
+  std::lock_guard<std::mutex> lk(txn_mu_);
+  if (needs_resync_)
+    resync_();
+  session_id_ = sid;
   std::vector<std::uint8_t> cmd(sizeof(PtpContainerHeader));
   auto *h = reinterpret_cast<PtpContainerHeader *>(cmd.data());
   h->total_length_bytes = sizeof(PtpContainerHeader) + 4;
@@ -39,6 +69,7 @@ void CameraPTP::open_session(std::uint32_t sid)
 
 void CameraPTP::close_session()
 {
+  std::lock_guard<std::mutex> lk(txn_mu_);
   std::vector<std::uint8_t> cmd(sizeof(PtpContainerHeader));
   auto *h = reinterpret_cast<PtpContainerHeader *>(cmd.data());
   h->total_length_bytes = sizeof(PtpContainerHeader);
@@ -49,9 +80,8 @@ void CameraPTP::close_session()
   (void)read_full_container_();
 }
 
-CameraPTP::Response CameraPTP::transact(
-    std::uint16_t opcode, const std::vector<std::uint32_t> &params,
-    const std::vector<std::uint8_t> *data_out, bool expect_data_in)
+std::uint32_t CameraPTP::write_command_(std::uint16_t opcode,
+                                       const std::vector<std::uint32_t> &params)
 {
   std::vector<std::uint8_t> cmd(sizeof(PtpContainerHeader));
   auto *ch = reinterpret_cast<PtpContainerHeader *>(cmd.data());
@@ -59,106 +89,566 @@ CameraPTP::Response CameraPTP::transact(
       std::uint32_t(sizeof(PtpContainerHeader) + params.size() * 4);
   ch->container_type = PTP_CONTAINER_COMMAND;
   ch->operation_or_response = opcode;
-  ch->transaction_id = next_tid_++;
+  const std::uint32_t tid = next_tid_++;
+  ch->transaction_id = tid;
   for (auto p : params)
-    put_32le(cmd, p);
+    put_32le(cmd, p); // may reallocate: `ch` is dead from here on
   transport_.write_exact(cmd.data(), (int)cmd.size());
+  return tid;
+}
 
-  if (data_out)
+void CameraPTP::write_data_(std::uint16_t opcode, std::uint32_t tid,
+                            std::uint64_t size, const DataProducer &fill)
+{
+  constexpr std::uint64_t hdr = sizeof(PtpContainerHeader);
+  if (size > 0xFFFFFFFFull - hdr)
+    throw std::runtime_error("object too large for one PTP data container");
+
+  // The header shares the first write with the body: a header-only bulk
+  // write would be a short packet and end the transfer early. Every write
+  // but the last is a full piece (a multiple of any USB packet size).
+  std::vector<std::uint8_t> piece(std::size_t(std::min<std::uint64_t>(kDataPiece, hdr + size)));
+  auto *dh = reinterpret_cast<PtpContainerHeader *>(piece.data());
+  dh->total_length_bytes = std::uint32_t(hdr + size);
+  dh->container_type = PTP_CONTAINER_DATA;
+  dh->operation_or_response = opcode;
+  dh->transaction_id = tid;
+
+  std::size_t used = hdr;
+  std::uint64_t left = size;
+  // The body already expects `size` bytes: if the producer gives out, the
+  // container is finished with zeros so the next command isn't read as its
+  // tail. The response to that transaction is left for resync_() to drain.
+  auto abandon = [&](const char *why)
+  {
+    needs_resync_ = true;
+    LOG_WARN("op 0x%04X: %s; padding %llu bytes", opcode, why, (unsigned long long)left);
+    try
+    {
+      for (;;)
+      {
+        const std::size_t k = std::size_t(std::min<std::uint64_t>(piece.size() - used, left));
+        std::memset(piece.data() + used, 0, k);
+        used += k;
+        left -= k;
+        transport_.write_exact(piece.data(), (int)used);
+        if (!left)
+          return;
+        used = 0;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      LOG_ERROR("op 0x%04X: padding failed: %s", opcode, e.what());
+    }
+  };
+
+  for (;;)
   {
-    std::vector<std::uint8_t> dc(sizeof(PtpContainerHeader));
-    auto *dh = reinterpret_cast<PtpContainerHeader *>(dc.data());
-    dh->total_length_bytes =
-        std::uint32_t(sizeof(PtpContainerHeader) + data_out->size());
-    dh->container_type = PTP_CONTAINER_DATA;
-    dh->operation_or_response = opcode;
-    dh->transaction_id = ch->transaction_id;
-    dc.insert(dc.end(), data_out->begin(), data_out->end());
-    transport_.write_exact(dc.data(), (int)dc.size());
+    while (used < piece.size() && left)
+    {
+      const std::size_t want = std::size_t(std::min<std::uint64_t>(piece.size() - used, left));
+      std::size_t n = 0;
+      try
+      {
+        n = std::min(fill(piece.data() + used, want), want);
+      }
+      catch (const std::exception &e)
+      {
+        abandon(e.what());
+        throw;
+      }
+      if (n == 0)
+      {
+        abandon("data source ended early");
+        throw std::runtime_error("data source ended before the declared size");
+      }
+      used += n;
+      left -= n;
+    }
+    try
+    {
+      transport_.write_exact(piece.data(), (int)used);
+    }
+    catch (...)
+    {
+      needs_resync_ = true; // the pipe state is unknown
+      throw;
+    }
+    if (!left)
+      return;
+    used = 0;
   }
+}
 
-  Response r{};
+bool CameraPTP::is_idempotent_(std::uint16_t opcode) const
+{
+  switch (opcode)
+  {
+  case PTP_OP_GetDeviceInfo:
+  case PTP_OP_GetStorageIDs:
+  case PTP_OP_GetStorageInfo:
+  case PTP_OP_GetNumObjects:
+  case PTP_OP_GetObjectHandles:
+  case PTP_OP_GetObjectInfo:
+  case PTP_OP_GetObject:
+  case PTP_OP_GetThumb:
+  case PTP_OP_GetDevicePropDesc:
+  case PTP_OP_GetDevicePropValue:
+  case PTP_OP_GetPartialObject:
+    return true;
+  default:
+    return false;
+  }
+}
 
-  // Read first inbound container. May be EVENT, DATA, or RESPONSE.
-  auto pkt = read_full_container_();
-  const auto *h = reinterpret_cast<const PtpContainerHeader *>(pkt.data());
+void CameraPTP::recover_session() { recover_session_(recoveries_.load()); }
 
-  // Drop stray events
-  int guard = 0;
-  while (h->container_type == PTP_CONTAINER_EVENT && guard++ < 8)
+void CameraPTP::recover_session_(std::uint32_t seen)
+{
+  std::lock_guard<std::mutex> lk(recover_mu_);
+  if (recoveries_.load() != seen)
   {
-    pkt = read_full_container_();
-    h = reinterpret_cast<const PtpContainerHeader *>(pkt.data());
+    LOG_INFO("PTP session already recovered by another thread");
+    return;
   }
-
-  // If DATA first, capture it, then read RESPONSE
-  if (h->container_type == PTP_CONTAINER_DATA)
+  recover_owner_ = std::this_thread::get_id();
+  struct Release
   {
-    r.data.assign(pkt.begin() + sizeof(PtpContainerHeader),
-                  pkt.begin() + h->total_length_bytes);
+    std::atomic<std::thread::id> &owner;
+    ~Release() { owner = std::thread::id(); }
+  } release{recover_owner_};
+
+  const std::uint32_t sid = session_id_ ? session_id_ : 1;
+  LOG_WARN("PTP session lost; reopening session %u", sid);
+  open_session(sid);
+  on_session_restored_();
+  ++recoveries_;
+}
 
-    // RESPONSE must follow
-    auto rpkt = read_full_container_();
-    const auto *rh = reinterpret_cast<const PtpContainerHeader *>(rpkt.data());
-    if (rh->container_type != PTP_CONTAINER_RESPONSE)
-      throw std::runtime_error("expected response container after data");
+CameraPTP::Response CameraPTP::transact(
+    std::uint16_t opcode, const std::vector<std::uint32_t> &params,
+    const std::vector<std::uint8_t> *data_out, bool expect_data_in)
+{
+  return transact_(opcode, params, data_out, false);
+}
 
-    r.response_code = rh->operation_or_response;
+CameraPTP::Response CameraPTP::transact_in_place(std::uint16_t opcode,
+                                                 const std::vector<std::uint32_t> &params)
+{
+  return transact_(opcode, params, nullptr, true);
+}
 
-    const std::uint8_t *p = rpkt.data() + sizeof(PtpContainerHeader);
-    while (p < rpkt.data() + rh->total_length_bytes)
+CameraPTP::Response CameraPTP::transact_(std::uint16_t opcode,
+                                         const std::vector<std::uint32_t> &params,
+                                         const std::vector<std::uint8_t> *data_out,
+                                         bool in_place)
+{
+  if (!auto_recover_ || recover_owner_.load() == std::this_thread::get_id())
+    return transact_once_(opcode, params, data_out, in_place);
+
+  const std::uint32_t seen = recoveries_.load();
+  Response r;
+  try
+  {
+    r = transact_once_(opcode, params, data_out, in_place);
+  }
+  catch (const std::runtime_error &e)
+  {
+    if (!is_idempotent_(opcode))
+      throw;
+    // Most likely a timeout with the session still open: drain what is
+    // left of the attempt and try once more before reopening the session,
+    // which resets the body (ConfigApi) and replays every setting.
+    LOG_WARN("op 0x%04X failed (%s); resyncing and retrying", opcode, e.what());
+    {
+      std::lock_guard<std::mutex> lk(txn_mu_);
+      needs_resync_ = true;
+    }
+    try
+    {
+      r = transact_once_(opcode, params, data_out, in_place);
+    }
+    catch (const std::runtime_error &e2)
     {
-      std::uint32_t v = std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) |
-                        (std::uint32_t(p[2]) << 16) |
-                        (std::uint32_t(p[3]) << 24);
-      r.params.push_back(v);
-      p += 4;
+      LOG_WARN("op 0x%04X failed again (%s); recovering", opcode, e2.what());
+      recover_session_(seen);
+      return transact_once_(opcode, params, data_out, in_place);
     }
+  }
+
+  if (r.response_code != PTP_RESP_SessionNotOpen &&
+      r.response_code != PTP_RESP_IncompleteTransfer)
     return r;
+  LOG_WARN("op 0x%04X answered 0x%04X; recovering", opcode, r.response_code);
+  recover_session_(seen);
+  // SessionNotOpen means the command was ignored, so replaying it is safe
+  if (r.response_code == PTP_RESP_SessionNotOpen || is_idempotent_(opcode))
+    return transact_once_(opcode, params, data_out, in_place);
+  return r;
+}
+
+CameraPTP::Response CameraPTP::transact_once_(
+    std::uint16_t opcode, const std::vector<std::uint32_t> &params,
+    const std::vector<std::uint8_t> *data_out, bool in_place)
+{
+  std::lock_guard<std::mutex> lk(txn_mu_);
+  if (needs_resync_)
+    resync_();
+  TraceScope ts("transact", "ptp");
+  const std::uint32_t tid = write_command_(opcode, params);
+  if (ts)
+  {
+    ts.arg("opcode", opcode);
+    ts.arg("tid", tid);
+    ts.arg("bytes_out", data_out ? data_out->size() : 0);
   }
+  if (data_out)
+  {
+    std::size_t at = 0;
+    write_data_(opcode, tid, data_out->size(),
+                [&](std::uint8_t *buf, std::size_t max)
+                {
+                  std::memcpy(buf, data_out->data() + at, max);
+                  at += max;
+                  return max;
+                });
+  }
+  Response r = read_response_(tid, in_place);
+  if (ts)
+  {
+    ts.arg("bytes_in", r.data.size() - r.data_offset);
+    ts.arg("response", r.response_code);
+  }
+  return r;
+}
 
-  // If RESPONSE directly, accept it (some bodies skip DATA even when you
-  // “expect” it)
-  if (h->container_type == PTP_CONTAINER_RESPONSE)
+CameraPTP::Response CameraPTP::transact_stream(
+    std::uint16_t opcode, const std::vector<std::uint32_t> &params,
+    std::uint64_t size, const DataProducer &fill)
+{
+  const std::uint32_t seen = recoveries_.load();
+  Response r;
   {
-    r.response_code = h->operation_or_response;
+    std::lock_guard<std::mutex> lk(txn_mu_);
+    if (needs_resync_)
+      resync_();
+    TraceScope ts("transact", "ptp");
+    const std::uint32_t tid = write_command_(opcode, params);
+    if (ts)
+    {
+      ts.arg("opcode", opcode);
+      ts.arg("tid", tid);
+      ts.arg("bytes_out", size);
+    }
+    write_data_(opcode, tid, size, fill);
+    r = read_response_(tid);
+    if (ts)
+    {
+      ts.arg("bytes_in", r.data.size());
+      ts.arg("response", r.response_code);
+    }
+  }
+  // the producer is spent: restore the session but leave the retry to the caller
+  if (auto_recover_ && recover_owner_.load() != std::this_thread::get_id() &&
+      (r.response_code == PTP_RESP_SessionNotOpen ||
+       r.response_code == PTP_RESP_IncompleteTransfer))
+    recover_session_(seen);
+  return r;
+}
 
-    const std::uint8_t *p = pkt.data() + sizeof(PtpContainerHeader);
-    while (p < pkt.data() + h->total_length_bytes)
+std::size_t CameraPTP::run_batch(const Request *reqs, std::size_t n, Response *results,
+                                 BatchMode mode)
+{
+  constexpr std::size_t hdr = sizeof(PtpContainerHeader);
+  const std::uint32_t seen = recoveries_.load();
+  std::size_t done = 0;
+  bool lost_session = false;
+  {
+    std::lock_guard<std::mutex> lk(txn_mu_);
+    if (needs_resync_)
+      resync_();
+    TraceScope ts("run_batch", "ptp");
+    ts.arg("ops", n);
+
+    // Encode everything up front; tids are stamped as each op goes out so
+    // a batch that stops early doesn't burn ids.
+    batch_arena_.clear();
+    batch_offset_.clear();
+    for (std::size_t i = 0; i < n; ++i)
     {
-      std::uint32_t v = std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) |
-                        (std::uint32_t(p[2]) << 16) |
-                        (std::uint32_t(p[3]) << 24);
-      r.params.push_back(v);
-      p += 4;
+      const Request &q = reqs[i];
+      if (q.nparams > 5)
+        throw std::invalid_argument("run_batch: more than 5 params");
+      if (q.data_size > 0xFFFFFFFFull - hdr)
+        throw std::runtime_error("run_batch: data phase too large");
+      batch_offset_.push_back(batch_arena_.size());
+      put_32le(batch_arena_, std::uint32_t(hdr + 4 * q.nparams));
+      put_16le(batch_arena_, PTP_CONTAINER_COMMAND);
+      put_16le(batch_arena_, q.opcode);
+      put_32le(batch_arena_, 0);
+      for (std::uint8_t k = 0; k < q.nparams; ++k)
+        put_32le(batch_arena_, q.params[k]);
+      if (q.data)
+      {
+        put_32le(batch_arena_, std::uint32_t(hdr + q.data_size));
+        put_16le(batch_arena_, PTP_CONTAINER_DATA);
+        put_16le(batch_arena_, q.opcode);
+        put_32le(batch_arena_, 0);
+        batch_arena_.insert(batch_arena_.end(), q.data, q.data + q.data_size);
+      }
     }
-    // r.data stays empty if device didn’t send DATA.
-    return r;
+
+    for (; done < n; ++done)
+    {
+      const Request &q = reqs[done];
+      const std::size_t at = batch_offset_[done];
+      const std::size_t cmd_len = hdr + 4 * q.nparams;
+      const std::uint32_t tid = next_tid_++;
+      put_32le_at(batch_arena_, tid, at + 8);
+      transport_.write_exact(batch_arena_.data() + at, int(cmd_len));
+      if (q.data)
+      {
+        put_32le_at(batch_arena_, tid, at + cmd_len + 8);
+        transport_.write_exact(batch_arena_.data() + at + cmd_len, int(hdr + q.data_size));
+      }
+      results[done] = read_response_(tid);
+
+      const std::uint16_t rc = results[done].response_code;
+      if (rc == PTP_RESP_OK)
+        continue;
+      if (rc == PTP_RESP_SessionNotOpen || rc == PTP_RESP_IncompleteTransfer)
+      {
+        lost_session = true; // the rest would fail the same way
+        ++done;
+        break;
+      }
+      if (mode == BatchMode::StopOnError)
+      {
+        ++done;
+        break;
+      }
+    }
+    ts.arg("ran", done);
   }
+  if (lost_session && auto_recover_ && recover_owner_.load() != std::this_thread::get_id())
+    recover_session_(seen);
+  return done;
+}
+
+std::size_t CameraPTP::run_batch(const std::vector<Request> &reqs,
+                                 std::vector<Response> &results, BatchMode mode)
+{
+  results.resize(reqs.size());
+  return run_batch(reqs.data(), reqs.size(), results.data(), mode);
+}
 
+static void parse_response_params(const std::vector<std::uint8_t> &pkt,
+                                  std::vector<std::uint32_t> &out)
+{
+  const auto *h = reinterpret_cast<const PtpContainerHeader *>(pkt.data());
+  for (std::size_t i = sizeof(PtpContainerHeader); i + 4 <= h->total_length_bytes; i += 4)
+    out.push_back(read_32le(pkt.data() + i));
+}
+
+CameraPTP::Response CameraPTP::read_response_(std::uint32_t tid, bool in_place)
+{
+  Response r{};
+  bool have_data = false;
+  int events = 0;
+  int stale = 0;
+  for (;;)
+  {
+    // May be EVENT, DATA, or RESPONSE, and possibly left over from an
+    // earlier transaction that timed out.
+    std::vector<std::uint8_t> pkt;
+    try
+    {
+      pkt = read_full_container_();
+    }
+    catch (...)
+    {
+      needs_resync_ = true; // whatever we missed may still arrive later
+      throw;
+    }
+    const auto *h = reinterpret_cast<const PtpContainerHeader *>(pkt.data());
+
+    if (h->container_type == PTP_CONTAINER_EVENT)
+    {
+      // Drop stray events
+      if (++events > 8)
+        break;
+      continue;
+    }
+    if (h->transaction_id != tid)
+    {
+      LOG_WARN("dropping stale container type %u code 0x%04X tid %u (expected %u)",
+               h->container_type, h->operation_or_response, h->transaction_id, tid);
+      if (++stale > kMaxStaleContainers)
+      {
+        needs_resync_ = true;
+        throw std::runtime_error("transaction id mismatch");
+      }
+      continue;
+    }
+
+    // If DATA first, capture it; the RESPONSE must follow
+    if (h->container_type == PTP_CONTAINER_DATA && !have_data)
+    {
+      const std::size_t end = h->total_length_bytes;
+      if (end - sizeof(PtpContainerHeader) >= kMoveDataMin)
+      {
+        // big payloads keep their buffer; in place, the header stays too
+        pkt.resize(end);
+        if (in_place)
+          r.data_offset = sizeof(PtpContainerHeader);
+        else
+          pkt.erase(pkt.begin(), pkt.begin() + sizeof(PtpContainerHeader));
+        r.data = std::move(pkt);
+      }
+      else
+        r.data.assign(pkt.begin() + sizeof(PtpContainerHeader), pkt.begin() + end);
+      have_data = true;
+      continue;
+    }
+
+    // A RESPONSE directly is accepted too (some bodies skip DATA even when
+    // you “expect” it); r.data then stays empty.
+    if (h->container_type == PTP_CONTAINER_RESPONSE)
+    {
+      r.response_code = h->operation_or_response;
+      parse_response_params(pkt, r.params);
+      return r;
+    }
+    if (have_data)
+    {
+      needs_resync_ = true;
+      throw std::runtime_error("expected response container after data");
+    }
+    break;
+  }
+  needs_resync_ = true;
   throw std::runtime_error("unexpected container type");
 }
 
+void CameraPTP::resync_()
+{
+  // Anything still queued on bulk IN belongs to a transaction we gave up
+  // on. Read it away with short timeouts until the pipe is quiet.
+  std::vector<std::uint8_t> buf(1 << 20);
+  std::size_t dropped = 0;
+  for (int i = 0; i < 64; ++i)
+  {
+    int n = 0;
+    try
+    {
+      n = transport_.read_some(buf.data(), (int)buf.size(), kResyncDrainMs);
+    }
+    catch (const std::exception &)
+    {
+      break; // timeout: drained
+    }
+    if (n <= 0)
+      break;
+    dropped += std::size_t(n);
+  }
+  needs_resync_ = false;
+  ++resyncs_;
+  LOG_INFO("resync: drained %zu stale bytes", dropped);
+}
+
+EventMonitor &CameraPTP::events()
+{
+  if (!events_)
+    events_ = std::make_unique<EventMonitor>(transport_);
+  return *events_;
+}
+
+void CameraPTP::start_event_monitor(unsigned slice_ms)
+{
+  events().start(slice_ms);
+}
+
+void CameraPTP::stop_event_monitor()
+{
+  if (events_)
+    events_->stop();
+}
+
+std::optional<std::uint32_t>
+CameraPTP::wait_object_added(std::chrono::milliseconds timeout,
+                             const EventPredicate &pred,
+                             std::optional<std::chrono::steady_clock::time_point> since)
+{
+  const auto from = since ? *since : std::chrono::steady_clock::now();
+  auto &mon = events();
+  if (!mon.running())
+    mon.start();
+  auto ev = mon.wait(
+      [&](const PtpEvent &e)
+      {
+        return e.code == PTP_EVENT_ObjectAdded && !e.params.empty() &&
+               (!pred || pred(e));
+      },
+      timeout, from);
+  if (!ev)
+    return std::nullopt;
+  return ev->params[0];
+}
+
 std::optional<std::uint32_t> CameraPTP::wait_object_added(int timeout_ms,
                                                           int poll_ms)
 {
-  const int tries = timeout_ms / poll_ms;
-  for (int i = 0; i < tries; ++i)
+  auto &mon = events();
+  if (!mon.running())
+    mon.start(poll_ms > 0 ? unsigned(poll_ms) : 100u);
+  return wait_object_added(std::chrono::milliseconds(timeout_ms));
+}
+
+EventPredicate CameraPTP::object_in_storage(std::uint32_t storage_id)
+{
+  return [this, storage_id](const PtpEvent &e)
   {
-    auto ev = event(poll_ms); // interrupt IN
-    if (ev.size() >= 16)
+    if (e.params.empty())
+      return false;
+    auto info = get_object_info(e.params[0]); // StorageID leads the dataset
+    return info.size() >= 4 && read_32le(info.data()) == storage_id;
+  };
+}
+
+const DeviceInfo &CameraPTP::device_info()
+{
+  if (device_info_)
+    return *device_info_;
+
+  const bool cached = !devinfo_cache_dir_.empty() && !devinfo_cache_key_.empty();
+  if (cached)
+  {
+    if (auto raw = DeviceInfoCache(devinfo_cache_dir_).load(devinfo_cache_key_))
     {
-      const std::uint16_t type = ev[4] | (ev[5] << 8); // 4 = Event
-      const std::uint16_t code = ev[6] | (ev[7] << 8); // 0x4002 = ObjectAdded
-      if (type == PTP_CONTAINER_EVENT && code == PTP_EVENT_ObjectAdded)
+      try
+      {
+        DeviceInfo di;
+        di.decode(*raw);
+        device_info_ = std::move(di);
+        LOG_DEBUG("DeviceInfo loaded from cache (%s)", devinfo_cache_key_.c_str());
+        return *device_info_;
+      }
+      catch (const std::exception &e)
       {
-        std::uint32_t handle =
-            ev[12] | (ev[13] << 8) | (ev[14] << 16) | (ev[15] << 24);
-        return handle;
+        LOG_WARN("DeviceInfo cache entry %s unusable: %s",
+                 devinfo_cache_key_.c_str(), e.what());
       }
     }
   }
-  return std::nullopt;
+
+  const auto raw = get_device_info();
+  DeviceInfo di;
+  di.decode(raw);
+  device_info_ = std::move(di);
+  if (cached)
+    DeviceInfoCache(devinfo_cache_dir_).store(devinfo_cache_key_, raw);
+  return *device_info_;
 }
 
 // convenience
@@ -171,13 +661,12 @@ std::vector<std::uint32_t> CameraPTP::get_storage_ids()
 {
   auto d = transact(PTP_OP_GetStorageIDs, {}, nullptr, true).data;
   std::vector<std::uint32_t> ids;
-  for (size_t i = 0; i + 3 < d.size(); i += 4)
-  {
-    std::uint32_t v = std::uint32_t(d[i]) | (std::uint32_t(d[i + 1]) << 8) |
-                      (std::uint32_t(d[i + 2]) << 16) |
-                      (std::uint32_t(d[i + 3]) << 24);
-    ids.push_back(v);
-  }
+  if (d.size() < 4)
+    return ids;
+  // AUINT32: <count:u32><items...>
+  const std::uint32_t n = read_32le(d.data());
+  for (size_t i = 4; i + 3 < d.size() && ids.size() < n; i += 4)
+    ids.push_back(read_32le(&d[i]));
   return ids;
 }
 
@@ -279,6 +768,25 @@ void CameraPTP::send_object(const std::vector<std::uint8_t> &object_bytes)
   (void)transact(PTP_OP_SendObject, {}, &object_bytes, false);
 }
 
+void CameraPTP::send_object(std::uint64_t size, const DataProducer &fill)
+{
+  (void)transact_stream(PTP_OP_SendObject, {}, size, fill);
+}
+
+void CameraPTP::send_object(int fd, std::uint64_t size)
+{
+  send_object(size, [fd](std::uint8_t *buf, std::size_t max) -> std::size_t
+              {
+    for (;;)
+    {
+      const ssize_t n = ::read(fd, buf, max);
+      if (n >= 0)
+        return std::size_t(n);
+      if (errno != EINTR)
+        throw std::runtime_error(std::string("send_object read: ") + std::strerror(errno));
+    } });
+}
+
 void CameraPTP::delete_object(std::uint32_t handle)
 {
   (void)transact(PTP_OP_DeleteObject, {handle}, nullptr, false);
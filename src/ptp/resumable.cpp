@@ -0,0 +1,171 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ptp/resumable.h"
+#include "utils/log.h"
+
+static std::runtime_error sys_error(const std::string &what)
+{
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// ---------- DownloadCheckpoint ----------
+std::optional<DownloadCheckpoint>
+DownloadCheckpoint::load(const std::string &path)
+{
+  std::ifstream f(path);
+  if (!f)
+    return std::nullopt;
+  DownloadCheckpoint cp;
+  bool have_offset = false;
+  std::string line;
+  try
+  {
+    while (std::getline(f, line))
+    {
+      const auto eq = line.find('=');
+      if (eq == std::string::npos)
+        continue;
+      const std::string key = line.substr(0, eq);
+      const std::string val = line.substr(eq + 1);
+      if (key == "kind")
+        cp.kind = val;
+      else if (key == "id")
+        cp.id = std::uint32_t(std::stoul(val));
+      else if (key == "size")
+        cp.size = std::stoull(val);
+      else if (key == "name")
+        cp.name = val;
+      else if (key == "offset")
+      {
+        cp.offset = std::stoull(val);
+        have_offset = true;
+      }
+    }
+  }
+  catch (const std::exception &)
+  {
+    return std::nullopt; // corrupt sidecar: start over
+  }
+  if (cp.kind.empty() || !have_offset || cp.offset > cp.size)
+    return std::nullopt;
+  return cp;
+}
+
+void DownloadCheckpoint::save(const std::string &path) const
+{
+  const std::string tmp = path + ".tmp";
+  const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw sys_error("checkpoint open " + tmp);
+  const std::string body = "kind=" + kind + "\nid=" + std::to_string(id) +
+                           "\nsize=" + std::to_string(size) + "\nname=" + name +
+                           "\noffset=" + std::to_string(offset) + "\n";
+  FdSink out(fd);
+  try
+  {
+    out.write(reinterpret_cast<const std::uint8_t *>(body.data()), body.size());
+    out.sync();
+  }
+  catch (...)
+  {
+    ::close(fd);
+    std::remove(tmp.c_str());
+    throw;
+  }
+  ::close(fd);
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    throw sys_error("checkpoint rename " + path);
+}
+
+// ---------- ResumableFile ----------
+ResumableFile::ResumableFile(const std::string &path,
+                             DownloadCheckpoint identity,
+                             std::uint64_t sync_every)
+    : path_(path), sidecar_(path + ".part"), cp_(std::move(identity)),
+      sync_every_(sync_every ? sync_every : 1)
+{
+  cp_.offset = 0;
+  fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT, 0644);
+  if (fd_ < 0)
+    throw sys_error("open " + path_);
+
+  auto prev = DownloadCheckpoint::load(sidecar_);
+  struct stat st{};
+  if (prev && prev->same_file(cp_) && ::fstat(fd_, &st) == 0 &&
+      std::uint64_t(st.st_size) >= prev->offset)
+  {
+    cp_.offset = prev->offset;
+    resumed_ = cp_.offset > 0;
+  }
+  else if (::ftruncate(fd_, 0) != 0)
+  {
+    ::close(fd_);
+    throw sys_error("truncate " + path_);
+  }
+
+  if (::lseek(fd_, off_t(cp_.offset), SEEK_SET) < 0)
+  {
+    ::close(fd_);
+    throw sys_error("seek " + path_);
+  }
+  if (resumed_)
+    LOG_INFO("Resuming %s at %llu/%llu bytes", cp_.name.c_str(),
+             (unsigned long long)cp_.offset, (unsigned long long)cp_.size);
+  cp_.save(sidecar_);
+}
+
+ResumableFile::~ResumableFile()
+{
+  if (fd_ < 0)
+    return;
+  // keep what is durable for the next attempt
+  try
+  {
+    sync();
+  }
+  catch (const std::exception &e)
+  {
+    LOG_WARN("ResumableFile: final checkpoint failed: %s", e.what());
+  }
+  ::close(fd_);
+}
+
+void ResumableFile::write(const std::uint8_t *data, std::size_t len)
+{
+  FdSink(fd_).write(data, len);
+  pending_ += len;
+  if (pending_ >= sync_every_)
+    sync();
+}
+
+void ResumableFile::reserve(std::uint64_t total) { FdSink(fd_).reserve(total); }
+
+void ResumableFile::sync()
+{
+  if (pending_ == 0)
+    return;
+  FdSink(fd_).sync();
+  cp_.offset += pending_;
+  pending_ = 0;
+  cp_.save(sidecar_);
+}
+
+void ResumableFile::finish()
+{
+  FdSink(fd_).sync();
+  cp_.offset += pending_;
+  pending_ = 0;
+  // drop any fallocate tail past the real size
+  if (::ftruncate(fd_, off_t(cp_.offset)) != 0)
+    throw sys_error("truncate " + path_);
+  ::close(fd_);
+  fd_ = -1;
+  std::remove(sidecar_.c_str());
+}
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iterator>
+
+#include "ptp/object_catalog.h"
+#include "ptp/ptp.h"
+#include "ptp/thumbnail.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+ThumbnailService::ThumbnailService(CameraPTP &cam, ObjectCatalog &catalog,
+                                   ThumbnailOptions opt)
+    : cam_(cam), catalog_(catalog), opt_(std::move(opt))
+{
+}
+
+ThumbnailService::~ThumbnailService() { stop(); }
+
+// "<handle>_<size>_<capture date>" with the date reduced to [A-Za-z0-9.]
+std::string ThumbnailService::key_(const ObjectEntry &e)
+{
+  char head[32];
+  std::snprintf(head, sizeof(head), "%08X_%u_", e.handle, e.size);
+  std::string key = head;
+  for (char c : e.capture_date)
+  {
+    const bool ok = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                    (c >= '0' && c <= '9') || c == '.';
+    key += ok ? c : '_';
+  }
+  return key;
+}
+
+std::string ThumbnailService::disk_path_(const std::string &key) const
+{
+  return opt_.cache_dir + "/" + key + ".thumb";
+}
+
+// ---------- LRU (caller holds mu_) ----------
+Thumbnail ThumbnailService::lookup_(std::uint32_t handle, const std::string &key)
+{
+  auto it = index_.find(handle);
+  if (it == index_.end())
+    return nullptr;
+  if (it->second->key != key)
+  {
+    // handle now names another object
+    bytes_ -= it->second->data->size();
+    lru_.erase(it->second);
+    index_.erase(it);
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->data;
+}
+
+bool ThumbnailService::insert_(std::uint32_t handle, const std::string &key,
+                               Thumbnail data, bool evict)
+{
+  const std::size_t n = data->size();
+  if (n > opt_.memory_bytes)
+    return false;
+  auto it = index_.find(handle);
+  if (it != index_.end())
+  {
+    if (it->second->key == key)
+      return true;
+    bytes_ -= it->second->data->size();
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+  if (!evict && bytes_ + n > opt_.memory_bytes)
+    return false;
+  while (bytes_ + n > opt_.memory_bytes && !lru_.empty())
+  {
+    bytes_ -= lru_.back().data->size();
+    index_.erase(lru_.back().handle);
+    lru_.pop_back();
+  }
+  lru_.push_front(Node{handle, key, std::move(data)});
+  index_[handle] = lru_.begin();
+  bytes_ += n;
+  return true;
+}
+
+// ---------- disk / camera ----------
+Thumbnail ThumbnailService::load_(const ObjectEntry &e, const std::string &key,
+                                  bool evict, bool use_disk, bool *kept)
+{
+  bool ignored;
+  if (!kept)
+    kept = &ignored;
+  *kept = false;
+  use_disk = use_disk && !opt_.cache_dir.empty();
+  if (use_disk)
+  {
+    std::ifstream f(disk_path_(key), std::ios::binary);
+    if (f)
+    {
+      auto v = std::make_shared<std::vector<std::uint8_t>>(
+          (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+      Thumbnail t = std::move(v);
+      std::lock_guard<std::mutex> lk(mu_);
+      ++stats_.disk_hits;
+      *kept = insert_(e.handle, key, t, evict);
+      return t;
+    }
+  }
+
+  auto r = cam_.transact(PTP_OP_GetThumb, {e.handle}, nullptr, true);
+  Thumbnail t = std::make_shared<std::vector<std::uint8_t>>(std::move(r.data));
+  // only a definite answer is cached; a busy or failed fetch is retried next time
+  const bool definite = (r.response_code == PTP_RESP_OK && !t->empty()) ||
+                        r.response_code == PTP_RESP_NoThumbnailPresent;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    ++stats_.fetched;
+    if (definite)
+      *kept = insert_(e.handle, key, t, evict);
+  }
+  if (!definite)
+  {
+    LOG_DEBUG("ThumbnailService: GetThumb 0x%08X -> 0x%04X, not cached", e.handle,
+              r.response_code);
+    return std::make_shared<std::vector<std::uint8_t>>();
+  }
+  if (!use_disk || t->empty())
+    return t;
+
+  // write-then-rename so a concurrent reader never sees a torn file
+  const std::string path = disk_path_(key);
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char *>(t->data()), (std::streamsize)t->size());
+    if (!f)
+    {
+      LOG_WARN("ThumbnailService: cannot write %s", tmp.c_str());
+      std::remove(tmp.c_str());
+      return t;
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    LOG_WARN("ThumbnailService: cannot rename %s", tmp.c_str());
+    std::remove(tmp.c_str());
+  }
+  return t;
+}
+
+Thumbnail ThumbnailService::get(std::uint32_t handle)
+{
+  ObjectEntry e;
+  if (auto found = catalog_.find(handle))
+    e = *found;
+  else
+    e.handle = handle; // not catalogued yet: still cacheable in memory
+  const std::string key = key_(e);
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (auto t = lookup_(handle, key))
+    {
+      ++stats_.memory_hits;
+      return t;
+    }
+  }
+
+  ++foreground_;
+  struct Done
+  {
+    std::atomic<int> &n;
+    ~Done() { --n; }
+  } done{foreground_};
+  // without an identity the disk cache can be neither trusted nor filled
+  const bool known = e.size != 0 || !e.capture_date.empty();
+  return load_(e, key, true, known);
+}
+
+// ---------- prefetch ----------
+void ThumbnailService::prefetch()
+{
+  stop();
+  std::lock_guard<std::mutex> lk(run_mu_);
+  stop_ = false;
+  walking_ = true;
+  thread_ = std::thread(&ThumbnailService::run_, this);
+}
+
+void ThumbnailService::stop()
+{
+  std::thread t;
+  {
+    std::lock_guard<std::mutex> lk(run_mu_);
+    stop_ = true;
+    t = std::move(thread_);
+  }
+  run_cv_.notify_all();
+  if (t.joinable())
+    t.join();
+}
+
+bool ThumbnailService::wait_prefetch(std::chrono::milliseconds timeout)
+{
+  std::unique_lock<std::mutex> lk(run_mu_);
+  return run_cv_.wait_for(lk, timeout, [&]
+                          { return !walking_; });
+}
+
+void ThumbnailService::run_()
+{
+  trace_thread_name("thumbnail prefetch");
+  auto entries = catalog_.list();
+  std::sort(entries.begin(), entries.end(),
+            [](const ObjectEntry &a, const ObjectEntry &b)
+            { return a.handle < b.handle; });
+
+  std::size_t done = 0;
+  for (const auto &e : entries)
+  {
+    const std::string key = key_(e);
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      auto it = index_.find(e.handle);
+      if (it != index_.end() && it->second->key == key)
+        continue;
+    }
+    {
+      std::unique_lock<std::mutex> lk(run_mu_);
+      // yield to the foreground, and pace the walk so it never hogs the pipe
+      do
+        run_cv_.wait_for(lk, opt_.prefetch_gap, [&]
+                         { return stop_; });
+      while (!stop_ && foreground_.load() > 0);
+      if (stop_)
+        break;
+    }
+    try
+    {
+      bool kept = false;
+      Thumbnail t = load_(e, key, false, true, &kept);
+      ++done;
+      // without a disk cache, a thumbnail memory could not hold was fetched
+      // for nothing, and so would the rest
+      if (!kept && !t->empty() && opt_.cache_dir.empty())
+      {
+        LOG_DEBUG("thumbnail prefetch: memory budget full, stopping");
+        break;
+      }
+    }
+    catch (const std::exception &ex)
+    {
+      LOG_WARN("thumbnail prefetch 0x%08X: %s", e.handle, ex.what());
+    }
+  }
+  LOG_DEBUG("thumbnail prefetch: %zu of %zu objects loaded", done, entries.size());
+
+  {
+    std::lock_guard<std::mutex> lk(run_mu_);
+    walking_ = false;
+  }
+  run_cv_.notify_all();
+}
+
+std::size_t ThumbnailService::memory_bytes() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return bytes_;
+}
+
+ThumbnailStats ThumbnailService::stats() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
@@ -3,6 +3,7 @@
 #include <string>
 
 #include "ptp/usb_transport.h"
+#include "utils/trace.h"
 
 static inline void check(int rc, const char *what) {
   if (rc < 0)
@@ -115,6 +116,8 @@ void USBTransport::close() {
 }
 
 void USBTransport::write_exact(const void *data, int len, unsigned to) {
+  TraceScope ts("bulk_out", "usb");
+  ts.arg("bytes", len);
   int x = 0;
   check(libusb_bulk_transfer(dev_, ep_out_, (unsigned char *)data, len, &x, to),
         "bulk_out");
@@ -123,20 +126,24 @@ void USBTransport::write_exact(const void *data, int len, unsigned to) {
 }
 
 int USBTransport::read_some(void *buf, int max, unsigned to) {
+  TraceScope ts("bulk_in", "usb");
   int x = 0;
   check(libusb_bulk_transfer(dev_, ep_in_, (uint8_t *)buf, max, &x, to),
         "bulk_in");
+  ts.arg("bytes", x);
   return x;
 }
 
 int USBTransport::read_intr(void *buf, int max, unsigned to) {
   if (!ep_intr_)
     return 0;
+  TraceScope ts("intr_in", "usb");
   int x = 0;
   int rc =
       libusb_interrupt_transfer(dev_, ep_intr_, (uint8_t *)buf, max, &x, to);
   if (rc == LIBUSB_ERROR_TIMEOUT)
     return 0;
   check(rc, "intr_in");
+  ts.arg("bytes", x);
   return x;
 }
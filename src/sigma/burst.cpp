@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+#include "sigma/burst.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+BurstCapture::BurstCapture(SigmaCamera &cam, BurstOptions opt)
+    : cam_(cam), opt_(std::move(opt))
+{
+  if (opt_.depth == 0)
+    opt_.depth = 1;
+  // a batch larger than the DB would stall the shooter for good
+  opt_.clear_batch = std::min(std::max(opt_.clear_batch, 1u), opt_.depth);
+}
+
+// Polls until ImageDBTail (the newest entry) moves past `tail`; the
+// parameterless status can still describe the previous frame right after
+// a snap. The tail is an image id, so it wraps; 0 only ever means an empty
+// DB. Returns the last status read.
+CamCaptStatus BurstCapture::wait_new_tail_(std::uint8_t tail)
+{
+  const auto deadline = std::chrono::steady_clock::now() + opt_.wait.timeout;
+  for (;;)
+  {
+    CamCaptStatus st = cam_.get_cam_capt_status();
+    if (st.Status == CaptStatus::BufferFull || (st.ImageDBTail != tail && st.ImageDBTail != 0))
+      return st;
+    if (std::chrono::steady_clock::now() >= deadline)
+      throw std::runtime_error("burst: snapped frame never reached the image DB");
+    std::this_thread::sleep_for(opt_.wait.initial_interval);
+  }
+}
+
+void BurstCapture::shoot_()
+{
+  trace_thread_name("burst shooter");
+  try
+  {
+    std::uint8_t tail = cam_.get_cam_capt_status().ImageDBTail;
+    while (snapped_ < opt_.frames)
+    {
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&]
+                 { return abort_ || in_db_ < opt_.depth; });
+        if (abort_)
+          break;
+      }
+
+      const std::uint16_t rc = cam_.snap(opt_.mode, 1);
+      if (rc != PTP_RESP_OK)
+        throw std::runtime_error("SnapCommand refused");
+      // only this thread snaps, so the next new tail is the frame just taken
+      const CamCaptStatus st = wait_new_tail_(tail);
+      if (st.ImageDBTail == tail || st.ImageDBTail == 0)
+      {
+        // the body holds fewer frames than `depth`; snapping again would only
+        // be refused again, so wait until one of ours is cleared
+        std::unique_lock<std::mutex> lk(mu_);
+        if (in_db_ == 0)
+          throw std::runtime_error("burst: image DB is full of frames from before the burst");
+        LOG_WARN("burst: image DB full at %u frames; waiting for a clear", in_db_);
+        const unsigned full_at = in_db_;
+        stalled_ = true;
+        cv_.notify_all();
+        cv_.wait(lk, [&]
+                 { return abort_ || in_db_ < full_at; });
+        stalled_ = false;
+        continue;
+      }
+
+      tail = st.ImageDBTail;
+      std::lock_guard<std::mutex> lk(mu_);
+      shot_.push_back(tail);
+      ++in_db_;
+      ++snapped_;
+      cv_.notify_all();
+    }
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    error_ = std::current_exception();
+  }
+  std::lock_guard<std::mutex> lk(mu_);
+  shooting_ = false;
+  cv_.notify_all();
+}
+
+void BurstCapture::clear_(bool all)
+{
+  if (to_clear_.empty() || (!all && to_clear_.size() < opt_.clear_batch))
+    return;
+
+  static const std::vector<std::uint8_t> kPayload(10, 0x00); // as clear_image_db_single
+  std::vector<CameraPTP::Request> reqs(to_clear_.size());
+  for (std::size_t i = 0; i < reqs.size(); ++i)
+  {
+    reqs[i].opcode = static_cast<std::uint16_t>(SigmaOp::ClearImageDBSingle);
+    reqs[i].nparams = 1;
+    reqs[i].params[0] = to_clear_[i];
+    reqs[i].data = kPayload.data();
+    reqs[i].data_size = kPayload.size();
+  }
+  std::vector<CameraPTP::Response> res;
+  cam_.run_batch(reqs, res, CameraPTP::BatchMode::ContinueOnError);
+  for (std::size_t i = 0; i < res.size(); ++i)
+    if (res[i].response_code != PTP_RESP_OK)
+      LOG_WARN("burst: ClearImageDBSingle %u: resp=0x%04X", to_clear_[i],
+               res[i].response_code);
+
+  std::lock_guard<std::mutex> lk(mu_);
+  in_db_ -= unsigned(to_clear_.size());
+  to_clear_.clear();
+  cv_.notify_all();
+}
+
+BurstResult BurstCapture::run()
+{
+  using clock = std::chrono::steady_clock;
+  BurstResult out;
+  const auto t0 = clock::now();
+
+  shot_.clear();
+  to_clear_.clear();
+  in_db_ = snapped_ = 0;
+  shooting_ = true;
+  stalled_ = false;
+  abort_ = false;
+  error_ = nullptr;
+  std::filesystem::create_directories(opt_.dir);
+  std::thread shooter([this]
+                      { shoot_(); });
+  // frames already downloaded leave the image DB even if a later one fails
+  struct Flush
+  {
+    BurstCapture &b;
+    ~Flush()
+    {
+      try
+      {
+        b.clear_(true);
+      }
+      catch (const std::exception &e)
+      {
+        LOG_WARN("burst: clearing %zu finished frames failed: %s", b.to_clear_.size(),
+                 e.what());
+      }
+    }
+  } flush{*this};
+
+  try
+  {
+    for (;;)
+    {
+      std::uint8_t id;
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&]
+                 { return !shot_.empty() || !shooting_ || (stalled_ && !to_clear_.empty()); });
+        if (shot_.empty() && shooting_)
+        {
+          // the shooter waits on a clear that a partial batch would hold back
+          lk.unlock();
+          clear_(true);
+          continue;
+        }
+        if (shot_.empty())
+          break;
+        id = shot_.front();
+        shot_.pop_front();
+      }
+
+      TraceScope ts("burst_frame", "sigma");
+      ts.arg("image_id", id);
+      const CamCaptStatus st = cam_.wait_completion(id, opt_.wait);
+      if (st.Status != CaptStatus::ImageGenCompleted &&
+          st.Status != CaptStatus::ImageDataStorageCompleted)
+        throw std::runtime_error("burst: frame did not complete");
+
+      BurstFrame f;
+      f.image_id = id;
+      f.info = cam_.get_pict_file_info2(id);
+      const std::string name = f.info.FileName.empty()
+                                   ? "burst_" + std::to_string(id) + ".jpg"
+                                   : f.info.FileName;
+      f.path = (std::filesystem::path(opt_.dir) / name).string();
+      out.bytes += cam_.download_pict_file(f.info, f.path, opt_.chunk);
+      f.ready_at = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - t0);
+      ts.arg("bytes", f.info.FileSize);
+
+      to_clear_.push_back(id);
+      clear_(false);
+      if (on_frame)
+        on_frame(f);
+      out.frames.push_back(std::move(f));
+    }
+    clear_(true);
+  }
+  catch (...)
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      abort_ = true;
+      cv_.notify_all();
+    }
+    shooter.join();
+    throw;
+  }
+  shooter.join();
+  if (error_)
+    std::rethrow_exception(error_);
+
+  out.snapped = snapped_;
+  out.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - t0);
+  LOG_INFO("burst: %zu frames, %llu bytes in %lld ms (%.2f fps)", out.frames.size(),
+           (unsigned long long)out.bytes, (long long)out.elapsed.count(), out.fps());
+  return out;
+}
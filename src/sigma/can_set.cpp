@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "sigma/can_set.h"
+#include "utils/log.h"
+
+CanSetValidator::CanSetValidator(SigmaCamera &cam)
+    : cam_(cam), recoveries_seen_(cam.recoveries())
+{
+}
+
+void CanSetValidator::bind(CanSetField field, std::uint16_t tag)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  tags_[std::size_t(field)] = tag;
+  entry_[std::size_t(field)] = info_ ? info_->find(tag) : nullptr;
+}
+
+void CanSetValidator::unbind(CanSetField field)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  tags_[std::size_t(field)].reset();
+  entry_[std::size_t(field)] = nullptr;
+}
+
+void CanSetValidator::invalidate()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  info_.reset();
+  entry_.fill(nullptr);
+}
+
+CamCanSetInfo5 CanSetValidator::info()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  refresh_();
+  return *info_;
+}
+
+void CanSetValidator::refresh_()
+{
+  if (cam_.recoveries() != recoveries_seen_)
+  {
+    recoveries_seen_ = cam_.recoveries(); // ConfigApi reset the modes
+    info_.reset();
+  }
+  if (info_)
+    return;
+  info_ = cam_.get_cam_can_set_info5();
+  for (std::size_t i = 0; i < tags_.size(); ++i)
+    entry_[i] = tags_[i] ? info_->find(*tags_[i]) : nullptr;
+}
+
+// Fields whose codes run in order (a stop finer or coarser), where the
+// nearest code is the nearest setting. The others are plain enums: the
+// numerically nearest code is just some other mode.
+static bool ordinal(CanSetField f)
+{
+  switch (f)
+  {
+  case CanSetField::ShutterSpeed:
+  case CanSetField::Aperture:
+  case CanSetField::ISOSpeed:
+  case CanSetField::ExpComp:
+  case CanSetField::ColorTemp:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Exposure compensation codes are two's complement in a byte (0xF8 is
+// -1.0 EV), so their EV order is their signed order. The body may list
+// them as Int8 or UInt8; both are compared as signed.
+static bool signed_code(CanSetField f) { return f == CanSetField::ExpComp; }
+
+static std::int64_t as_signed8(std::int64_t c) { return std::int8_t(std::uint8_t(c)); }
+
+template <class T>
+void CanSetValidator::check_(std::optional<T> &v, CanSetField f, CanSetAction action,
+                             CanSetVerdict &out)
+{
+  const CamCanSetInfo5::Entry *e = entry_[std::size_t(f)];
+  if (!v || !e || e->values.empty())
+    return;
+  std::int64_t x = static_cast<std::int64_t>(*v);
+  std::vector<std::int64_t> keyed;
+  if (signed_code(f))
+  {
+    x = as_signed8(x);
+    keyed.reserve(e->values.size());
+    for (std::int64_t c : e->values)
+      keyed.push_back(as_signed8(c));
+    std::sort(keyed.begin(), keyed.end());
+  }
+  const auto &vals = signed_code(f) ? keyed : e->values;
+  auto it = std::lower_bound(vals.begin(), vals.end(), x);
+  if (it != vals.end() && *it == x)
+    return;
+  if (action == CanSetAction::Reject || !ordinal(f))
+  {
+    out.rejected.push_back(f);
+    return;
+  }
+  if (it == vals.end() || (it != vals.begin() && x - *(it - 1) <= *it - x))
+    --it;
+  LOG_DEBUG("can-set: field %d 0x%llX -> 0x%llX", int(f), (long long)x, (long long)*it);
+  v = static_cast<T>(*it); // a negative code wraps back to its byte
+  out.clamped.push_back(f);
+}
+
+CanSetVerdict CanSetValidator::check(CamDataGroup1 &g, CanSetAction action)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  refresh_();
+  CanSetVerdict out;
+  check_(g.shutterSpeed, CanSetField::ShutterSpeed, action, out);
+  check_(g.aperture, CanSetField::Aperture, action, out);
+  check_(g.isoSpeed, CanSetField::ISOSpeed, action, out);
+  check_(g.expComp, CanSetField::ExpComp, action, out);
+  check_(g.abValue, CanSetField::ABValue, action, out);
+  return out;
+}
+
+CanSetVerdict CanSetValidator::check(CamDataGroup2 &g, CanSetAction action)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  refresh_();
+  CanSetVerdict out;
+  check_(g.driveMode, CanSetField::DriveMode, action, out);
+  check_(g.exposureMode, CanSetField::ExposureMode, action, out);
+  check_(g.whiteBalance, CanSetField::WhiteBalance, action, out);
+  check_(g.resolution, CanSetField::Resolution, action, out);
+  check_(g.imageQuality, CanSetField::ImageQuality, action, out);
+  return out;
+}
+
+CanSetVerdict CanSetValidator::check(CamDataGroup5 &g, CanSetAction action)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  refresh_();
+  CanSetVerdict out;
+  check_(g.colorTemp, CanSetField::ColorTemp, action, out);
+  check_(g.aspectRatio, CanSetField::AspectRatio, action, out);
+  return out;
+}
+
+template <class GroupT>
+CameraPTP::Response CanSetValidator::set(GroupT g, CanSetAction action)
+{
+  if (!check(g, action).ok())
+    throw std::runtime_error("value not settable in the current mode");
+  auto r = cam_.set_group(g);
+  if constexpr (std::is_same_v<GroupT, CamDataGroup2>)
+    if (r.response_code == PTP_RESP_OK)
+      invalidate(); // new exposure/drive mode, new limits
+  return r;
+}
+
+// explicit instantiations
+template CameraPTP::Response CanSetValidator::set<CamDataGroup1>(CamDataGroup1, CanSetAction);
+template CameraPTP::Response CanSetValidator::set<CamDataGroup2>(CamDataGroup2, CanSetAction);
+template CameraPTP::Response CanSetValidator::set<CamDataGroup5>(CamDataGroup5, CanSetAction);
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <exception>
+
+#include "sigma/live_view.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+LiveViewEngine::LiveViewEngine(SigmaCamera &cam, LiveViewOptions opt)
+    : cam_(cam), opt_(opt)
+{
+  if (!(opt_.target_fps > 0))
+    opt_.target_fps = 30.0;
+  for (auto h : opt_.placeholders)
+    filter_.add_placeholder(h);
+}
+
+LiveViewEngine::~LiveViewEngine() { stop(); }
+
+void LiveViewEngine::start()
+{
+  if (running_.exchange(true))
+    return;
+  {
+    std::lock_guard<std::mutex> lk(run_mu_);
+    stop_ = false;
+  }
+  thread_ = std::thread([this]
+                        { run_(); });
+}
+
+void LiveViewEngine::stop()
+{
+  {
+    std::lock_guard<std::mutex> lk(run_mu_);
+    stop_ = true;
+  }
+  run_cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+  running_ = false;
+}
+
+const LiveFrame *LiveViewEngine::acquire(bool *is_new)
+{
+  bool fresh = false;
+  if (middle_.load(std::memory_order_relaxed) & kFresh)
+  {
+    const std::uint8_t prev = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = prev & 0x3;
+    fresh = true;
+  }
+  if (is_new)
+    *is_new = fresh;
+  const LiveFrame &f = slots_[front_];
+  return f.seq ? &f : nullptr;
+}
+
+LiveViewStats LiveViewEngine::stats() const
+{
+  std::lock_guard<std::mutex> lk(stats_mu_);
+  return stats_;
+}
+
+void LiveViewEngine::publish_()
+{
+  if (opt_.drop == LiveViewDrop::DropNewest &&
+      (middle_.load(std::memory_order_acquire) & kFresh))
+  {
+    std::lock_guard<std::mutex> lk(stats_mu_);
+    ++stats_.dropped; // the reader hasn't taken the previous one yet
+    return;
+  }
+  const std::uint8_t prev = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+  back_ = prev & 0x3;
+
+  std::lock_guard<std::mutex> lk(stats_mu_);
+  ++stats_.published;
+  if (prev & kFresh)
+    ++stats_.dropped; // DropOldest: replaced before anyone read it
+}
+
+void LiveViewEngine::run_()
+{
+  using clock = std::chrono::steady_clock;
+  trace_thread_name("live view");
+  const auto period = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(1.0 / opt_.target_fps));
+  std::uint64_t seq = 0;
+  auto next = clock::now();
+
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lk(run_mu_);
+      if (run_cv_.wait_until(lk, next, [&]
+                             { return stop_; }))
+        break;
+    }
+    const auto t0 = clock::now();
+    // no catch-up bursts after a slow frame
+    next = std::max(next + period, t0);
+
+    LiveFrame &f = slots_[back_];
+    try
+    {
+      TraceScope ts("view_frame", "liveview");
+      f.jpeg = cam_.get_view_frame_view();
+      ts.arg("bytes", f.jpeg.size());
+    }
+    catch (const std::exception &e)
+    {
+      {
+        std::lock_guard<std::mutex> lk(stats_mu_);
+        ++stats_.errors;
+      }
+      LOG_WARN("live view: GetViewFrame failed: %s", e.what());
+      next = clock::now() + opt_.error_backoff;
+      continue;
+    }
+    const auto t1 = clock::now();
+    if (f.jpeg.empty())
+      continue;
+    f.captured = t1;
+    f.fetch_latency = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0);
+
+    {
+      std::lock_guard<std::mutex> lk(stats_mu_);
+      ++stats_.fetched;
+      const auto us = f.fetch_latency.count();
+      stats_.fetch_latency = std::chrono::microseconds(
+          stats_.fetched == 1 ? us : (stats_.fetch_latency.count() * 7 + us) / 8);
+      if (last_fetch_ != clock::time_point{})
+      {
+        const double dt = std::chrono::duration<double>(t1 - last_fetch_).count();
+        if (dt > 0)
+          stats_.fps = stats_.fps == 0 ? 1.0 / dt : 0.875 * stats_.fps + 0.125 / dt;
+      }
+      last_fetch_ = t1;
+    }
+    if (opt_.skip_repeats)
+    {
+      f.info = jpeg_sniff(f.jpeg.data(), f.jpeg.size());
+      const auto verdict = filter_.classify(f.info);
+      if (verdict != FrameFilter::Fresh)
+      {
+        std::lock_guard<std::mutex> lk(stats_mu_);
+        ++(verdict == FrameFilter::Duplicate ? stats_.repeats : stats_.rejected);
+        continue;
+      }
+    }
+    f.seq = ++seq;
+    if (opt_.decoder && !opt_.decoder->submit(f.data(), f.size(), f.seq))
+    {
+      std::lock_guard<std::mutex> lk(stats_mu_);
+      ++stats_.decode_dropped;
+    }
+    if (opt_.shm)
+      opt_.shm->publish(f.data(), f.size(), f.captured);
+    publish_();
+  }
+}
@@ -0,0 +1,141 @@
+#include <type_traits>
+
+#include "sigma/profile.h"
+#include "utils/log.h"
+
+template <class GroupT>
+static constexpr SigmaOp set_op()
+{
+  if constexpr (std::is_same_v<GroupT, CamDataGroupFocus>)
+    return SigmaOp::SetCamDataGroupFocus;
+  else
+    return SigmaGroupMap<GroupT>::Set;
+}
+
+template <class GroupT>
+static constexpr SigmaOp get_op()
+{
+  if constexpr (std::is_same_v<GroupT, CamDataGroupFocus>)
+    return SigmaOp::GetCamDataGroupFocus;
+  else
+    return SigmaGroupMap<GroupT>::Get;
+}
+
+// groups with values the body fits to the lens, mode or a range rather than
+// refusing outright
+template <class GroupT>
+static constexpr bool may_clamp()
+{
+  return std::is_same_v<GroupT, CamDataGroup1> || std::is_same_v<GroupT, CamDataGroup5> ||
+         std::is_same_v<GroupT, CamDataGroupFocus>;
+}
+
+// a group with no settable fields would be an empty Set*
+template <class GroupT>
+static bool has_settable(const std::optional<GroupT> &g)
+{
+  return g && g->diff(GroupT{});
+}
+
+template <class F>
+void CameraProfile::each_(F &&f)
+{
+  // same order as SigmaCamera::on_session_restored_
+  f(std::get<std::optional<CamDataGroup2>>(groups_));
+  f(std::get<std::optional<CamDataGroup1>>(groups_));
+  f(std::get<std::optional<CamDataGroup3>>(groups_));
+  f(std::get<std::optional<CamDataGroup4>>(groups_));
+  f(std::get<std::optional<CamDataGroup5>>(groups_));
+  f(std::get<std::optional<CamDataGroupFocus>>(groups_));
+}
+
+void CameraProfile::clear()
+{
+  groups_ = {};
+  encoded_ = false;
+}
+
+void CameraProfile::encode_()
+{
+  if (encoded_)
+    return;
+  payloads_.clear();
+  sets_.clear();
+  gets_.clear();
+  each_([&](const auto &g)
+        {
+          using G = typename std::decay_t<decltype(g)>::value_type;
+          if (!has_settable(g))
+            return;
+          payloads_.push_back(g->encode()); // throws here, not mid-apply
+          CameraPTP::Request q;
+          q.opcode = static_cast<std::uint16_t>(set_op<G>());
+          sets_.push_back(q);
+          if (may_clamp<G>())
+          {
+            CameraPTP::Request r;
+            r.opcode = static_cast<std::uint16_t>(get_op<G>());
+            gets_.push_back(r);
+          } });
+  // the payloads are in place now; point the requests at them
+  for (std::size_t i = 0; i < sets_.size(); ++i)
+  {
+    sets_[i].data = payloads_[i].data();
+    sets_[i].data_size = payloads_[i].size();
+  }
+  encoded_ = true;
+}
+
+std::size_t CameraProfile::transactions()
+{
+  encode_();
+  return sets_.size();
+}
+
+ProfileApplyResult CameraProfile::apply(SigmaCamera &cam, bool verify)
+{
+  encode_();
+  ProfileApplyResult out;
+  out.planned = sets_.size();
+  if (sets_.empty())
+    return out;
+
+  out.sent = cam.run_batch(sets_, results_, CameraPTP::BatchMode::StopOnError);
+  std::size_t i = 0;
+  each_([&](const auto &g)
+        {
+          if (!has_settable(g) || i >= out.sent)
+            return;
+          const CameraPTP::Response &r = results_[i];
+          if (r.response_code == PTP_RESP_OK)
+            cam.remember_(*g); // so session recovery re-applies it
+          else
+            out.refused.push_back({sets_[i].opcode, r.response_code});
+          ++i; });
+  for (const auto &f : out.refused)
+    LOG_WARN("profile: 0x%04X refused, resp=0x%04X", f.opcode, f.response_code);
+  if (!verify || !out.ok() || gets_.empty())
+    return out;
+
+  const std::size_t read = cam.run_batch(gets_, results_, CameraPTP::BatchMode::ContinueOnError);
+  std::size_t k = 0;
+  each_([&](const auto &g)
+        {
+          using G = typename std::decay_t<decltype(g)>::value_type;
+          if (!may_clamp<G>() || !has_settable(g) || k >= read)
+            return;
+          const CameraPTP::Response &r = results_[k++];
+          if (r.response_code != PTP_RESP_OK)
+          {
+            LOG_WARN("profile: read-back 0x%04X failed, resp=0x%04X",
+                     static_cast<unsigned>(get_op<G>()), r.response_code);
+            return;
+          }
+          G body;
+          body.decode(r.data);
+          if (g->diff(body))
+            out.clamped.push_back(static_cast<std::uint16_t>(set_op<G>())); });
+  for (auto op : out.clamped)
+    LOG_INFO("profile: body adjusted the values sent with 0x%04X", op);
+  return out;
+}
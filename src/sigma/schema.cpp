@@ -671,6 +671,26 @@ void ViewFrame::decode(const std::vector<std::uint8_t> &raw)
   Data.assign(raw.begin() + 10, raw.end());
 }
 
+// ---------- views ----------
+void BigPartialPictFileView::decode(std::vector<std::uint8_t> &&raw, std::size_t at)
+{
+  if (raw.size() < at + kOffset)
+    throw std::runtime_error("BigPartialPictFile: short buffer");
+  AcquiredSize = read_32le(raw.data() + at);
+  off_ = at + kOffset;
+  len_ = std::min<std::size_t>(AcquiredSize, raw.size() - off_);
+  buf_ = std::move(raw);
+}
+
+void ViewFrameView::decode(std::vector<std::uint8_t> &&raw, std::size_t at)
+{
+  if (raw.size() < at + kOffset)
+    throw std::runtime_error("ViewFrame: short buffer");
+  off_ = at + kOffset;
+  len_ = raw.size() - off_;
+  buf_ = std::move(raw);
+}
+
 void ApiConfig::decode(const std::vector<std::uint8_t> &raw)
 {
   camera_model_.clear();
@@ -975,3 +995,346 @@ std::string CamDataGroupFocus::to_string() const {
   if (sep(!!focusLimit))      os << "focusLimit=" << (int)*focusLimit;
   return os.str();
 }
+
+// ---------- merge ----------
+template <class T>
+static void take(std::optional<T> &dst, const std::optional<T> &src)
+{
+  if (src)
+    dst = src;
+}
+
+void CamDataGroup1::merge(const CamDataGroup1 &o)
+{
+  take(shutterSpeed, o.shutterSpeed);
+  take(aperture, o.aperture);
+  take(programShift, o.programShift);
+  take(isoAuto, o.isoAuto);
+  take(isoSpeed, o.isoSpeed);
+  take(expComp, o.expComp);
+  take(abValue, o.abValue);
+  take(abSetting, o.abSetting);
+}
+
+void CamDataGroup2::merge(const CamDataGroup2 &o)
+{
+  take(driveMode, o.driveMode);
+  take(specialMode, o.specialMode);
+  take(exposureMode, o.exposureMode);
+  take(aeMeteringMode, o.aeMeteringMode);
+  take(flashType, o.flashType);
+  take(flashMode, o.flashMode);
+  take(flashSetting, o.flashSetting);
+  take(whiteBalance, o.whiteBalance);
+  take(resolution, o.resolution);
+  take(imageQuality, o.imageQuality);
+}
+
+void CamDataGroup3::merge(const CamDataGroup3 &o)
+{
+  take(colorSpace, o.colorSpace);
+  take(colorMode, o.colorMode);
+  take(batteryKind, o.batteryKind);
+  take(lensWideFocalLength, o.lensWideFocalLength);
+  take(lensTeleFocalLength, o.lensTeleFocalLength);
+  take(afAuxLight, o.afAuxLight);
+  take(afBeep, o.afBeep);
+  take(timerSound, o.timerSound);
+  take(destToSave, o.destToSave);
+}
+
+void CamDataGroup4::merge(const CamDataGroup4 &o)
+{
+  take(dcCropMode, o.dcCropMode);
+  take(lvMagnifyRatio, o.lvMagnifyRatio);
+  take(highISOExt, o.highISOExt);
+  take(contShootSpeed, o.contShootSpeed);
+  take(hdr, o.hdr);
+  take(dngQuality, o.dngQuality);
+  take(fillLight, o.fillLight);
+  take(eImageStab, o.eImageStab);
+  take(shutterSound, o.shutterSound);
+  // the LOC block is sent whole (unset entries as Off), so it merges whole
+  if (o.locDistortion || o.locChromaticAberration || o.locDiffraction ||
+      o.locVignetting || o.locColorShade || o.locColorShadeAcq)
+  {
+    locDistortion = o.locDistortion.value_or(LOCDistortion::Off);
+    locChromaticAberration = o.locChromaticAberration.value_or(LOCChromaticAberration::Off);
+    locDiffraction = o.locDiffraction.value_or(LOCDiffraction::Off);
+    locVignetting = o.locVignetting.value_or(LOCVignetting::Off);
+    locColorShade = o.locColorShade.value_or(LOCColorShade::Off);
+    locColorShadeAcq = o.locColorShadeAcq.value_or(LOCColorShadeAcq::Off);
+  }
+}
+
+void CamDataGroup5::merge(const CamDataGroup5 &o)
+{
+  // seconds and frames only travel as a pair
+  if (o.intervalTimerSecond && o.intervalTimerFrame)
+  {
+    intervalTimerSecond = o.intervalTimerSecond;
+    intervalTimerFrame = o.intervalTimerFrame;
+  }
+  take(colorTemp, o.colorTemp);
+  take(aspectRatio, o.aspectRatio);
+  take(toneEffect, o.toneEffect);
+  take(afAuxLightEF, o.afAuxLightEF);
+}
+
+void CamDataGroupFocus::merge(const CamDataGroupFocus &o)
+{
+  take(focusMode, o.focusMode);
+  take(afLock, o.afLock);
+  take(faceEyeAF, o.faceEyeAF);
+  take(focusArea, o.focusArea);
+  take(onePointSelection, o.onePointSelection);
+  take(dmfSize, o.dmfSize);
+  take(dmfPos, o.dmfPos);
+  take(preConstAF, o.preConstAF);
+  take(focusLimit, o.focusLimit);
+}
+
+// ---------- diff ----------
+// `out` gets `want` if it is set and differs from `have`
+template <class T>
+static void changed(std::optional<T> &out, const std::optional<T> &want,
+                    const std::optional<T> &have, bool &any)
+{
+  if (want && want != have)
+  {
+    out = want;
+    any = true;
+  }
+}
+
+std::optional<CamDataGroup1> CamDataGroup1::diff(const CamDataGroup1 &known) const
+{
+  CamDataGroup1 d;
+  bool any = false;
+  changed(d.shutterSpeed, shutterSpeed, known.shutterSpeed, any);
+  changed(d.aperture, aperture, known.aperture, any);
+  changed(d.programShift, programShift, known.programShift, any);
+  changed(d.isoAuto, isoAuto, known.isoAuto, any);
+  changed(d.isoSpeed, isoSpeed, known.isoSpeed, any);
+  changed(d.expComp, expComp, known.expComp, any);
+  changed(d.abValue, abValue, known.abValue, any);
+  changed(d.abSetting, abSetting, known.abSetting, any);
+  if (!any)
+    return std::nullopt;
+  return d;
+}
+
+std::optional<CamDataGroup2> CamDataGroup2::diff(const CamDataGroup2 &known) const
+{
+  CamDataGroup2 d;
+  bool any = false;
+  changed(d.driveMode, driveMode, known.driveMode, any);
+  changed(d.specialMode, specialMode, known.specialMode, any);
+  changed(d.exposureMode, exposureMode, known.exposureMode, any);
+  changed(d.aeMeteringMode, aeMeteringMode, known.aeMeteringMode, any);
+  changed(d.flashType, flashType, known.flashType, any);
+  changed(d.flashMode, flashMode, known.flashMode, any);
+  changed(d.flashSetting, flashSetting, known.flashSetting, any);
+  changed(d.whiteBalance, whiteBalance, known.whiteBalance, any);
+  changed(d.resolution, resolution, known.resolution, any);
+  changed(d.imageQuality, imageQuality, known.imageQuality, any);
+  if (!any)
+    return std::nullopt;
+  return d;
+}
+
+std::optional<CamDataGroup3> CamDataGroup3::diff(const CamDataGroup3 &known) const
+{
+  CamDataGroup3 d;
+  bool any = false;
+  changed(d.colorSpace, colorSpace, known.colorSpace, any);
+  changed(d.colorMode, colorMode, known.colorMode, any);
+  changed(d.batteryKind, batteryKind, known.batteryKind, any);
+  changed(d.lensWideFocalLength, lensWideFocalLength, known.lensWideFocalLength, any);
+  changed(d.lensTeleFocalLength, lensTeleFocalLength, known.lensTeleFocalLength, any);
+  changed(d.afAuxLight, afAuxLight, known.afAuxLight, any);
+  changed(d.afBeep, afBeep, known.afBeep, any);
+  changed(d.timerSound, timerSound, known.timerSound, any);
+  changed(d.destToSave, destToSave, known.destToSave, any);
+  if (!any)
+    return std::nullopt;
+  return d;
+}
+
+std::optional<CamDataGroup4> CamDataGroup4::diff(const CamDataGroup4 &known) const
+{
+  CamDataGroup4 d;
+  bool any = false;
+  changed(d.dcCropMode, dcCropMode, known.dcCropMode, any);
+  changed(d.lvMagnifyRatio, lvMagnifyRatio, known.lvMagnifyRatio, any);
+  changed(d.highISOExt, highISOExt, known.highISOExt, any);
+  changed(d.contShootSpeed, contShootSpeed, known.contShootSpeed, any);
+  changed(d.hdr, hdr, known.hdr, any);
+  changed(d.dngQuality, dngQuality, known.dngQuality, any);
+  changed(d.fillLight, fillLight, known.fillLight, any);
+  changed(d.eImageStab, eImageStab, known.eImageStab, any);
+  changed(d.shutterSound, shutterSound, known.shutterSound, any);
+  // the LOC block goes whole, unset entries as Off: compare what would be sent
+  if (locDistortion || locChromaticAberration || locDiffraction || locVignetting ||
+      locColorShade || locColorShadeAcq)
+  {
+    CamDataGroup4 sent;
+    sent.merge(*this);
+    if (sent.locDistortion != known.locDistortion ||
+        sent.locChromaticAberration != known.locChromaticAberration ||
+        sent.locDiffraction != known.locDiffraction ||
+        sent.locVignetting != known.locVignetting ||
+        sent.locColorShade != known.locColorShade ||
+        sent.locColorShadeAcq != known.locColorShadeAcq)
+    {
+      d.locDistortion = sent.locDistortion;
+      d.locChromaticAberration = sent.locChromaticAberration;
+      d.locDiffraction = sent.locDiffraction;
+      d.locVignetting = sent.locVignetting;
+      d.locColorShade = sent.locColorShade;
+      d.locColorShadeAcq = sent.locColorShadeAcq;
+      any = true;
+    }
+  }
+  if (!any)
+    return std::nullopt;
+  return d;
+}
+
+std::optional<CamDataGroup5> CamDataGroup5::diff(const CamDataGroup5 &known) const
+{
+  CamDataGroup5 d;
+  bool any = false;
+  // a lone half of the pair is passed on for encode() to reject
+  if ((intervalTimerSecond || intervalTimerFrame) &&
+      (intervalTimerSecond != known.intervalTimerSecond ||
+       intervalTimerFrame != known.intervalTimerFrame))
+  {
+    d.intervalTimerSecond = intervalTimerSecond;
+    d.intervalTimerFrame = intervalTimerFrame;
+    any = true;
+  }
+  changed(d.colorTemp, colorTemp, known.colorTemp, any);
+  changed(d.aspectRatio, aspectRatio, known.aspectRatio, any);
+  changed(d.toneEffect, toneEffect, known.toneEffect, any);
+  changed(d.afAuxLightEF, afAuxLightEF, known.afAuxLightEF, any);
+  if (!any)
+    return std::nullopt;
+  return d;
+}
+
+std::optional<CamDataGroupFocus> CamDataGroupFocus::diff(const CamDataGroupFocus &known) const
+{
+  CamDataGroupFocus d;
+  bool any = false;
+  changed(d.focusMode, focusMode, known.focusMode, any);
+  changed(d.afLock, afLock, known.afLock, any);
+  changed(d.faceEyeAF, faceEyeAF, known.faceEyeAF, any);
+  changed(d.focusArea, focusArea, known.focusArea, any);
+  changed(d.onePointSelection, onePointSelection, known.onePointSelection, any);
+  changed(d.dmfSize, dmfSize, known.dmfSize, any);
+  changed(d.dmfPos, dmfPos, known.dmfPos, any);
+  changed(d.preConstAF, preConstAF, known.preConstAF, any);
+  changed(d.focusLimit, focusLimit, known.focusLimit, any);
+  if (!any)
+    return std::nullopt;
+  return d;
+}
+
+// ---------- CamCanSetInfo5 ----------
+void CamCanSetInfo5::decode(const std::vector<std::uint8_t> &raw)
+{
+  entries.clear();
+  if (raw.size() < 8)
+    return;
+  const std::uint32_t dir_cnt = read_32le(&raw[4]);
+  if (raw.size() < 8 + std::size_t(dir_cnt) * 12)
+    throw std::runtime_error("CamCanSetInfo5: directory out of range");
+
+  entries.reserve(dir_cnt);
+  for (std::uint32_t i = 0; i < dir_cnt; ++i)
+  {
+    const std::size_t off = 8 + std::size_t(i) * 12;
+    Entry e;
+    e.tag = read_16le(&raw[off + 0]);
+    e.type = static_cast<DirectoryType>(read_16le(&raw[off + 2]));
+    const std::uint32_t cnt = read_32le(&raw[off + 4]);
+    std::uint32_t width;
+    try
+    {
+      width = dir_type_size(e.type);
+    }
+    catch (const std::runtime_error &)
+    {
+      continue; // a type this tree doesn't know; skip rather than misread
+    }
+    const std::size_t nbytes = std::size_t(cnt) * width;
+    const std::uint8_t *p = &raw[off + 8];
+    if (nbytes > 4)
+    {
+      const std::uint32_t ofs = read_32le(p);
+      if (std::size_t(ofs) + nbytes > raw.size())
+        continue;
+      p = &raw[ofs];
+    }
+    e.raw.assign(p, p + nbytes);
+
+    for (std::uint32_t k = 0; k < cnt; ++k)
+    {
+      const std::uint8_t *v = p + std::size_t(k) * width;
+      switch (e.type)
+      {
+      case DirectoryType::UInt8:
+      case DirectoryType::Any8:
+        e.values.push_back(v[0]);
+        break;
+      case DirectoryType::Int8:
+        e.values.push_back(std::int8_t(v[0]));
+        break;
+      case DirectoryType::UInt16:
+        e.values.push_back(read_16le(v));
+        break;
+      case DirectoryType::Int16:
+        e.values.push_back(std::int16_t(read_16le(v)));
+        break;
+      case DirectoryType::UInt32:
+        e.values.push_back(read_32le(v));
+        break;
+      case DirectoryType::Int32:
+        e.values.push_back(std::int32_t(read_32le(v)));
+        break;
+      default:
+        k = cnt; // strings, rationals, floats: raw only
+        break;
+      }
+    }
+    std::sort(e.values.begin(), e.values.end());
+    e.values.erase(std::unique(e.values.begin(), e.values.end()), e.values.end());
+    entries.push_back(std::move(e));
+  }
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+            { return a.tag < b.tag; });
+}
+
+const CamCanSetInfo5::Entry *CamCanSetInfo5::find(std::uint16_t tag) const
+{
+  auto it = std::lower_bound(entries.begin(), entries.end(), tag,
+                             [](const Entry &e, std::uint16_t t)
+                             { return e.tag < t; });
+  return it != entries.end() && it->tag == tag ? &*it : nullptr;
+}
+
+std::string CamCanSetInfo5::to_string() const
+{
+  std::ostringstream os;
+  for (const auto &e : entries)
+  {
+    os << "tag 0x" << std::hex << e.tag << std::dec << " type " << int(e.type) << ":";
+    if (e.values.empty())
+      os << " (" << e.raw.size() << " raw bytes)";
+    for (auto v : e.values)
+      os << ' ' << v;
+    os << '\n';
+  }
+  return os.str();
+}
@@ -1,8 +1,15 @@
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <stdexcept>
 #include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "ptp/resumable.h"
 #include "utils/log.h"
+#include "utils/trace.h"
 
 #include "sigma/sigma_ptp.h"
 
@@ -23,6 +30,14 @@ to be handled is based on the IFD structure.
 
 Returns:
     ApiConfig: the set of values obtained from a camera.*/
+{
+  ApiConfig cfg = config_api_();
+  std::lock_guard<std::mutex> lk(applied_mu_);
+  applied_ = {};
+  return cfg;
+}
+
+ApiConfig SigmaCamera::config_api_()
 {
   // Vendor op: SigmaConfigApi, with a single parameter 0
   auto r = transact(static_cast<std::uint16_t>(SigmaOp::ConfigApi), {}, nullptr,
@@ -34,9 +49,79 @@ Returns:
   ApiConfig cfg;
   cfg.decode(r.data);
   LOG_INFO("ConfigApi: %s", cfg.to_string().c_str());
+  // without a serial number the body can't be told from others of its model
+  if (!cfg.camera_model().empty() && !cfg.serial_number().empty())
+    devinfo_cache_key_ = DeviceInfoCache::make_key(cfg.camera_model(), cfg.firmware_version(),
+                                                   cfg.serial_number());
+  api_configured_ = true;
   return cfg;
 }
 
+bool SigmaCamera::is_idempotent_(std::uint16_t opcode) const
+{
+  switch (static_cast<SigmaOp>(opcode))
+  {
+  case SigmaOp::GetCamDataGroup1:
+  case SigmaOp::GetCamDataGroup2:
+  case SigmaOp::GetCamDataGroup3:
+  case SigmaOp::GetCamDataGroup4:
+  case SigmaOp::GetCamDataGroup5:
+  case SigmaOp::GetCamDataGroupFocus:
+  case SigmaOp::GetCamDataGroupMovie:
+  case SigmaOp::GetCamCaptStatus:
+  case SigmaOp::GetPictFileInfo2:
+  case SigmaOp::GetBigPartialPictFile:
+  case SigmaOp::GetViewFrame:
+  case SigmaOp::GetCamCanSetInfo5:
+  case SigmaOp::GetMovieFileInfo:
+  case SigmaOp::GetPartialMovieFile:
+    return true;
+  default:
+    return CameraPTP::is_idempotent_(opcode);
+  }
+}
+
+template <class GroupT>
+void SigmaCamera::remember_(const GroupT &g)
+{
+  std::lock_guard<std::mutex> lk(applied_mu_);
+  auto &slot = std::get<std::optional<GroupT>>(applied_);
+  if (slot)
+    slot->merge(g);
+  else
+    slot = g;
+}
+
+void SigmaCamera::on_session_restored_()
+{
+  if (!api_configured_)
+    return;
+  config_api_();
+
+  decltype(applied_) applied;
+  {
+    std::lock_guard<std::mutex> lk(applied_mu_);
+    applied = applied_;
+  }
+  auto apply = [&](const char *name, std::uint16_t code)
+  {
+    if (code != PTP_RESP_OK)
+      LOG_WARN("restoring %s failed, resp=0x%04X", name, code);
+  };
+  if (auto &g = std::get<std::optional<CamDataGroup2>>(applied))
+    apply("CamDataGroup2", set_group(*g).response_code);
+  if (auto &g = std::get<std::optional<CamDataGroup1>>(applied))
+    apply("CamDataGroup1", set_group(*g).response_code);
+  if (auto &g = std::get<std::optional<CamDataGroup3>>(applied))
+    apply("CamDataGroup3", set_group(*g).response_code);
+  if (auto &g = std::get<std::optional<CamDataGroup4>>(applied))
+    apply("CamDataGroup4", set_group(*g).response_code);
+  if (auto &g = std::get<std::optional<CamDataGroup5>>(applied))
+    apply("CamDataGroup5", set_group(*g).response_code);
+  if (auto &g = std::get<std::optional<CamDataGroupFocus>>(applied))
+    apply("CamDataGroupFocus", set_cam_data_group_focus(*g).response_code);
+}
+
 void SigmaCamera::close_application()
 /*This instruction informs the camera that the session is closed when the
    application exits.*/
@@ -53,6 +138,8 @@ CameraPTP::Response SigmaCamera::set_cam_data_group_focus(const CamDataGroupFocu
   auto r = transact(static_cast<std::uint16_t>(SigmaOp::SetCamDataGroupFocus),
                     {}, &payload, false);
   LOG_INFO("set_cam_data_group_focus sent, resp=0x%04X", r.response_code);
+  if (r.response_code == PTP_RESP_OK)
+    remember_(focus);
   return r;
 }
 
@@ -96,46 +183,138 @@ Returns:
   return s;
 }
 
-CamCaptStatus SigmaCamera::wait_completion(std::uint8_t image_id, int polls,
-                                           int sleep_ms)
+CamCaptStatus SigmaCamera::wait_completion(std::uint8_t image_id,
+                                           const WaitPolicy &policy,
+                                           WaitStats *stats)
 {
+  using clock = std::chrono::steady_clock;
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
 
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  // Any event is a hint that the status moved; the listener only bumps a
+  // counter, so events stay in the backlog for their real consumers.
+  struct Wakeup
+  {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::uint64_t seq{0};
+  } wake;
+  EventMonitor *mon = nullptr;
+  int listener = 0;
+  if (policy.wake_on_event)
+  {
+    mon = &events();
+    listener = mon->add_listener([&wake](const PtpEvent &)
+                                 {
+      std::lock_guard<std::mutex> lk(wake.mu);
+      ++wake.seq;
+      wake.cv.notify_all(); });
+    if (!mon->running())
+      mon->start();
+  }
+  struct Unlisten
+  {
+    EventMonitor *mon;
+    int id;
+    ~Unlisten()
+    {
+      if (mon)
+        mon->remove_listener(id);
+    }
+  } unlisten{mon, listener};
+
+  WaitStats local;
+  WaitStats &ws = stats ? *stats : local;
+  ws = WaitStats{};
+
+  const auto t0 = clock::now();
+  const auto deadline = t0 + policy.timeout;
+  auto last_poll = t0;
+  auto gap = policy.initial_interval;
+  CaptStatus prev = CaptStatus::Null;
   CamCaptStatus st;
   int err = 0;
-  for (int i = 0; i < polls; ++i)
+
+  for (int i = 0; policy.max_polls <= 0 || i < policy.max_polls; ++i)
   {
-    st = get_cam_capt_status(image_id);
+    std::uint64_t seen;
+    {
+      std::lock_guard<std::mutex> lk(wake.mu);
+      seen = wake.seq;
+    }
+    {
+      TraceScope ts("capt_status_poll", "sigma");
+      ts.arg("poll", std::uint64_t(i));
+      st = get_cam_capt_status(image_id);
+      ts.arg("status", static_cast<std::uint16_t>(st.Status));
+    }
+    const auto now = clock::now();
+    ++ws.polls;
+    // charge the time since the last poll to the phase seen back then
+    if (prev == CaptStatus::ShootInProgress)
+      ws.shoot_ms += duration_cast<milliseconds>(now - last_poll);
+    else if (prev == CaptStatus::ImageGenInProgress)
+      ws.image_gen_ms += duration_cast<milliseconds>(now - last_poll);
+    last_poll = now;
+
     const std::uint16_t code = static_cast<std::uint16_t>(st.Status);
     LOG_DEBUG("CaptStatus img=%u head=%u tail=%u code=0x%04X", st.ImageId,
               st.ImageDBHead, st.ImageDBTail, code);
 
-    switch (static_cast<CaptStatus>(code))
+    bool done = false;
+    switch (st.Status)
     {
     case CaptStatus::ImageGenCompleted:
     case CaptStatus::ImageDataStorageCompleted:
-      // case CaptStatus::Cleared:
-      return st;
+      ws.completed = true;
+      done = true;
+      break;
 
     case CaptStatus::ShootInProgress:
     case CaptStatus::ShootSuccess:
     case CaptStatus::ImageGenInProgress:
     case CaptStatus::AFSuccess:
     case CaptStatus::CWBSuccess:
-      LOG_INFO("Current status 0x%04X, waiting...", code);
       break;
     default:
-      err++;
       LOG_WARN("Unexpected capture status 0x%04X", code);
-      if (err > 15)
-        return st;
+      done = ++err > policy.max_errors;
     }
+    if (done || now >= deadline)
+      break;
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
+    if (st.Status != prev)
+      gap = policy.initial_interval; // new phase: look again soon
+    else
+      gap = std::min(gap * std::max(policy.backoff, 1u), policy.max_interval);
+    prev = st.Status;
+
+    const auto until = std::min(now + gap, deadline);
+    std::unique_lock<std::mutex> lk(wake.mu);
+    if (wake.cv.wait_until(lk, until, [&]
+                           { return wake.seq != seen; }))
+      ++ws.event_wakeups;
   }
+  ws.total = duration_cast<milliseconds>(clock::now() - t0);
+  LOG_INFO("capture wait: %lld ms (shoot %lld, image gen %lld), %d polls",
+           (long long)ws.total.count(), (long long)ws.shoot_ms.count(),
+           (long long)ws.image_gen_ms.count(), ws.polls);
   return st;
 }
 
+CamCaptStatus SigmaCamera::wait_completion(std::uint8_t image_id, int polls,
+                                           int sleep_ms)
+{
+  WaitPolicy p;
+  p.initial_interval = p.max_interval = std::chrono::milliseconds(sleep_ms);
+  p.backoff = 1;
+  p.max_polls = polls;
+  p.timeout = std::chrono::milliseconds(std::int64_t(polls) * sleep_ms);
+  // don't start the monitor behind the back of callers that read event()
+  p.wake_on_event = events().running();
+  return wait_completion(image_id, p);
+}
+
 // --- SnapCommand ---
 uint16_t SigmaCamera::snap(const SnapCommand &cmd)
 /*This command issues shooting instructions from the PC to the camera.
@@ -221,6 +400,16 @@ Returns:
   return part;
 }
 
+BigPartialPictFileView SigmaCamera::get_big_partial_pict_file_view(
+    std::uint32_t address, std::uint32_t start, std::uint32_t max_bytes)
+{
+  auto r = transact_in_place(static_cast<std::uint16_t>(SigmaOp::GetBigPartialPictFile),
+                             {address, start, max_bytes});
+  BigPartialPictFileView part;
+  part.decode(std::move(r.data), r.data_offset);
+  return part;
+}
+
 // --- ViewFrame (live view JPEG) ---
 ViewFrame SigmaCamera::get_view_frame()
 /*This function acquires image data when displaying LiveView.
@@ -246,33 +435,128 @@ Examples:
   return f;
 }
 
+ViewFrameView SigmaCamera::get_view_frame_view()
+{
+  auto r = transact_in_place(static_cast<std::uint16_t>(SigmaOp::GetViewFrame));
+  ViewFrameView f;
+  f.decode(std::move(r.data), r.data_offset);
+  return f;
+}
+
 // TODO remove ?
 //  --- Vendor-chunked object download ---
+std::uint32_t SigmaCamera::chunk_for_(std::uint32_t chunk, std::uint32_t left) const
+{
+  return std::min(chunk ? chunk : chunks_.next(), left);
+}
+
 std::vector<std::uint8_t>
 SigmaCamera::get_object_vendor(std::uint32_t object_handle,
                                std::uint32_t chunk)
 {
-  const auto info = get_pict_file_info2(object_handle);
   std::vector<std::uint8_t> out;
-  out.reserve(info.FileSize);
+  VectorSink sink(out);
+  get_object_vendor(object_handle, sink, chunk);
+  return out;
+}
+
+std::uint64_t SigmaCamera::get_object_vendor(std::uint32_t object_handle,
+                                             ByteSink &sink, std::uint32_t chunk,
+                                             bool preallocate)
+{
+  const auto info = get_pict_file_info2(object_handle);
+  if (preallocate)
+    sink.reserve(info.FileSize);
 
-  std::uint32_t addr = info.FileAddress;
-  std::uint32_t left = info.FileSize;
   std::uint32_t start = 0;
-  while (left)
+  while (start < info.FileSize)
   {
-    const std::uint32_t req = std::min(chunk, left);
-    BigPartialPictFile part = get_big_partial_pict_file(addr, start, req);
-    if (part.AcquiredSize == 0 || part.PartialData.empty())
+    const std::uint32_t req = chunk_for_(chunk, info.FileSize - start);
+    TraceScope ts("pict_file_chunk", "download");
+    ts.arg("offset", start);
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto part = get_big_partial_pict_file_view(info.FileAddress, start, req);
+    const std::size_t n = std::min<std::size_t>(part.size(), req);
+    if (!chunk)
+      chunks_.record(req, std::uint32_t(n), std::chrono::steady_clock::now() - t0);
+    if (n == 0)
       break;
-
-    out.insert(out.end(), part.PartialData.begin(), part.PartialData.end());
-    start += part.AcquiredSize;
-    left -= part.AcquiredSize;
-    if (part.PartialData.size() < req)
+    sink.write(part.data(), n);
+    ts.arg("bytes", n);
+    start += std::uint32_t(n);
+    if (n < req)
       break; // safety
   }
-  return out;
+  if (start < info.FileSize)
+    throw std::runtime_error("GetBigPartialPictFile: object ended after " +
+                             std::to_string(start) + " of " +
+                             std::to_string(info.FileSize) + " bytes");
+  return start;
+}
+
+std::uint64_t SigmaCamera::get_object_vendor(std::uint32_t object_handle, int fd,
+                                             std::uint32_t chunk, bool preallocate)
+{
+  struct stat st{};
+  const off_t had = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : -1;
+  // A failed download leaves fallocate'd space past the data; cut back to
+  // the data or the old end of file, whichever is further. Content that was
+  // already there is never truncated.
+  auto trim = [&]
+  {
+    const off_t pos = ::lseek(fd, 0, SEEK_CUR);
+    const off_t keep = std::max(had, pos);
+    if (preallocate && had >= 0 && pos >= 0 && ::fstat(fd, &st) == 0 && st.st_size > keep)
+      (void)::ftruncate(fd, keep);
+  };
+  FdSink sink(fd);
+  try
+  {
+    const std::uint64_t n = get_object_vendor(object_handle, sink, chunk, preallocate);
+    trim();
+    return n;
+  }
+  catch (...)
+  {
+    trim();
+    throw;
+  }
+}
+
+std::uint64_t SigmaCamera::download_pict_file(const PictFileInfo2 &info,
+                                              const std::string &path,
+                                              std::uint32_t chunk,
+                                              std::uint64_t checkpoint_bytes)
+{
+  DownloadCheckpoint id;
+  id.kind = "sigma";
+  id.id = info.FileAddress;
+  id.size = info.FileSize;
+  id.name = info.FileName;
+  ResumableFile file(path, id, checkpoint_bytes);
+
+  std::uint64_t fetched = 0;
+  std::uint32_t start = std::uint32_t(file.offset());
+  if (start < info.FileSize)
+    file.reserve(info.FileSize - start);
+  while (start < info.FileSize)
+  {
+    const std::uint32_t req = chunk_for_(chunk, info.FileSize - start);
+    TraceScope ts("pict_file_chunk", "download");
+    ts.arg("offset", start);
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto part = get_big_partial_pict_file_view(info.FileAddress, start, req);
+    if (!chunk)
+      chunks_.record(req, std::uint32_t(part.size()), std::chrono::steady_clock::now() - t0);
+    if (part.AcquiredSize == 0 || part.empty())
+      throw std::runtime_error("GetBigPartialPictFile returned no data");
+    file.write(part.data(), part.size());
+    ts.arg("bytes", part.size());
+    start += std::uint32_t(part.size());
+    fetched += part.size();
+  }
+  file.finish();
+  return fetched;
 }
 
 // TODO remove ?
@@ -281,7 +565,7 @@ std::vector<uint8_t> SigmaCamera::get_latest_image(DestToSave mode,
 {
   if (mode == DestToSave::InComputer)
   {
-    if (auto h = SigmaCamera::wait_object_added(timeout, 200))
+    if (auto h = wait_object_added(std::chrono::milliseconds(timeout)))
       return SigmaCamera::get_object(*h);
     return {};
   }
@@ -292,7 +576,17 @@ std::vector<uint8_t> SigmaCamera::get_latest_image(DestToSave mode,
 }
 
 // TODO get_cam_data_group_focus and set_cam_data_group_focus
-// TODO get_cam_can_set_info5
+
+CamCanSetInfo5 SigmaCamera::get_cam_can_set_info5()
+{
+  auto r = transact(static_cast<std::uint16_t>(SigmaOp::GetCamCanSetInfo5), {}, nullptr, true);
+  if (r.response_code != PTP_RESP_OK)
+    throw std::runtime_error("GetCamCanSetInfo5 failed");
+  CamCanSetInfo5 info;
+  info.decode(r.data);
+  LOG_DEBUG("CamCanSetInfo5: %zu entries", info.entries.size());
+  return info;
+}
 
 // templates (definitions) + explicit instantiations
 template <class GroupT>
@@ -325,8 +619,11 @@ Args:
   LOG_DEBUG("Bytes encoding for class %s:", typeid(GroupT).name());
   log_hex_preview(LogLevel::Debug, bytes.data(), bytes.size());
 
-  return transact(static_cast<std::uint16_t>(SigmaGroupMap<GroupT>::Set), {},
-                  &bytes, false);
+  auto r = transact(static_cast<std::uint16_t>(SigmaGroupMap<GroupT>::Set), {},
+                    &bytes, false);
+  if (r.response_code == PTP_RESP_OK)
+    remember_(g);
+  return r;
 }
 
 // explicit instantiation for 1..5
@@ -341,3 +638,11 @@ template CameraPTP::Response SigmaCamera::set_group<CamDataGroup2>(const CamData
 template CameraPTP::Response SigmaCamera::set_group<CamDataGroup3>(const CamDataGroup3 &);
 template CameraPTP::Response SigmaCamera::set_group<CamDataGroup4>(const CamDataGroup4 &);
 template CameraPTP::Response SigmaCamera::set_group<CamDataGroup5>(const CamDataGroup5 &);
+
+// remember_ is also used by CameraProfile
+template void SigmaCamera::remember_<CamDataGroup1>(const CamDataGroup1 &);
+template void SigmaCamera::remember_<CamDataGroup2>(const CamDataGroup2 &);
+template void SigmaCamera::remember_<CamDataGroup3>(const CamDataGroup3 &);
+template void SigmaCamera::remember_<CamDataGroup4>(const CamDataGroup4 &);
+template void SigmaCamera::remember_<CamDataGroup5>(const CamDataGroup5 &);
+template void SigmaCamera::remember_<CamDataGroupFocus>(const CamDataGroupFocus &);
@@ -0,0 +1,162 @@
+#include <type_traits>
+
+#include "sigma/state_cache.h"
+#include "utils/log.h"
+
+// CamDataGroupFocus has its own calls rather than a SigmaGroupMap entry
+template <class GroupT>
+static GroupT read_group(SigmaCamera &cam)
+{
+  if constexpr (std::is_same_v<GroupT, CamDataGroupFocus>)
+    return cam.get_cam_data_group_focus();
+  else
+    return cam.get_group<GroupT>();
+}
+
+template <class GroupT>
+static CameraPTP::Response write_group(SigmaCamera &cam, const GroupT &g)
+{
+  if constexpr (std::is_same_v<GroupT, CamDataGroupFocus>)
+    return cam.set_cam_data_group_focus(g);
+  else
+    return cam.set_group(g);
+}
+
+// groups with values the body fits to the lens, mode or a range rather than
+// refusing outright (ISO floor, colour temperature, DMF position, ...)
+template <class GroupT>
+static constexpr bool may_clamp()
+{
+  return std::is_same_v<GroupT, CamDataGroup1> || std::is_same_v<GroupT, CamDataGroup5> ||
+         std::is_same_v<GroupT, CamDataGroupFocus>;
+}
+
+CameraStateCache::CameraStateCache(SigmaCamera &cam, std::chrono::milliseconds max_age)
+    : cam_(cam), max_age_(max_age), recoveries_seen_(cam.recoveries())
+{
+}
+
+void CameraStateCache::check_session_()
+{
+  if (cam_.recoveries() == recoveries_seen_)
+    return;
+  // new session: ConfigApi ran again and the body may have been reset
+  recoveries_seen_ = cam_.recoveries();
+  entries_ = {};
+}
+
+void CameraStateCache::invalidate()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  entries_ = {};
+}
+
+void CameraStateCache::set_max_age(std::chrono::milliseconds age)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  max_age_ = age;
+}
+
+StateCacheStats CameraStateCache::stats() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
+
+template <class GroupT>
+bool CameraStateCache::fresh_(const Entry<GroupT> &e) const
+{
+  return e.value && e.read_at != std::chrono::steady_clock::time_point{} &&
+         std::chrono::steady_clock::now() - e.read_at < max_age_;
+}
+
+template <class GroupT>
+GroupT CameraStateCache::read_()
+{
+  GroupT g = read_group<GroupT>(cam_);
+  ++stats_.reads;
+  auto &e = entry_<GroupT>();
+  e.value = g;
+  e.read_at = std::chrono::steady_clock::now();
+  return g;
+}
+
+template <class GroupT>
+GroupT CameraStateCache::get()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  check_session_();
+  const auto &e = entry_<GroupT>();
+  if (fresh_(e))
+  {
+    ++stats_.read_hits;
+    return *e.value;
+  }
+  return read_<GroupT>();
+}
+
+template <class GroupT>
+GroupT CameraStateCache::refresh()
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  check_session_();
+  return read_<GroupT>();
+}
+
+template <class GroupT>
+CameraPTP::Response CameraStateCache::set(const GroupT &want)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  check_session_();
+  auto &e = entry_<GroupT>();
+  // an old mirror may miss a dial turned on the body since: send it all
+  const std::optional<GroupT> d = fresh_(e) ? want.diff(*e.value) : std::optional<GroupT>(want);
+  if (!d)
+  {
+    ++stats_.writes_skipped;
+    CameraPTP::Response r;
+    r.response_code = PTP_RESP_OK;
+    return r;
+  }
+
+  CameraPTP::Response r = write_group(cam_, *d);
+  ++stats_.writes;
+  if (r.response_code == PTP_RESP_OK)
+  {
+    if (!e.value)
+      e.value.emplace(); // holds only what was written; get() still reads
+    e.value->merge(*d);
+    // the body may hold something other than what was asked for: until it
+    // is read back, diff against nothing
+    if (may_clamp<GroupT>())
+      e.read_at = {};
+  }
+  else
+  {
+    LOG_WARN("state cache: set refused (0x%04X); dropping the mirror", r.response_code);
+    e = {};
+  }
+  return r;
+}
+
+// explicit instantiations
+template CamDataGroup1 CameraStateCache::get<CamDataGroup1>();
+template CamDataGroup2 CameraStateCache::get<CamDataGroup2>();
+template CamDataGroup3 CameraStateCache::get<CamDataGroup3>();
+template CamDataGroup4 CameraStateCache::get<CamDataGroup4>();
+template CamDataGroup5 CameraStateCache::get<CamDataGroup5>();
+template CamDataGroupFocus CameraStateCache::get<CamDataGroupFocus>();
+
+template CamDataGroup1 CameraStateCache::refresh<CamDataGroup1>();
+template CamDataGroup2 CameraStateCache::refresh<CamDataGroup2>();
+template CamDataGroup3 CameraStateCache::refresh<CamDataGroup3>();
+template CamDataGroup4 CameraStateCache::refresh<CamDataGroup4>();
+template CamDataGroup5 CameraStateCache::refresh<CamDataGroup5>();
+template CamDataGroupFocus CameraStateCache::refresh<CamDataGroupFocus>();
+
+template CameraPTP::Response CameraStateCache::set<CamDataGroup1>(const CamDataGroup1 &);
+template CameraPTP::Response CameraStateCache::set<CamDataGroup2>(const CamDataGroup2 &);
+template CameraPTP::Response CameraStateCache::set<CamDataGroup3>(const CamDataGroup3 &);
+template CameraPTP::Response CameraStateCache::set<CamDataGroup4>(const CamDataGroup4 &);
+template CameraPTP::Response CameraStateCache::set<CamDataGroup5>(const CamDataGroup5 &);
+template CameraPTP::Response CameraStateCache::set<CamDataGroupFocus>(const CamDataGroupFocus &);
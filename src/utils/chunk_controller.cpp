@@ -0,0 +1,60 @@
+#include <algorithm>
+
+#include "utils/chunk_controller.h"
+
+static constexpr std::uint32_t kAlign = 4096;
+
+ChunkController::ChunkController(ChunkPolicy p) : p_(p)
+{
+  p_.min_bytes = std::max(p_.min_bytes, kAlign);
+  p_.max_bytes = std::max(p_.max_bytes, p_.min_bytes);
+  chunk_ = clamp_(p_.start_bytes);
+}
+
+std::uint32_t ChunkController::clamp_(double bytes) const
+{
+  const double c = std::min(std::max(bytes, double(p_.min_bytes)), double(p_.max_bytes));
+  return std::max(std::uint32_t(c) / kAlign * kAlign, p_.min_bytes);
+}
+
+std::uint32_t ChunkController::next() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return chunk_;
+}
+
+double ChunkController::bytes_per_sec() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return rate_;
+}
+
+void ChunkController::record(std::uint32_t asked, std::uint32_t got,
+                             std::chrono::nanoseconds elapsed)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  if (got == 0 || elapsed.count() <= 0)
+    return;
+  const double rate = got / std::chrono::duration<double>(elapsed).count();
+  rate_ = rate_ == 0 ? rate : 0.75 * rate_ + 0.25 * rate;
+
+  if (elapsed > p_.latency_target)
+  {
+    slow_start_ = false;
+    chunk_ = clamp_(chunk_ * p_.decrease);
+    return;
+  }
+  if (asked < chunk_ / 2 || got < asked)
+    return; // tail of a file: too small to say anything about the pipe
+
+  if (slow_start_)
+  {
+    // doubling that no longer pays (< 10% gain) means the pipe is full
+    if (best_rate_ > 0 && rate < best_rate_ * 1.1)
+      slow_start_ = false;
+    best_rate_ = std::max(best_rate_, rate);
+    chunk_ = clamp_(slow_start_ ? chunk_ * 2.0 : chunk_ + double(p_.step_bytes));
+    return;
+  }
+  chunk_ = clamp_(chunk_ + double(p_.step_bytes));
+}
@@ -0,0 +1,163 @@
+#include <cstring>
+
+#include "utils/jpeg.h"
+
+namespace
+{
+constexpr std::uint64_t P1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t P3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+inline std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline std::uint64_t load64(const std::uint8_t *p)
+{
+  std::uint64_t v;
+  std::memcpy(&v, p, 8); // little-endian hosts only, like the rest of the wire code
+  return v;
+}
+
+inline std::uint32_t load32(const std::uint8_t *p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline std::uint64_t lane(std::uint64_t acc, std::uint64_t in)
+{
+  acc += in * P2;
+  return rotl(acc, 31) * P1;
+}
+
+inline std::uint64_t merge(std::uint64_t acc, std::uint64_t v)
+{
+  acc ^= lane(0, v);
+  return acc * P1 + P4;
+}
+
+inline std::uint16_t be16(const std::uint8_t *p) { return std::uint16_t(p[0] << 8 | p[1]); }
+
+bool is_sof(std::uint8_t m)
+{
+  // C0-CF minus DHT (C4), JPG (C8) and DAC (CC)
+  return m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC;
+}
+} // namespace
+
+std::uint64_t hash64(const void *data, std::size_t n, std::uint64_t seed)
+{
+  const auto *p = static_cast<const std::uint8_t *>(data);
+  const std::uint8_t *const end = p + n;
+  std::uint64_t h;
+
+  if (n >= 32)
+  {
+    // four independent lanes: the compiler keeps them in flight together
+    std::uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+    const std::uint8_t *const limit = end - 32;
+    do
+    {
+      v1 = lane(v1, load64(p));
+      v2 = lane(v2, load64(p + 8));
+      v3 = lane(v3, load64(p + 16));
+      v4 = lane(v4, load64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(h, v1);
+    h = merge(h, v2);
+    h = merge(h, v3);
+    h = merge(h, v4);
+  }
+  else
+    h = seed + P5;
+
+  h += n;
+  for (; p + 8 <= end; p += 8)
+    h = rotl(h ^ lane(0, load64(p)), 27) * P1 + P4;
+  if (p + 4 <= end)
+  {
+    h = rotl(h ^ (std::uint64_t(load32(p)) * P1), 23) * P2 + P3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+    h = rotl(h ^ (*p * P5), 11) * P1;
+
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+JpegInfo jpeg_sniff(const std::uint8_t *p, std::size_t n)
+{
+  JpegInfo info;
+  if (n < 4 || p[0] != 0xFF || p[1] != 0xD8)
+    return info;
+
+  bool sof = false;
+  std::size_t i = 2;
+  while (i + 4 <= n)
+  {
+    if (p[i] != 0xFF)
+      return info;
+    while (i + 1 < n && p[i + 1] == 0xFF) // fill bytes
+      ++i;
+    const std::uint8_t m = p[i + 1];
+    i += 2;
+    if (m == 0x01 || (m >= 0xD0 && m <= 0xD7)) // TEM, RSTn: no length
+      continue;
+    if (m == 0xD9 || i + 2 > n)
+      return info; // EOI before any scan
+    const std::size_t len = be16(p + i);
+    if (len < 2 || i + len > n)
+      return info;
+    if (is_sof(m) && len >= 8)
+    {
+      info.height = be16(p + i + 3);
+      info.width = be16(p + i + 5);
+      info.components = p[i + 7];
+      sof = true;
+    }
+    if (m == 0xDA)
+    {
+      info.scan_offset = i + len;
+      break;
+    }
+    i += len;
+  }
+  if (!sof || !info.scan_offset || !info.width || !info.height)
+    return info;
+
+  // EOI, allowing for padding after it
+  std::size_t e = n;
+  while (e >= info.scan_offset + 2 && !(p[e - 2] == 0xFF && p[e - 1] == 0xD9))
+  {
+    if (n - e > 64)
+      return info;
+    --e;
+  }
+  if (e < info.scan_offset + 2)
+    return info;
+  info.scan_size = e - 2 - info.scan_offset;
+  info.scan_hash = hash64(p + info.scan_offset, info.scan_size);
+  info.valid = true;
+  return info;
+}
+
+FrameFilter::Verdict FrameFilter::classify(const JpegInfo &info)
+{
+  if (!info.valid)
+    return Invalid;
+  if (placeholders_.count(info.scan_hash))
+    return Placeholder;
+  if (info.scan_hash == last_)
+    return Duplicate;
+  last_ = info.scan_hash;
+  return Fresh;
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <stdexcept>
+
+#include "utils/jpeg_decode.h"
+#include "utils/log.h"
+#include "utils/trace.h"
+
+#if PTP_SIGMA_HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+struct JpegDecodePool::Shelf
+{
+  std::mutex mu;
+  std::vector<std::unique_ptr<RgbImage>> free;
+  std::size_t keep{0}; // more than this are released instead of shelved
+};
+
+#if PTP_SIGMA_HAVE_JPEG
+namespace
+{
+  struct ErrorMgr
+  {
+    jpeg_error_mgr pub;
+    std::jmp_buf jump;
+    char msg[JMSG_LENGTH_MAX];
+  };
+
+  void on_error(j_common_ptr c)
+  {
+    auto *e = reinterpret_cast<ErrorMgr *>(c->err);
+    c->err->format_message(c, e->msg);
+    std::longjmp(e->jump, 1);
+  }
+
+  void on_message(j_common_ptr) {} // warnings (e.g. corrupt data) stay quiet
+}
+#endif
+
+bool JpegDecodePool::available()
+{
+#if PTP_SIGMA_HAVE_JPEG
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool JpegDecodePool::decode(const std::uint8_t *p, std::size_t n, JpegScale scale,
+                            RgbImage &out, bool fast)
+{
+  out.ok = false;
+  out.error.clear();
+#if PTP_SIGMA_HAVE_JPEG
+  jpeg_decompress_struct cinfo;
+  ErrorMgr err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = on_error;
+  err.pub.output_message = on_message;
+  err.msg[0] = 0;
+  // nothing with a destructor lives between here and the longjmp
+  if (setjmp(err.jump))
+  {
+    jpeg_destroy_decompress(&cinfo);
+    out.error = err.msg;
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, const_cast<std::uint8_t *>(p), static_cast<unsigned long>(n));
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = static_cast<unsigned>(scale);
+  if (fast)
+  {
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+  }
+  jpeg_start_decompress(&cinfo);
+
+  out.width = cinfo.output_width;
+  out.height = cinfo.output_height;
+  const std::size_t stride = std::size_t(out.width) * 3;
+  out.rgb.resize(stride * out.height); // keeps its capacity between frames
+  while (cinfo.output_scanline < cinfo.output_height)
+  {
+    JSAMPROW rows[8];
+    const JDIMENSION y = cinfo.output_scanline;
+    const JDIMENSION k = std::min<JDIMENSION>(8, cinfo.output_height - y);
+    for (JDIMENSION r = 0; r < k; ++r)
+      rows[r] = out.rgb.data() + (y + r) * stride;
+    jpeg_read_scanlines(&cinfo, rows, k);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  out.ok = true;
+  return true;
+#else
+  (void)p;
+  (void)n;
+  (void)scale;
+  (void)fast;
+  out.error = "built without JPEG decoding";
+  return false;
+#endif
+}
+
+JpegDecodePool::JpegDecodePool(JpegDecodeOptions opt)
+    : opt_(opt), shelf_(std::make_shared<Shelf>())
+{
+  if (!available())
+    throw std::runtime_error("JpegDecodePool: built without libjpeg-turbo "
+                             "(configure with -DWITH_JPEG_DECODE=ON)");
+  if (opt_.workers == 0)
+    opt_.workers = 1;
+  if (opt_.max_pending == 0)
+    opt_.max_pending = 1;
+  // every outstanding image plus a couple held by the consumer
+  shelf_->keep = opt_.max_pending + 2;
+  threads_.reserve(opt_.workers);
+  for (unsigned i = 0; i < opt_.workers; ++i)
+    threads_.emplace_back([this]
+                          { work_(); });
+}
+
+JpegDecodePool::~JpegDecodePool()
+{
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto &t : threads_)
+    t.join();
+}
+
+std::uint64_t JpegDecodePool::submit(const std::uint8_t *p, std::size_t n, std::uint64_t tag)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  if (submitted_ - (next_out_ - 1) >= opt_.max_pending)
+    return 0;
+  Job job{++submitted_, tag, opt_.scale, {}};
+  if (!spare_in_.empty())
+  {
+    job.jpeg = std::move(spare_in_.back());
+    spare_in_.pop_back();
+  }
+  job.jpeg.assign(p, p + n);
+  jobs_.push_back(std::move(job));
+  work_cv_.notify_one();
+  return submitted_;
+}
+
+RgbImagePtr JpegDecodePool::next(std::chrono::milliseconds timeout)
+{
+  std::unique_ptr<RgbImage> img;
+  {
+    std::unique_lock<std::mutex> lk(mu_);
+    if (!done_cv_.wait_for(lk, timeout, [&]
+                           { return done_.count(next_out_) != 0; }))
+      return nullptr;
+    auto it = done_.find(next_out_);
+    img = std::move(it->second);
+    done_.erase(it);
+    ++next_out_;
+  }
+  std::shared_ptr<Shelf> shelf = shelf_;
+  return RgbImagePtr(img.release(), [shelf](const RgbImage *p)
+                     {
+                       std::unique_ptr<RgbImage> back(const_cast<RgbImage *>(p));
+                       std::lock_guard<std::mutex> lk(shelf->mu);
+                       if (shelf->free.size() < shelf->keep)
+                         shelf->free.push_back(std::move(back)); });
+}
+
+void JpegDecodePool::set_scale(JpegScale s)
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  opt_.scale = s;
+}
+
+std::size_t JpegDecodePool::pending() const
+{
+  std::lock_guard<std::mutex> lk(mu_);
+  return std::size_t(submitted_ - (next_out_ - 1));
+}
+
+void JpegDecodePool::work_()
+{
+  trace_thread_name("jpeg decode");
+  for (;;)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      work_cv_.wait(lk, [&]
+                    { return stop_ || !jobs_.empty(); });
+      if (stop_)
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    std::unique_ptr<RgbImage> img;
+    {
+      std::lock_guard<std::mutex> lk(shelf_->mu);
+      if (!shelf_->free.empty())
+      {
+        img = std::move(shelf_->free.back());
+        shelf_->free.pop_back();
+      }
+    }
+    if (!img)
+      img = std::make_unique<RgbImage>();
+    img->order = job.order;
+    img->tag = job.tag;
+    {
+      TraceScope ts("jpeg_decode", "liveview");
+      ts.arg("bytes", job.jpeg.size());
+      if (!decode(job.jpeg.data(), job.jpeg.size(), job.scale, *img, opt_.fast))
+        LOG_DEBUG("jpeg decode #%llu failed: %s", (unsigned long long)job.order,
+                  img->error.c_str());
+    }
+
+    std::lock_guard<std::mutex> lk(mu_);
+    done_[job.order] = std::move(img);
+    spare_in_.push_back(std::move(job.jpeg));
+    done_cv_.notify_all();
+  }
+}
@@ -0,0 +1,252 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "utils/log.h"
+#include "utils/shm_ring.h"
+
+static std::size_t align64(std::size_t n) { return (n + 63) & ~std::size_t(63); }
+
+static std::size_t slot_stride(const ShmRingHeader &h) { return align64(h.slot_bytes); }
+
+static std::runtime_error sys_error(const std::string &what, const std::string &name)
+{
+  return std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+}
+
+// ---------- ShmRingWriter ----------
+// Whether the existing segment `name` still has a writer. A segment without
+// a complete header counts as in use: its writer may be setting it up.
+static bool ring_in_use(const std::string &name, std::uint32_t &pid)
+{
+  pid = 0;
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false; // unlinked meanwhile
+  struct stat st{};
+  void *base = fstat(fd, &st) == 0 && std::size_t(st.st_size) >= sizeof(ShmRingHeader)
+                   ? mmap(nullptr, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0)
+                   : MAP_FAILED;
+  close(fd);
+  if (base == MAP_FAILED)
+    return true;
+  const auto *h = static_cast<const ShmRingHeader *>(base);
+  const bool ready = h->magic == ShmRingHeader::kMagic;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  pid = h->writer_pid;
+  munmap(base, sizeof(ShmRingHeader));
+  return !ready || kill(pid_t(pid), 0) == 0 || errno == EPERM;
+}
+
+ShmRingWriter::ShmRingWriter(std::string name, std::uint32_t slots, std::size_t slot_bytes)
+    : name_(std::move(name))
+{
+  if (slots < 2)
+    slots = 2; // readers need a slot the writer isn't in
+  const std::size_t data_offset =
+      align64(sizeof(ShmRingHeader)) + align64(slots * sizeof(ShmSlotHeader));
+  bytes_ = data_offset + slots * align64(slot_bytes);
+
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0 && errno == EEXIST)
+  {
+    std::uint32_t pid;
+    if (ring_in_use(name_, pid))
+      throw std::runtime_error("shm ring " + name_ + " is in use by writer pid " +
+                               std::to_string(pid));
+    // a previous writer that died without cleaning up
+    LOG_WARN("shm ring %s: replacing the segment of exited writer pid %u", name_.c_str(), pid);
+    shm_unlink(name_.c_str());
+    fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  }
+  if (fd < 0)
+    throw sys_error("shm_open", name_);
+  if (ftruncate(fd, off_t(bytes_)) != 0)
+  {
+    const auto err = sys_error("ftruncate", name_);
+    close(fd);
+    shm_unlink(name_.c_str());
+    throw err;
+  }
+  base_ = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base_ == MAP_FAILED)
+  {
+    base_ = nullptr;
+    shm_unlink(name_.c_str());
+    throw sys_error("mmap", name_);
+  }
+
+  // the segment starts zeroed: every lock even, latest 0
+  auto *h = static_cast<ShmRingHeader *>(base_);
+  h->version = ShmRingHeader::kVersion;
+  h->slots = slots;
+  h->writer_pid = std::uint32_t(getpid());
+  h->slot_bytes = slot_bytes;
+  h->data_offset = data_offset;
+  std::atomic_thread_fence(std::memory_order_release);
+  h->magic = ShmRingHeader::kMagic; // readers refuse the ring until this is set
+  LOG_INFO("shm ring %s: %u slots of %zu bytes", name_.c_str(), slots, slot_bytes);
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+  if (base_)
+    munmap(base_, bytes_);
+  shm_unlink(name_.c_str()); // mapped readers keep their view until they unmap
+}
+
+std::uint64_t ShmRingWriter::publish(const std::uint8_t *p, std::size_t n,
+                                     std::chrono::steady_clock::time_point captured)
+{
+  auto *h = static_cast<ShmRingHeader *>(base_);
+  if (n > h->slot_bytes)
+  {
+    LOG_WARN("shm ring %s: %zu-byte frame does not fit a %llu-byte slot", name_.c_str(), n,
+             (unsigned long long)h->slot_bytes);
+    return 0;
+  }
+  const std::uint64_t seq = ++seq_;
+  const std::uint32_t slot = std::uint32_t((seq - 1) % h->slots);
+  auto *sh = reinterpret_cast<ShmSlotHeader *>(static_cast<std::uint8_t *>(base_) +
+                                               align64(sizeof(ShmRingHeader))) +
+             slot;
+  std::uint8_t *dst = static_cast<std::uint8_t *>(base_) + h->data_offset + slot * slot_stride(*h);
+
+  const std::uint64_t v = sh->lock.load(std::memory_order_relaxed);
+  sh->lock.store(v + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(dst, p, n);
+  sh->seq = seq;
+  sh->size = n;
+  sh->captured_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(captured.time_since_epoch()).count();
+  sh->lock.store(v + 2, std::memory_order_release);
+  h->latest.store(seq, std::memory_order_release);
+  return seq;
+}
+
+// ---------- ShmRingReader ----------
+ShmRingReader::ShmRingReader(const std::string &name)
+{
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    throw sys_error("shm_open", name);
+  struct stat st{};
+  if (fstat(fd, &st) != 0)
+  {
+    const auto err = sys_error("fstat", name);
+    close(fd);
+    throw err;
+  }
+  bytes_ = std::size_t(st.st_size);
+  void *base = bytes_ >= sizeof(ShmRingHeader)
+                   ? mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0)
+                   : MAP_FAILED;
+  close(fd);
+  if (base == MAP_FAILED)
+    throw std::runtime_error("shm ring " + name + ": cannot map");
+
+  hdr_ = static_cast<const ShmRingHeader *>(base);
+  bool ok = hdr_->magic == ShmRingHeader::kMagic;
+  std::atomic_thread_fence(std::memory_order_acquire); // pairs with the writer's, before magic
+  ok = ok && hdr_->version == ShmRingHeader::kVersion && hdr_->slots >= 2 &&
+       hdr_->data_offset + hdr_->slots * slot_stride(*hdr_) <= bytes_;
+  if (!ok)
+  {
+    munmap(base, bytes_);
+    throw std::runtime_error("shm ring " + name + ": not a ring of this version");
+  }
+  slot_hdr_ = reinterpret_cast<const ShmSlotHeader *>(static_cast<const std::uint8_t *>(base) +
+                                                      align64(sizeof(ShmRingHeader)));
+  data_ = static_cast<const std::uint8_t *>(base) + hdr_->data_offset;
+}
+
+ShmRingReader::~ShmRingReader()
+{
+  if (hdr_)
+    munmap(const_cast<ShmRingHeader *>(hdr_), bytes_);
+}
+
+std::uint64_t ShmRingReader::latest_seq() const
+{
+  return hdr_->latest.load(std::memory_order_acquire);
+}
+
+bool ShmRingReader::latest(ShmFrame &out) const
+{
+  const std::uint64_t seq = latest_seq();
+  if (seq == 0)
+    return false;
+  const std::uint32_t slot = std::uint32_t((seq - 1) % hdr_->slots);
+  const ShmSlotHeader &sh = slot_hdr_[slot];
+  const std::uint64_t v = sh.lock.load(std::memory_order_acquire);
+  if (v & 1)
+    return false;
+  ShmFrame f;
+  f.seq = sh.seq;
+  f.size = sh.size;
+  f.captured_ns = sh.captured_ns;
+  f.data = data_ + slot * slot_stride(*hdr_);
+  f.slot_ = slot;
+  f.lock_ = v;
+  if (!still_valid(f) || f.size > hdr_->slot_bytes)
+    return false;
+  out = f;
+  return true;
+}
+
+bool ShmRingReader::still_valid(const ShmFrame &f) const
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot_hdr_[f.slot_].lock.load(std::memory_order_relaxed) == f.lock_;
+}
+
+bool ShmRingReader::copy_latest(std::vector<std::uint8_t> &out, ShmFrame *meta) const
+{
+  for (int attempt = 0; attempt < 8; ++attempt)
+  {
+    ShmFrame f;
+    if (!latest(f))
+    {
+      if (latest_seq() == 0)
+        return false;
+      continue; // caught the writer mid-slot
+    }
+    out.assign(f.data, f.data + f.size);
+    if (!still_valid(f))
+      continue;
+    if (meta)
+    {
+      *meta = f;
+      meta->data = nullptr; // the copy is in `out`
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ShmRingReader::wait_next(std::uint64_t after, ShmFrame &out,
+                              std::chrono::milliseconds timeout) const
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;)
+  {
+    if (latest_seq() > after && latest(out) && out.seq > after)
+      return true;
+    if (std::chrono::steady_clock::now() >= deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+bool ShmRingReader::writer_alive() const
+{
+  return kill(pid_t(hdr_->writer_pid), 0) == 0 || errno == EPERM;
+}
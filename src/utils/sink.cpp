@@ -0,0 +1,46 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/log.h"
+#include "utils/sink.h"
+
+void FdSink::write(const std::uint8_t *data, std::size_t len)
+{
+  while (len)
+  {
+    const ssize_t n = ::write(fd_, data, len);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("FdSink write: ") + std::strerror(errno));
+    }
+    data += n;
+    len -= size_t(n);
+  }
+}
+
+void FdSink::reserve(std::uint64_t total)
+{
+  struct stat st{};
+  if (::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode))
+    return;
+  const off_t pos = ::lseek(fd_, 0, SEEK_CUR);
+  if (pos < 0)
+    return;
+  const int rc = ::posix_fallocate(fd_, pos, off_t(total));
+  if (rc != 0)
+    LOG_DEBUG("posix_fallocate(%llu) failed: %s", (unsigned long long)total,
+              std::strerror(rc));
+}
+
+void FdSink::sync()
+{
+  if (::fsync(fd_) != 0 && errno != EINVAL)
+    throw std::runtime_error(std::string("FdSink fsync: ") + std::strerror(errno));
+}
@@ -0,0 +1,260 @@
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "utils/trace.h"
+
+std::atomic<bool> g_trace_on{false};
+
+namespace
+{
+struct TraceEvent
+{
+  const char *name;
+  const char *cat;
+  std::uint32_t tid;
+  std::uint64_t ts_ns;
+  std::uint64_t dur_ns;
+  int nargs;
+  const char *keys[TraceScope::kMaxArgs];
+  std::uint64_t vals[TraceScope::kMaxArgs];
+};
+
+constexpr std::size_t kEventsPerThread = 1 << 14; // allocated on first event
+
+// Written only by the thread that holds it; `count` is published with
+// release so the exporter sees fully written events. When that thread exits
+// the buffer goes back to the pool and the next new thread carries on where
+// it stopped (events keep their own tid), so short-lived threads don't each
+// cost a buffer.
+struct ThreadBuffer
+{
+  std::vector<TraceEvent> events;
+  std::atomic<std::size_t> count{0};
+  bool in_use{false}; // g_reg_mu
+};
+
+std::mutex g_reg_mu; // registry only; never taken while recording
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+std::map<std::uint32_t, std::string> g_names; // tid -> trace_thread_name
+std::uint32_t g_next_tid = 1;
+std::atomic<std::uint64_t> g_dropped{0};
+const auto g_epoch = std::chrono::steady_clock::now();
+
+std::uint64_t now_ns()
+{
+  return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - g_epoch)
+                           .count());
+}
+
+struct LocalBuffer
+{
+  std::shared_ptr<ThreadBuffer> buf;
+  std::uint32_t tid{0};
+
+  ~LocalBuffer()
+  {
+    if (!buf)
+      return;
+    std::lock_guard<std::mutex> lk(g_reg_mu);
+    buf->in_use = false;
+  }
+};
+
+thread_local LocalBuffer t_local;
+thread_local std::string t_name;
+
+ThreadBuffer &local_buffer()
+{
+  if (!t_local.buf)
+  {
+    std::lock_guard<std::mutex> lk(g_reg_mu);
+    t_local.tid = g_next_tid++;
+    if (!t_name.empty())
+      g_names[t_local.tid] = t_name;
+    // an idle buffer with the most room left, else a new one
+    std::shared_ptr<ThreadBuffer> best;
+    for (auto &b : g_buffers)
+      if (!b->in_use && (!best || b->count.load(std::memory_order_relaxed) <
+                                      best->count.load(std::memory_order_relaxed)))
+        best = b;
+    if (!best || best->count.load(std::memory_order_relaxed) >= kEventsPerThread)
+    {
+      best = std::make_shared<ThreadBuffer>();
+      best->events.resize(kEventsPerThread);
+      g_buffers.push_back(best);
+    }
+    best->in_use = true;
+    t_local.buf = std::move(best);
+  }
+  return *t_local.buf;
+}
+
+void json_escape(std::string &out, const char *s)
+{
+  for (; *s; ++s)
+  {
+    const char c = *s;
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+      out += ' ';
+    else
+      out += c;
+  }
+}
+} // namespace
+
+void trace_enable(bool on) { g_trace_on.store(on, std::memory_order_relaxed); }
+
+void trace_thread_name(const char *name)
+{
+  t_name = name;
+  if (!t_local.buf)
+    return; // picked up when the thread records its first event
+  std::lock_guard<std::mutex> lk(g_reg_mu);
+  g_names[t_local.tid] = t_name;
+}
+
+void trace_clear()
+{
+  std::lock_guard<std::mutex> lk(g_reg_mu);
+  for (auto &b : g_buffers)
+    b->count.store(0, std::memory_order_release);
+  g_dropped.store(0, std::memory_order_relaxed);
+}
+
+std::size_t trace_event_count()
+{
+  std::lock_guard<std::mutex> lk(g_reg_mu);
+  std::size_t n = 0;
+  for (auto &b : g_buffers)
+    n += b->count.load(std::memory_order_acquire);
+  return n;
+}
+
+std::size_t trace_buffer_count()
+{
+  std::lock_guard<std::mutex> lk(g_reg_mu);
+  return g_buffers.size();
+}
+
+void TraceScope::begin_(const char *name, const char *cat)
+{
+  active_ = true;
+  name_ = name;
+  cat_ = cat;
+  t0_ns_ = now_ns();
+}
+
+void TraceScope::end_()
+{
+  const std::uint64_t t1 = now_ns();
+  auto &b = local_buffer();
+  const std::size_t i = b.count.load(std::memory_order_relaxed);
+  if (i >= b.events.size())
+  {
+    g_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceEvent &e = b.events[i];
+  e.name = name_;
+  e.cat = cat_;
+  e.tid = t_local.tid;
+  e.ts_ns = t0_ns_;
+  e.dur_ns = t1 - t0_ns_;
+  e.nargs = nargs_;
+  for (int k = 0; k < nargs_; ++k)
+  {
+    e.keys[k] = keys_[k];
+    e.vals[k] = vals_[k];
+  }
+  b.count.store(i + 1, std::memory_order_release);
+}
+
+std::string trace_json()
+{
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  char num[160];
+  auto sep = [&]
+  {
+    if (!first)
+      out += ",\n";
+    first = false;
+  };
+
+  std::lock_guard<std::mutex> lk(g_reg_mu);
+  for (const auto &t : g_names)
+  {
+    sep();
+    std::snprintf(num, sizeof(num),
+                  "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                  t.first);
+    out += num;
+    json_escape(out, t.second.c_str());
+    out += "\"}}";
+  }
+  for (auto &b : g_buffers)
+  {
+    const std::size_t n = b->count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      const TraceEvent &e = b->events[i];
+      sep();
+      out += "{\"ph\":\"X\",\"name\":\"";
+      json_escape(out, e.name);
+      out += "\",\"cat\":\"";
+      json_escape(out, e.cat);
+      // Chrome wants microseconds; keep the ns as the fraction
+      std::snprintf(num, sizeof(num),
+                    "\",\"pid\":1,\"tid\":%u,\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u",
+                    e.tid, e.ts_ns / 1000, unsigned(e.ts_ns % 1000),
+                    e.dur_ns / 1000, unsigned(e.dur_ns % 1000));
+      out += num;
+      if (e.nargs)
+      {
+        out += ",\"args\":{";
+        for (int k = 0; k < e.nargs; ++k)
+        {
+          out += k ? ",\"" : "\"";
+          json_escape(out, e.keys[k]);
+          std::snprintf(num, sizeof(num), "\":%" PRIu64, e.vals[k]);
+          out += num;
+        }
+        out += "}";
+      }
+      out += "}";
+    }
+  }
+  const auto dropped = g_dropped.load(std::memory_order_relaxed);
+  if (dropped)
+  {
+    sep();
+    std::snprintf(num, sizeof(num),
+                  "{\"ph\":\"i\",\"s\":\"p\",\"name\":\"trace buffer full\",\"pid\":1,\"tid\":0,"
+                  "\"ts\":0,\"args\":{\"dropped\":%" PRIu64 "}}",
+                  dropped);
+    out += num;
+  }
+  out += "\n]}\n";
+  return out;
+}
+
+bool trace_dump_json(const std::string &path)
+{
+  std::ofstream f(path, std::ios::trunc);
+  if (!f)
+    return false;
+  f << trace_json();
+  return bool(f);
+}
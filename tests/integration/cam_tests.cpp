@@ -1,14 +1,35 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_version_macros.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
 static_assert(CATCH_VERSION_MAJOR >= 3, "Catch2 v3 required");
 
 #include "utils/log.h"
+#include "utils/sink.h"
 #include "utils/utils.h"
 #include "utils/apex.h"
 #include "ptp/ptp.h"
+#include "ptp/device_prop.h"
+#include "ptp/download.h"
+#include "ptp/event_monitor.h"
+#include "ptp/object_catalog.h"
+#include "ptp/resumable.h"
+#include "ptp/thumbnail.h"
+#include "sigma/burst.h"
+#include "sigma/can_set.h"
+#include "sigma/live_view.h"
+#include "sigma/profile.h"
 #include "sigma/schema.h"
 #include "sigma/sigma_ptp.h"
+#include "sigma/state_cache.h"
 #include "ptp/fake_transport.h"
 
 TEST_CASE("SetCamDataGroup1 cmd/data out frame")
@@ -458,3 +479,1404 @@ TEST_CASE("GetCamDataGroupFocus cmd/data out frame")
   REQUIRE(cmd_m  == golden_cmd);
 }
 
+static std::vector<uint8_t> build_event(uint16_t code, std::vector<uint32_t> params)
+{
+  std::vector<uint8_t> b;
+  put_32le(b, uint32_t(12 + params.size() * 4));
+  put_16le(b, PTP_CONTAINER_EVENT);
+  put_16le(b, code);
+  put_32le(b, 0);
+  for (uint32_t p : params)
+    put_32le(b, p);
+  return b;
+}
+
+TEST_CASE("wait_object_added wakes on ObjectAdded and honours the predicate")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+
+  const auto t0 = std::chrono::steady_clock::now(); // "just before the capture"
+  tp.queue_event(build_event(PTP_EVENT_DevicePropChanged, {0x5001}));
+  tp.queue_event(build_event(PTP_EVENT_ObjectAdded, {0x11}));
+  std::thread late([&]
+                   {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    tp.queue_event(build_event(PTP_EVENT_ObjectAdded, {0x22})); });
+
+  auto h = cam.wait_object_added(std::chrono::milliseconds(2000),
+                                 [](const PtpEvent &e)
+                                 { return e.params[0] == 0x22; }, t0);
+  late.join();
+  REQUIRE(h.has_value());
+  REQUIRE(*h == 0x22);
+
+  // the skipped event stays in the backlog for the next waiter
+  h = cam.wait_object_added(std::chrono::milliseconds(100), {}, t0);
+  REQUIRE(h.has_value());
+  REQUIRE(*h == 0x11);
+
+  REQUIRE_FALSE(cam.wait_object_added(std::chrono::milliseconds(20)).has_value());
+
+  // an event from before the wait began is not the new object...
+  tp.queue_event(build_event(PTP_EVENT_ObjectAdded, {0x33}));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE_FALSE(cam.wait_object_added(std::chrono::milliseconds(20)).has_value());
+  // ...unless the caller says it started the capture before it
+  h = cam.wait_object_added(std::chrono::milliseconds(20), {}, t0);
+  REQUIRE(h.has_value());
+  CHECK(*h == 0x33);
+  cam.stop_event_monitor();
+}
+
+TEST_CASE("EventMonitor idles when the transport has no interrupt pipe")
+{
+  struct NoIntr : FakeTransport
+  {
+    std::atomic<int> reads{0};
+    int read_intr(void *, int, unsigned) override
+    {
+      ++reads;
+      return 0; // as USBTransport does without an interrupt endpoint
+    }
+  } tp;
+  EventMonitor mon(tp);
+  mon.start(20);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  mon.stop();
+  CHECK(tp.reads > 0);
+  CHECK(tp.reads <= 10); // one read per slice, not a spin
+}
+
+// ApiConfig directory with CameraModel (tag 1), FirmwareVersion (tag 3) and,
+// if given, SerialNumber (tag 2)
+static std::vector<uint8_t> build_api_config(const std::string &model,
+                                             const std::string &fw,
+                                             const std::string &serial = "")
+{
+  std::vector<std::pair<uint16_t, std::string>> entries = {{1, model}, {3, fw}};
+  if (!serial.empty())
+    entries.push_back({2, serial});
+  std::vector<uint8_t> b(8 + entries.size() * 12, 0);
+  put_32le_at(b, 0, 0);
+  put_32le_at(b, uint32_t(entries.size()), 4);
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    const size_t off = 8 + i * 12;
+    const auto &s = entries[i].second;
+    put_16le_at(b, entries[i].first, off);
+    put_16le_at(b, uint16_t(DirectoryType::String), off + 2);
+    put_32le_at(b, uint32_t(s.size() + 1), off + 4);
+    if (s.size() + 1 <= 4)
+    {
+      std::copy(s.begin(), s.end(), b.begin() + off + 8); // inline value
+      continue;
+    }
+    put_32le_at(b, uint32_t(b.size()), off + 8);
+    b.insert(b.end(), s.begin(), s.end());
+    b.push_back(0);
+  }
+  put_32le_at(b, uint32_t(b.size()), 0);
+  return b;
+}
+
+static std::vector<uint8_t> build_device_info(const std::vector<uint16_t> &ops)
+{
+  std::vector<uint8_t> b;
+  put_16le(b, 100);
+  put_32le(b, 6);
+  put_16le(b, 100);
+  put_8(b, 0); // VendorExtensionDesc
+  put_16le(b, 0);
+  put_32le(b, uint32_t(ops.size()));
+  for (auto op : ops)
+    put_16le(b, op);
+  for (int k = 0; k < 4; ++k)
+    put_32le(b, 0); // events, props, capture and image formats
+  for (int k = 0; k < 4; ++k)
+    put_8(b, 0); // manufacturer, model, version, serial
+  return b;
+}
+
+TEST_CASE("device_info is cached on disk per model + firmware + serial")
+{
+  const std::string dir = std::filesystem::temp_directory_path().string();
+  const std::string file = dir + "/fp_01.00_93001.devinfo";
+  std::remove(file.c_str());
+  constexpr uint16_t CONFIG_API = static_cast<uint16_t>(SigmaOp::ConfigApi);
+
+  {
+    FakeTransport tp;
+    tp.respond_data(CONFIG_API, build_api_config("fp", "01.00", "93001"));
+    tp.respond_data(PTP_OP_GetDeviceInfo, build_device_info({0x1001, 0x9035}));
+    SigmaCamera cam(tp);
+    cam.set_device_info_cache_dir(dir);
+    cam.config_api();
+    REQUIRE(cam.device_info().supports_operation(0x9035));
+    REQUIRE(cam.device_info().supports_operation(0x1001));
+    REQUIRE(tp.command_count(PTP_OP_GetDeviceInfo) == 1);
+  }
+  {
+    FakeTransport tp;
+    tp.respond_data(CONFIG_API, build_api_config("fp", "01.00", "93001"));
+    SigmaCamera cam(tp);
+    cam.set_device_info_cache_dir(dir);
+    cam.config_api();
+    REQUIRE(cam.device_info().supports_operation(0x9035));
+    REQUIRE_FALSE(cam.device_info().supports_operation(0x9030));
+    REQUIRE(tp.command_count(PTP_OP_GetDeviceInfo) == 0);
+  }
+  // another unit of the same model and firmware asks its own body
+  for (const char *serial : {"93002", ""})
+  {
+    FakeTransport tp;
+    tp.respond_data(CONFIG_API, build_api_config("fp", "01.00", serial));
+    tp.respond_data(PTP_OP_GetDeviceInfo, build_device_info({0x1001, 0x9030}));
+    SigmaCamera cam(tp);
+    cam.set_device_info_cache_dir(dir);
+    cam.config_api();
+    REQUIRE(cam.device_info().supports_operation(0x9030));
+    REQUIRE(tp.command_count(PTP_OP_GetDeviceInfo) == 1);
+  }
+  std::remove(file.c_str());
+  std::remove((dir + "/fp_01.00_93002.devinfo").c_str());
+}
+
+static std::vector<uint8_t> build_u32_array(const std::vector<uint32_t> &v)
+{
+  std::vector<uint8_t> b;
+  put_32le(b, uint32_t(v.size()));
+  for (auto x : v)
+    put_32le(b, x);
+  return b;
+}
+
+static std::vector<uint8_t> build_object_info(uint32_t storage, uint32_t size,
+                                              const std::string &name)
+{
+  std::vector<uint8_t> b;
+  put_32le(b, storage);
+  put_16le(b, 0x3801); // EXIF/JPEG
+  put_16le(b, 0);
+  put_32le(b, size);
+  put_16le(b, 0x3808);
+  for (int k = 0; k < 7; ++k)
+    put_32le(b, 0); // thumb size/dims, image dims/depth, parent
+  put_16le(b, 0); // AssociationType
+  put_32le(b, 0);
+  put_32le(b, 0);
+  put_8(b, uint8_t(name.size() + 1));
+  for (char c : name)
+    put_16le(b, uint8_t(c));
+  put_16le(b, 0);
+  put_8(b, 0); // CaptureDate
+  put_8(b, 0); // ModificationDate
+  put_8(b, 0); // Keywords
+  return b;
+}
+
+TEST_CASE("ObjectCatalog builds once and follows object events")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  tp.respond_data(PTP_OP_GetStorageIDs, build_u32_array({0x00010001}));
+  tp.respond_data(PTP_OP_GetObjectHandles, build_u32_array({1, 2, 3}));
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, 4096, "SDIM0001.JPG"));
+
+  ObjectCatalog cat(cam);
+  cat.build();
+  REQUIRE(cat.size() == 3);
+  REQUIRE(tp.command_count(PTP_OP_GetObjectInfo) == 3);
+  auto e = cat.find(2);
+  REQUIRE(e.has_value());
+  CHECK(e->storage == 0x00010001);
+  CHECK(e->size == 4096);
+  CHECK(e->filename == "SDIM0001.JPG");
+
+  // nothing happened: no round trips
+  REQUIRE(cat.refresh() == 0);
+  REQUIRE(tp.command_count(PTP_OP_GetObjectHandles) == 1);
+
+  auto refresh_until = [&](size_t want)
+  {
+    size_t got = 0;
+    for (int i = 0; i < 200 && got < want; ++i)
+    {
+      got += cat.refresh();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return got;
+  };
+
+  tp.respond_data(PTP_OP_GetObjectInfo, {}); // handle 2 is gone
+  tp.queue_event(build_event(PTP_EVENT_ObjectRemoved, {2}));
+  REQUIRE(refresh_until(1) == 1);
+  REQUIRE(cat.size() == 2);
+  REQUIRE_FALSE(cat.find(2).has_value());
+
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, 8192, "SDIM0004.DNG"));
+  tp.queue_event(build_event(PTP_EVENT_ObjectAdded, {4}));
+  REQUIRE(refresh_until(1) == 1);
+  REQUIRE(cat.size() == 3);
+  REQUIRE(cat.find(4)->filename == "SDIM0004.DNG");
+  REQUIRE(cat.find(1).has_value());
+  REQUIRE(cat.find(3).has_value());
+  REQUIRE(tp.command_count(PTP_OP_GetObjectHandles) == 1);
+}
+
+// object bytes are a function of their offset, so misplaced chunks show up
+static std::vector<uint8_t> object_bytes(uint32_t offset, uint32_t n)
+{
+  std::vector<uint8_t> v(n);
+  for (uint32_t i = 0; i < n; ++i)
+    v[i] = uint8_t((offset + i) * 31u);
+  return v;
+}
+
+TEST_CASE("ObjectDownloader streams GetPartialObject chunks in order")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = 100000;
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, SIZE, "SDIM0001.DNG"));
+  tp.respond_with(PTP_OP_GetPartialObject, [](const std::vector<uint32_t> &p)
+                  { return object_bytes(p.at(1), std::min(p.at(2), SIZE - p.at(1))); });
+
+  std::vector<uint8_t> out;
+  VectorSink sink(out);
+  ObjectDownloader dl(cam, DownloadOptions{16 * 1024, 2});
+  auto st = dl.download(7, sink);
+
+  REQUIRE(st.bytes == SIZE);
+  REQUIRE(st.chunks == 7); // ceil(100000 / 16384)
+  REQUIRE(tp.command_count(PTP_OP_GetPartialObject) == 7);
+  REQUIRE(out == object_bytes(0, SIZE));
+}
+
+TEST_CASE("download_to_file resumes from the sidecar checkpoint")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = 100000;
+  constexpr uint32_t CHUNK = 16 * 1024;
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, SIZE, "SDIM0001.DNG"));
+
+  // the link drops after three chunks
+  int served = 0;
+  tp.respond_with(PTP_OP_GetPartialObject, [&](const std::vector<uint32_t> &p)
+                  {
+    if (served++ == 3)
+      return std::vector<uint8_t>{};
+    return object_bytes(p.at(1), std::min(p.at(2), SIZE - p.at(1))); });
+
+  const auto path = (std::filesystem::temp_directory_path() / "ptp_resume_test.dng").string();
+  std::remove(path.c_str());
+  std::remove((path + ".part").c_str());
+
+  DownloadOptions opt{CHUNK, 2, CHUNK};
+  ObjectDownloader dl(cam, opt);
+  CHECK_THROWS(dl.download_to_file(7, path));
+  REQUIRE(std::filesystem::exists(path + ".part"));
+
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, SIZE, "SDIM0001.DNG"));
+  tp.respond_with(PTP_OP_GetPartialObject, [](const std::vector<uint32_t> &p)
+                  {
+    REQUIRE(p.at(1) >= 3 * CHUNK); // nothing before the checkpoint is fetched again
+    return object_bytes(p.at(1), std::min(p.at(2), SIZE - p.at(1))); });
+  const auto before = tp.command_count(PTP_OP_GetPartialObject);
+  auto st = dl.download_to_file(7, path);
+
+  REQUIRE(st.bytes == SIZE - 3 * CHUNK);
+  REQUIRE(tp.command_count(PTP_OP_GetPartialObject) - before == 4);
+  REQUIRE_FALSE(std::filesystem::exists(path + ".part"));
+  REQUIRE(std::filesystem::file_size(path) == SIZE);
+
+  std::vector<uint8_t> disk(SIZE);
+  FILE *f = std::fopen(path.c_str(), "rb");
+  REQUIRE(f);
+  REQUIRE(std::fread(disk.data(), 1, SIZE, f) == SIZE);
+  std::fclose(f);
+  REQUIRE(disk == object_bytes(0, SIZE));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("download_pict_file restarts when the sidecar names another file")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = 40000;
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile),
+                  [](const std::vector<uint32_t> &p)
+                  {
+    const uint32_t n = std::min(p.at(2), SIZE - p.at(1));
+    std::vector<uint8_t> b;
+    put_32le(b, n);
+    auto d = object_bytes(p.at(1), n);
+    b.insert(b.end(), d.begin(), d.end());
+    return b; });
+
+  const auto path = (std::filesystem::temp_directory_path() / "sigma_resume_test.jpg").string();
+  DownloadCheckpoint stale{"sigma", 0x1234, SIZE, "SDIM0002.JPG", 8192};
+  stale.save(path + ".part");
+
+  PictFileInfo2 info;
+  info.FileAddress = 0x5678;
+  info.FileSize = SIZE;
+  info.FileName = "SDIM0003.JPG";
+  REQUIRE(cam.download_pict_file(info, path, 16 * 1024) == SIZE);
+  REQUIRE(std::filesystem::file_size(path) == SIZE);
+  REQUIRE_FALSE(std::filesystem::exists(path + ".part"));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("ThumbnailService prefetches once and then serves from cache")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  tp.respond_data(PTP_OP_GetStorageIDs, build_u32_array({0x00010001}));
+  tp.respond_data(PTP_OP_GetObjectHandles, build_u32_array({1, 2, 3}));
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, 4096, "SDIM0001.JPG"));
+  tp.respond_with(PTP_OP_GetThumb, [](const std::vector<uint32_t> &p)
+                  { return std::vector<uint8_t>(100, uint8_t(p.at(0))); });
+
+  ObjectCatalog cat(cam);
+  cat.build();
+
+  const auto dir = std::filesystem::temp_directory_path() / "ptp_thumb_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  ThumbnailOptions opt;
+  opt.memory_bytes = 250; // room for two
+  opt.cache_dir = dir.string();
+  opt.prefetch_gap = std::chrono::milliseconds(0);
+  {
+    ThumbnailService thumbs(cam, cat, opt);
+    thumbs.prefetch();
+    REQUIRE(thumbs.wait_prefetch(std::chrono::seconds(2)));
+    REQUIRE(tp.command_count(PTP_OP_GetThumb) == 3);
+    REQUIRE(thumbs.memory_bytes() == 200); // prefetch never evicts
+
+    REQUIRE(thumbs.get(1)->at(0) == 1);
+    REQUIRE(thumbs.get(3)->at(0) == 3); // from disk, evicts handle 2
+    REQUIRE(thumbs.get(2)->at(0) == 2);
+    REQUIRE(tp.command_count(PTP_OP_GetThumb) == 3);
+    CHECK(thumbs.stats().memory_hits == 1);
+    CHECK(thumbs.stats().disk_hits == 2);
+  }
+
+  // a new session starts with an empty LRU but a warm disk cache
+  ThumbnailService again(cam, cat, opt);
+  REQUIRE(again.get(2)->size() == 100);
+  REQUIRE(tp.command_count(PTP_OP_GetThumb) == 3);
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("ThumbnailService retries failed fetches and stops prefetch at the budget")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  tp.respond_data(PTP_OP_GetStorageIDs, build_u32_array({0x00010001}));
+  tp.respond_data(PTP_OP_GetObjectHandles, build_u32_array({1, 2, 3, 4, 5}));
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, 4096, "SDIM0001.JPG"));
+  tp.respond_with(PTP_OP_GetThumb, [](const std::vector<uint32_t> &p)
+                  { return std::vector<uint8_t>(100, uint8_t(p.at(0))); });
+
+  ObjectCatalog cat(cam);
+  cat.build();
+
+  ThumbnailOptions opt;
+  opt.memory_bytes = 250; // room for two, no disk cache
+  opt.prefetch_gap = std::chrono::milliseconds(0);
+  ThumbnailService thumbs(cam, cat, opt);
+
+  tp.fail_next(PTP_OP_GetThumb, PTP_RESP_DeviceBusy);
+  REQUIRE(thumbs.get(1)->empty());
+  REQUIRE(thumbs.memory_bytes() == 0);
+  REQUIRE(thumbs.get(1)->at(0) == 1); // asked again, not served from cache
+  REQUIRE(tp.command_count(PTP_OP_GetThumb) == 2);
+
+  thumbs.prefetch();
+  REQUIRE(thumbs.wait_prefetch(std::chrono::seconds(2)));
+  // 2 fits, 3 does not and ends the walk; 4 and 5 are never asked for
+  REQUIRE(tp.command_count(PTP_OP_GetThumb) == 4);
+  REQUIRE(thumbs.memory_bytes() == 200);
+}
+
+TEST_CASE("send_object streams a file in full-size pieces")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = (5u << 20) / 2 + 5; // 2.5 MiB + 5
+  const auto body = object_bytes(0, SIZE);
+
+  const auto path = (std::filesystem::temp_directory_path() / "ptp_upload_test.bin").string();
+  FILE *f = std::fopen(path.c_str(), "wb");
+  REQUIRE(f);
+  REQUIRE(std::fwrite(body.data(), 1, SIZE, f) == SIZE);
+  std::fclose(f);
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  REQUIRE(fd >= 0);
+  cam.send_object(fd, SIZE);
+  ::close(fd);
+  std::remove(path.c_str());
+
+  REQUIRE(tp.writes.size() == 4); // command + 3 data writes
+  REQUIRE(read_16le(&tp.writes[0][6]) == PTP_OP_SendObject);
+  CHECK(tp.writes[1].size() == (1u << 20)); // header rides in the first piece
+  CHECK(tp.writes[2].size() == (1u << 20));
+  CHECK(read_32le(&tp.writes[1][0]) == 12 + SIZE);
+  CHECK(read_16le(&tp.writes[1][4]) == PTP_CONTAINER_DATA);
+  CHECK(read_32le(&tp.writes[1][8]) == read_32le(&tp.writes[0][8]));
+
+  std::vector<uint8_t> sent(tp.writes[1].begin() + 12, tp.writes[1].end());
+  for (size_t k = 2; k < tp.writes.size(); ++k)
+    sent.insert(sent.end(), tp.writes[k].begin(), tp.writes[k].end());
+  REQUIRE(sent == body);
+
+  // a source that runs dry is an error, not a silently short object
+  const size_t mark = tp.writes.size();
+  const auto resyncs = cam.resyncs();
+  CHECK_THROWS(cam.send_object(100, [](uint8_t *, size_t)
+                               { return size_t(0); }));
+  // ...and the container is still completed to its declared length
+  REQUIRE(tp.writes.size() == mark + 2);
+  CHECK(tp.writes[mark + 1].size() == 12 + 100);
+  cam.transact(PTP_OP_GetDeviceInfo, {});
+  CHECK(cam.resyncs() == resyncs + 1);
+}
+
+// opcodes of the COMMAND containers written from `from` on
+static std::vector<uint16_t> commands_since(const FakeTransport &tp, size_t from)
+{
+  std::vector<uint16_t> ops;
+  for (size_t i = from; i < tp.writes.size(); ++i)
+    if (tp.writes[i].size() >= 12 && read_16le(&tp.writes[i][4]) == PTP_CONTAINER_COMMAND)
+      ops.push_back(read_16le(&tp.writes[i][6]));
+  return ops;
+}
+
+TEST_CASE("SessionNotOpen reopens, restores settings and replays the op")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr auto op = [](SigmaOp o)
+  { return static_cast<uint16_t>(o); };
+  tp.respond_data(op(SigmaOp::ConfigApi), build_api_config("fp", "01.00"));
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, 4096, "SDIM0001.JPG"));
+
+  cam.open_session(7);
+  cam.config_api();
+  CamDataGroup1 speed;
+  speed.shutterSpeed = 0x20;
+  cam.set_group(speed);
+  CamDataGroup1 aperture;
+  aperture.aperture = 0x30;
+  cam.set_group(aperture);
+  CamDataGroup2 mode;
+  mode.exposureMode = ExposureMode::Manual;
+  cam.set_group(mode);
+
+  const size_t mark = tp.writes.size();
+  tp.fail_next(PTP_OP_GetObjectInfo, PTP_RESP_SessionNotOpen);
+  ObjectInfo oi;
+  oi.decode(cam.get_object_info(3));
+  REQUIRE(oi.Filename == "SDIM0001.JPG");
+  REQUIRE(cam.recoveries() == 1);
+
+  const std::vector<uint16_t> want = {
+      PTP_OP_GetObjectInfo, PTP_OP_OpenSession, op(SigmaOp::ConfigApi),
+      op(SigmaOp::SetCamDataGroup2), op(SigmaOp::SetCamDataGroup1),
+      PTP_OP_GetObjectInfo};
+  REQUIRE(commands_since(tp, mark) == want);
+  const size_t open_at = mark + 1;
+  CHECK(read_32le(&tp.writes[open_at][12]) == 7); // same session id
+
+  // the two Group1 writes come back as one merged dataset
+  CamDataGroup1 merged = speed;
+  merged.merge(aperture);
+  const auto payload = merged.encode();
+  bool found = false;
+  for (size_t i = mark; i + 1 < tp.writes.size(); ++i)
+    if (read_16le(&tp.writes[i][6]) == op(SigmaOp::SetCamDataGroup1) &&
+        read_16le(&tp.writes[i][4]) == PTP_CONTAINER_COMMAND)
+      found = std::vector<uint8_t>(tp.writes[i + 1].begin() + 12, tp.writes[i + 1].end()) == payload;
+  REQUIRE(found);
+}
+
+TEST_CASE("IncompleteTransfer recovers but only replays idempotent ops")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  tp.respond_data(PTP_OP_GetObjectInfo, build_object_info(0x00010001, 4096, "SDIM0001.JPG"));
+
+  tp.fail_next(PTP_OP_DeleteObject, PTP_RESP_IncompleteTransfer);
+  cam.delete_object(3);
+  REQUIRE(cam.recoveries() == 1);
+  REQUIRE(tp.command_count(PTP_OP_DeleteObject) == 1);
+
+  tp.fail_next(PTP_OP_GetObjectInfo, PTP_RESP_IncompleteTransfer);
+  REQUIRE_FALSE(cam.get_object_info(3).empty());
+  REQUIRE(cam.recoveries() == 2);
+  REQUIRE(tp.command_count(PTP_OP_GetObjectInfo) == 2);
+
+  cam.set_auto_recover(false);
+  tp.fail_next(PTP_OP_GetObjectInfo, PTP_RESP_SessionNotOpen);
+  REQUIRE(cam.transact(PTP_OP_GetObjectInfo, {3}).response_code == PTP_RESP_SessionNotOpen);
+  REQUIRE(cam.recoveries() == 2);
+}
+
+TEST_CASE("a timeout on a live session is retried before recovering")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  const auto info = build_object_info(0x00010001, 4096, "SDIM0001.JPG");
+  tp.respond_data(PTP_OP_GetObjectInfo, info);
+
+  const size_t mark = tp.writes.size();
+  tp.drop_next(PTP_OP_GetObjectInfo);
+  REQUIRE(cam.get_object_info(3) == info);
+  CHECK(cam.recoveries() == 0);
+  CHECK(cam.resyncs() == 1);
+  CHECK(commands_since(tp, mark) ==
+        std::vector<uint16_t>{PTP_OP_GetObjectInfo, PTP_OP_GetObjectInfo});
+
+  // a retry that fails too escalates to recovery
+  tp.drop_next(PTP_OP_GetObjectInfo);
+  tp.drop_next(PTP_OP_GetObjectInfo);
+  REQUIRE(cam.get_object_info(3) == info);
+  CHECK(cam.recoveries() == 1);
+  CHECK(tp.command_count(PTP_OP_OpenSession) == 1);
+}
+
+static std::vector<uint8_t> build_container(uint16_t type, uint16_t code, uint32_t tid,
+                                            const std::vector<uint8_t> &payload = {})
+{
+  std::vector<uint8_t> b;
+  put_32le(b, uint32_t(12 + payload.size()));
+  put_16le(b, type);
+  put_16le(b, code);
+  put_32le(b, tid);
+  b.insert(b.end(), payload.begin(), payload.end());
+  return b;
+}
+
+TEST_CASE("transact skips containers that belong to other transactions")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  const auto info = build_object_info(0x00010001, 4096, "SDIM0001.JPG");
+  tp.respond_data(PTP_OP_GetObjectInfo, info);
+
+  // leftovers of an abandoned transaction sit in front of the real answer
+  tp.queue_read(build_container(PTP_CONTAINER_DATA, PTP_OP_GetThumb, 0x55, {1, 2, 3}));
+  tp.queue_read(build_container(PTP_CONTAINER_RESPONSE, PTP_RESP_OK, 0x55));
+  REQUIRE(cam.get_object_info(3) == info);
+  REQUIRE(cam.resyncs() == 0);
+}
+
+TEST_CASE("containers of whole USB packets leave no ZLP for the next transaction")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  cam.set_auto_recover(false);
+  const auto info = build_object_info(0x00010001, 4096, "SDIM0001.JPG");
+  tp.respond_data(PTP_OP_GetObjectInfo, info);
+
+  // a 1024 byte DATA container fills the head read, a 4096 byte one the rest
+  for (size_t total : {size_t(1024), size_t(4096), size_t(4096 + (1 << 20))})
+  {
+    tp.respond_data(PTP_OP_GetObject, object_bytes(0, uint32_t(total - 12)));
+    REQUIRE(cam.transact(PTP_OP_GetObject, {3}).data.size() == total - 12);
+    REQUIRE(cam.get_object_info(3) == info);
+  }
+  REQUIRE(cam.resyncs() == 0);
+}
+
+TEST_CASE("a timed-out transaction triggers a drain before the next one")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  cam.set_auto_recover(false);
+  const auto info = build_object_info(0x00010001, 4096, "SDIM0001.JPG");
+  tp.respond_data(PTP_OP_GetObjectInfo, info);
+
+  tp.drop_next(PTP_OP_GetObjectInfo);
+  CHECK_THROWS(cam.get_object_info(3));
+  const uint32_t lost_tid = read_32le(&tp.writes.back()[8]);
+
+  // the late answer shows up after we gave up on it
+  tp.queue_read(build_container(PTP_CONTAINER_DATA, PTP_OP_GetObjectInfo, lost_tid, {9, 9, 9, 9}));
+  tp.queue_read(build_container(PTP_CONTAINER_RESPONSE, PTP_RESP_OK, lost_tid));
+
+  REQUIRE(cam.get_object_info(3) == info);
+  REQUIRE(cam.resyncs() == 1);
+  REQUIRE(cam.get_object_info(3) == info);
+  REQUIRE(cam.resyncs() == 1);
+}
+
+TEST_CASE("DevicePropCache serves repeats locally until DevicePropChanged")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  std::vector<uint8_t> desc;
+  put_16le(desc, 0x5005); // WhiteBalance
+  put_16le(desc, PTP_DTC_UINT16);
+  put_8(desc, 1);
+  put_16le(desc, 2);
+  put_16le(desc, 2);
+  put_8(desc, DevicePropDesc::FormEnum);
+  put_16le(desc, 2);
+  put_16le(desc, 2);
+  put_16le(desc, 4);
+  tp.respond_data(PTP_OP_GetDevicePropDesc, desc);
+
+  DevicePropCache props(cam);
+  for (int i = 0; i < 3; ++i)
+    REQUIRE(props.get(0x5005).Enumeration.size() == 2);
+  REQUIRE(tp.command_count(PTP_OP_GetDevicePropDesc) == 1);
+
+  // validated locally: no round trip for a value outside the enumeration
+  CHECK_THROWS(props.set(0x5005, PropValue::of_uint(PTP_DTC_UINT16, 3)));
+  REQUIRE(props.set(0x5005, PropValue::of_uint(PTP_DTC_UINT16, 4)) == PTP_RESP_OK);
+  REQUIRE(tp.command_count(PTP_OP_SetDevicePropValue) == 1);
+  REQUIRE(props.get(0x5005).CurrentValue.as_uint() == 4);
+
+  tp.queue_event(build_event(PTP_EVENT_DevicePropChanged, {0x5005}));
+  for (int i = 0; i < 200 && props.cached(0x5005); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  REQUIRE_FALSE(props.cached(0x5005));
+  REQUIRE(props.get(0x5005).CurrentValue.as_uint() == 2);
+  REQUIRE(tp.command_count(PTP_OP_GetDevicePropDesc) == 2);
+  cam.stop_event_monitor();
+}
+
+TEST_CASE("run_batch sends pre-encoded ops in order and honours the error mode")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  const auto info = build_object_info(0x00010001, 4096, "SDIM0001.JPG");
+  tp.respond_data(PTP_OP_GetObjectInfo, info);
+  const std::vector<uint8_t> wb{0x04, 0x00};
+
+  std::vector<CameraPTP::Request> batch(4);
+  batch[0].opcode = PTP_OP_SetDevicePropValue;
+  batch[0].nparams = 1;
+  batch[0].params[0] = 0x5005;
+  batch[0].data = wb.data();
+  batch[0].data_size = wb.size();
+  batch[1].opcode = PTP_OP_DeleteObject;
+  batch[1].nparams = 1;
+  batch[1].params[0] = 9;
+  batch[2].opcode = PTP_OP_GetObjectInfo;
+  batch[2].nparams = 1;
+  batch[2].params[0] = 3;
+  batch[3] = batch[1];
+
+  std::vector<CameraPTP::Response> results;
+  const size_t w0 = tp.writes.size();
+  REQUIRE(cam.run_batch(batch, results) == 4);
+  REQUIRE(results.size() == 4);
+  for (const auto &r : results)
+    CHECK(r.response_code == PTP_RESP_OK);
+  CHECK(results[2].data == info);
+  REQUIRE(commands_since(tp, w0) == std::vector<uint16_t>{PTP_OP_SetDevicePropValue,
+                                                           PTP_OP_DeleteObject,
+                                                           PTP_OP_GetObjectInfo,
+                                                           PTP_OP_DeleteObject});
+  // SetDevicePropValue's data container follows its command, same tid
+  REQUIRE(tp.writes[w0 + 1].size() == 12 + wb.size());
+  CHECK(read_32le(&tp.writes[w0 + 1][8]) == read_32le(&tp.writes[w0][8]));
+
+  tp.fail_next(PTP_OP_DeleteObject, PTP_RESP_AccessDenied);
+  REQUIRE(cam.run_batch(batch, results) == 2);
+  CHECK(results[1].response_code == PTP_RESP_AccessDenied);
+
+  tp.fail_next(PTP_OP_DeleteObject, PTP_RESP_AccessDenied);
+  REQUIRE(cam.run_batch(batch, results, CameraPTP::BatchMode::ContinueOnError) == 4);
+  CHECK(results[1].response_code == PTP_RESP_AccessDenied);
+  CHECK(results[2].data == info);
+  CHECK(results[3].response_code == PTP_RESP_OK);
+
+  // the tids stay consecutive across batches and single transactions
+  const uint32_t last = read_32le(&tp.writes.back()[8]);
+  REQUIRE(cam.get_object_info(3) == info);
+  CHECK(read_32le(&tp.writes.back()[8]) == last + 1);
+}
+
+static std::vector<uint8_t> build_capt_status(CaptStatus status)
+{
+  std::vector<uint8_t> b{0x00, 1, 0, 1};
+  put_16le(b, static_cast<uint16_t>(status));
+  b.push_back(static_cast<uint8_t>(DestToSave::InCamera));
+  b.push_back(0x00);
+  return b;
+}
+
+TEST_CASE("wait_completion polls at once, backs off and splits the phases")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  const std::vector<CaptStatus> script{
+      CaptStatus::ShootInProgress, CaptStatus::ShootInProgress,
+      CaptStatus::ImageGenInProgress, CaptStatus::ImageGenInProgress,
+      CaptStatus::ImageGenCompleted};
+  size_t at = 0;
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetCamCaptStatus),
+                  [&](const std::vector<uint32_t> &)
+                  { return build_capt_status(script[std::min(at++, script.size() - 1)]); });
+
+  WaitPolicy p;
+  p.initial_interval = std::chrono::milliseconds(5);
+  p.max_interval = std::chrono::milliseconds(20);
+  p.wake_on_event = false;
+  WaitStats ws;
+  const auto st = cam.wait_completion(1, p, &ws);
+  CHECK(st.Status == CaptStatus::ImageGenCompleted);
+  CHECK(ws.completed);
+  CHECK(ws.polls == 5);
+  CHECK(ws.shoot_ms.count() >= 10);    // 5 ms, then 10 ms
+  CHECK(ws.image_gen_ms.count() >= 10);
+  CHECK(ws.total < std::chrono::milliseconds(500));
+}
+
+TEST_CASE("wait_completion wakes early on a PTP event")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  int polls = 0;
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetCamCaptStatus),
+                  [&](const std::vector<uint32_t> &)
+                  { return build_capt_status(polls++ ? CaptStatus::ImageGenCompleted
+                                                     : CaptStatus::ShootInProgress); });
+
+  WaitPolicy p;
+  p.initial_interval = p.max_interval = std::chrono::milliseconds(3000);
+  std::thread late([&]
+                   {
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    tp.queue_event(build_event(0xC001, {})); });
+  WaitStats ws;
+  const auto st = cam.wait_completion(1, p, &ws);
+  late.join();
+  CHECK(st.Status == CaptStatus::ImageGenCompleted);
+  CHECK(ws.event_wakeups == 1);
+  CHECK(ws.total < std::chrono::milliseconds(1500));
+  // the hint was not consumed
+  REQUIRE(cam.events().wait({}, std::chrono::milliseconds(100)).has_value());
+  cam.stop_event_monitor();
+}
+
+static std::vector<uint8_t> build_pict_file_info2(uint32_t address, uint32_t size,
+                                                  const std::string &name)
+{
+  std::vector<uint8_t> b(12, 0);
+  put_32le(b, address);
+  put_32le(b, size);
+  put_32le(b, 0);
+  put_32le(b, 0);
+  b.insert(b.end(), {'J', 'P', 'G', ' '});
+  put_16le(b, 6000);
+  put_16le(b, 4000);
+  const std::string path = "DCIM/100SIGMA";
+  b.insert(b.end(), path.begin(), path.end());
+  b.push_back(0);
+  b.insert(b.end(), name.begin(), name.end());
+  b.push_back(0);
+  return b;
+}
+
+TEST_CASE("BurstCapture keeps the image DB within depth and clears in batches")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = 20000;
+  const auto snap_op = static_cast<uint16_t>(SigmaOp::SnapCommand);
+  const auto clear_op = static_cast<uint16_t>(SigmaOp::ClearImageDBSingle);
+  size_t seen_snaps = 0;
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetCamCaptStatus),
+                  [&](const std::vector<uint32_t> &p)
+                  {
+    if (!p.empty())
+    {
+      auto b = build_capt_status(CaptStatus::ImageGenCompleted);
+      b[1] = uint8_t(p[0]);
+      return b;
+    }
+    // the first read after a snap still describes the previous frame
+    const size_t snaps = tp.command_count(snap_op);
+    const auto tail = uint8_t(snaps == seen_snaps ? snaps : snaps - 1);
+    seen_snaps = snaps;
+    auto b = build_capt_status(CaptStatus::ShootInProgress);
+    b[1] = b[3] = tail;
+    return b; });
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetPictFileInfo2),
+                  [](const std::vector<uint32_t> &p)
+                  {
+    char name[16];
+    std::snprintf(name, sizeof(name), "SDIM%04u.JPG", p.at(0));
+    return build_pict_file_info2(p.at(0) << 20, SIZE, name); });
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile),
+                  [](const std::vector<uint32_t> &p)
+                  {
+    const uint32_t n = std::min(p.at(2), SIZE - p.at(1));
+    std::vector<uint8_t> b;
+    put_32le(b, n);
+    auto d = object_bytes(p.at(1), n);
+    b.insert(b.end(), d.begin(), d.end());
+    return b; });
+
+  const auto dir = std::filesystem::temp_directory_path() / "sigma_burst_test";
+  std::filesystem::remove_all(dir);
+  BurstOptions opt;
+  opt.frames = 5;
+  opt.depth = 2;
+  opt.clear_batch = 2;
+  opt.chunk = 8192;
+  opt.dir = dir.string();
+  opt.wait.wake_on_event = false;
+
+  const size_t w0 = tp.writes.size();
+  BurstCapture burst(cam, opt);
+  int seen = 0;
+  burst.on_frame = [&](const BurstFrame &)
+  { ++seen; };
+  const auto res = burst.run();
+
+  REQUIRE(res.frames.size() == 5);
+  CHECK(seen == 5);
+  CHECK(res.bytes == 5 * SIZE);
+  for (size_t i = 0; i < res.frames.size(); ++i)
+  {
+    CHECK(res.frames[i].image_id == i + 1);
+    CHECK(std::filesystem::file_size(res.frames[i].path) == SIZE);
+  }
+  REQUIRE(tp.command_count(clear_op) == 5);
+
+  int in_db = 0, most = 0;
+  for (uint16_t op : commands_since(tp, w0))
+  {
+    in_db += op == snap_op ? 1 : op == clear_op ? -1 : 0;
+    most = std::max(most, in_db);
+  }
+  CHECK(most <= 2);
+  CHECK(in_db == 0);
+
+  // a failure mid-burst still clears the frames already saved
+  opt.frames = 3;
+  BurstCapture failing(cam, opt);
+  failing.on_frame = [](const BurstFrame &)
+  { throw std::runtime_error("disk full"); };
+  const size_t w1 = tp.writes.size();
+  CHECK_THROWS(failing.run());
+  std::vector<uint32_t> cleared;
+  for (size_t i = w1; i < tp.writes.size(); ++i)
+    if (read_16le(&tp.writes[i][4]) == PTP_CONTAINER_COMMAND &&
+        read_16le(&tp.writes[i][6]) == clear_op)
+      cleared.push_back(read_32le(&tp.writes[i][12]));
+  CHECK(cleared == std::vector<uint32_t>{6});
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("BurstCapture follows wrapping ids and waits for a clear on BufferFull")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = 5000;
+  const auto snap_op = static_cast<uint16_t>(SigmaOp::SnapCommand);
+  const auto clear_op = static_cast<uint16_t>(SigmaOp::ClearImageDBSingle);
+  // the body holds a single frame, fewer than the burst's depth
+  uint8_t tail = 254;
+  size_t handled = 0, accepted = 0, refused = 0;
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetCamCaptStatus),
+                  [&](const std::vector<uint32_t> &p)
+                  {
+    if (!p.empty())
+    {
+      auto b = build_capt_status(CaptStatus::ImageGenCompleted);
+      b[1] = uint8_t(p[0]);
+      return b;
+    }
+    auto st = CaptStatus::ShootInProgress;
+    if (tp.command_count(snap_op) > handled)
+    {
+      ++handled;
+      if (accepted - tp.command_count(clear_op) >= 1)
+      {
+        st = CaptStatus::BufferFull;
+        ++refused;
+      }
+      else
+      {
+        tail = tail == 255 ? 1 : uint8_t(tail + 1); // 0 is never an image id
+        ++accepted;
+      }
+    }
+    auto b = build_capt_status(st);
+    b[1] = b[3] = tail;
+    return b; });
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetPictFileInfo2),
+                  [](const std::vector<uint32_t> &p)
+                  { return build_pict_file_info2(p.at(0) << 20, SIZE, ""); });
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile),
+                  [](const std::vector<uint32_t> &p)
+                  {
+    const uint32_t n = std::min(p.at(2), SIZE - p.at(1));
+    std::vector<uint8_t> b;
+    put_32le(b, n);
+    auto d = object_bytes(p.at(1), n);
+    b.insert(b.end(), d.begin(), d.end());
+    return b; });
+
+  const auto dir = std::filesystem::temp_directory_path() / "sigma_burst_wrap_test";
+  std::filesystem::remove_all(dir);
+  BurstOptions opt;
+  opt.frames = 3;
+  opt.depth = 2;
+  opt.clear_batch = 2;
+  opt.dir = dir.string();
+  opt.wait.wake_on_event = false;
+
+  BurstCapture burst(cam, opt);
+  const auto res = burst.run();
+
+  REQUIRE(res.frames.size() == 3);
+  CHECK(res.frames[0].image_id == 255);
+  CHECK(res.frames[1].image_id == 1);
+  CHECK(res.frames[2].image_id == 2);
+  CHECK(std::filesystem::file_size(res.frames[1].path) == SIZE);
+  // each refusal is followed by a clear, never by another snap into a full DB
+  CHECK(refused == 2);
+  CHECK(tp.command_count(snap_op) == 5);
+  CHECK(tp.command_count(clear_op) == 3);
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("get_object_vendor streams chunks to an fd and trims a short file")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = 50000;
+  uint32_t served = SIZE;
+  tp.respond_data(static_cast<uint16_t>(SigmaOp::GetPictFileInfo2),
+                  build_pict_file_info2(0x4000, SIZE, "SDIM0007.DNG"));
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile),
+                  [&](const std::vector<uint32_t> &p)
+                  {
+    const uint32_t n = std::min(p.at(2), served - std::min(served, p.at(1)));
+    std::vector<uint8_t> b;
+    put_32le(b, n);
+    auto d = object_bytes(p.at(1), n);
+    b.insert(b.end(), d.begin(), d.end());
+    return b; });
+
+  const auto path = (std::filesystem::temp_directory_path() / "sigma_vendor_fd.dng").string();
+  int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  REQUIRE(fd >= 0);
+  REQUIRE(cam.get_object_vendor(7, fd, 16 * 1024) == SIZE);
+  ::close(fd);
+  CHECK(tp.command_count(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile)) == 4);
+  std::vector<uint8_t> disk(SIZE);
+  FILE *f = std::fopen(path.c_str(), "rb");
+  REQUIRE(f);
+  REQUIRE(std::fread(disk.data(), 1, SIZE, f) == SIZE);
+  std::fclose(f);
+  CHECK(disk == object_bytes(0, SIZE));
+
+  // a longer file keeps what lies past the object
+  const std::vector<uint8_t> old_tail(30000, 0xEE);
+  fd = ::open(path.c_str(), O_RDWR | O_APPEND);
+  REQUIRE(fd >= 0);
+  REQUIRE(::write(fd, old_tail.data(), old_tail.size()) == ssize_t(old_tail.size()));
+  ::close(fd);
+  fd = ::open(path.c_str(), O_RDWR);
+  REQUIRE(fd >= 0);
+  REQUIRE(cam.get_object_vendor(7, fd, 16 * 1024) == SIZE);
+  ::close(fd);
+  CHECK(std::filesystem::file_size(path) == SIZE + old_tail.size());
+
+  // the body stops early: an error, and the preallocated tail must not survive
+  served = 20000;
+  fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  REQUIRE(fd >= 0);
+  CHECK_THROWS(cam.get_object_vendor(7, fd, 16 * 1024));
+  ::close(fd);
+  CHECK(std::filesystem::file_size(path) == served);
+  std::remove(path.c_str());
+
+  // the vector form is a VectorSink over the same loop
+  served = SIZE;
+  REQUIRE(cam.get_object_vendor(7) == object_bytes(0, SIZE));
+}
+
+TEST_CASE("big data phases reach the view intact across several reads")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr uint32_t SIZE = (3 << 19) + 123; // > 1 MiB first read, odd tail
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile),
+                  [](const std::vector<uint32_t> &p)
+                  {
+    std::vector<uint8_t> b;
+    put_32le(b, p.at(2));
+    auto d = object_bytes(p.at(1), p.at(2));
+    b.insert(b.end(), d.begin(), d.end());
+    return b; });
+
+  const auto part = cam.get_big_partial_pict_file_view(0x4000, 4096, SIZE);
+  REQUIRE(part.size() == SIZE);
+  CHECK(std::vector<uint8_t>(part.data(), part.data() + part.size()) ==
+        object_bytes(4096, SIZE));
+
+  // the container is handed over as read: header kept, no spare capacity
+  const auto r = cam.transact_in_place(static_cast<uint16_t>(SigmaOp::GetBigPartialPictFile),
+                                       {0x4000, 0, SIZE});
+  CHECK(r.data_offset == 12);
+  CHECK(r.data.size() == 12 + 4 + SIZE);
+  CHECK(r.data.capacity() < r.data.size() + 4096);
+  CHECK(read_32le(r.data.data() + r.data_offset) == SIZE);
+
+  // small payloads take the copying path
+  const auto small = cam.get_big_partial_pict_file_view(0x4000, 0, 100);
+  REQUIRE(small.size() == 100);
+  CHECK(small.data()[99] == object_bytes(0, 100)[99]);
+}
+
+// GetViewFrame payload: 10-byte header, then a minimal JPEG whose scan
+// carries `n`, so the test can tell frames apart
+static std::vector<uint8_t> build_view_frame(uint32_t n)
+{
+  std::vector<uint8_t> b(10, 0);
+  b.insert(b.end(), {0xFF, 0xD8,
+                     0xFF, 0xC0, 0x00, 0x0B, 8, 0x01, 0xE0, 0x02, 0x80, 1, 1, 0x11, 0,
+                     0xFF, 0xDA, 0x00, 0x08, 1, 1, 0x00, 0, 63, 0});
+  put_32le(b, n);
+  b.insert(b.end(), {0xFF, 0xD9});
+  return b;
+}
+
+TEST_CASE("LiveViewEngine hands the newest frame over and counts drops")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  uint32_t served = 0;
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetViewFrame),
+                  [&](const std::vector<uint32_t> &)
+                  { return build_view_frame(++served); });
+  auto frame_no = [](const LiveFrame *f)
+  { return read_32le(f->data() + f->info.scan_offset); };
+  auto fetched = [&](LiveViewEngine &lv, uint64_t n)
+  {
+    for (int i = 0; i < 400 && lv.stats().fetched < n; ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return lv.stats().fetched >= n;
+  };
+
+  LiveViewOptions opt;
+  opt.target_fps = 200;
+  {
+    LiveViewEngine lv(cam, opt);
+    REQUIRE(lv.acquire() == nullptr);
+    lv.start();
+    REQUIRE(fetched(lv, 10));
+    bool is_new = false;
+    const LiveFrame *f = lv.acquire(&is_new);
+    REQUIRE(f);
+    CHECK(is_new);
+    CHECK(f->seq >= 9);
+    CHECK(frame_no(f) == f->seq);
+    CHECK(f->info.width == 640);
+    CHECK(f->info.height == 480);
+    lv.stop();
+    const auto st = lv.stats();
+    CHECK(st.dropped >= 8); // nobody read them
+    CHECK(st.fps > 0);
+    CHECK(st.errors == 0);
+    // nothing newer after stop, once a frame published after the first
+    // acquire (fetched is counted before publishing) has been taken
+    lv.acquire();
+    lv.acquire(&is_new);
+    CHECK_FALSE(is_new);
+  }
+
+  opt.drop = LiveViewDrop::DropNewest;
+  LiveViewEngine lv(cam, opt);
+  lv.start();
+  REQUIRE(fetched(lv, 10));
+  lv.stop();
+  const LiveFrame *f = lv.acquire();
+  REQUIRE(f);
+  CHECK(f->seq == 1); // the first unread frame was kept
+  CHECK(lv.stats().published == 1);
+  CHECK(lv.stats().dropped == lv.stats().fetched - 1);
+}
+
+TEST_CASE("LiveViewEngine skips repeated and placeholder frames")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  uint32_t calls = 0;
+  // 1 1 1 7 2 2 7 3 3 ... where 7 is the body's "no image" frame
+  tp.respond_with(static_cast<uint16_t>(SigmaOp::GetViewFrame),
+                  [&](const std::vector<uint32_t> &)
+                  {
+    const uint32_t k = calls++;
+    return build_view_frame(k % 3 == 2 ? 7 : 1 + k / 3); });
+
+  const auto ph = build_view_frame(7);
+  LiveViewOptions opt;
+  opt.target_fps = 300;
+  opt.placeholders.push_back(jpeg_sniff(ph.data() + 10, ph.size() - 10).scan_hash);
+  LiveViewEngine lv(cam, opt);
+  lv.start();
+  for (int i = 0; i < 400 && lv.stats().published < 4; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  lv.stop();
+
+  const auto st = lv.stats();
+  REQUIRE(st.published >= 4);
+  CHECK(st.repeats >= 3);
+  CHECK(st.rejected >= 3);
+  CHECK(st.fetched == st.published + st.repeats + st.rejected);
+  const LiveFrame *f = lv.acquire();
+  REQUIRE(f);
+  CHECK(f->seq == st.published); // skipped frames take no sequence number
+  CHECK(read_32le(f->data() + f->info.scan_offset) == st.published);
+}
+
+TEST_CASE("CameraStateCache sends only what changed and serves fresh reads")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  const auto get1 = static_cast<uint16_t>(SigmaOp::GetCamDataGroup1);
+  const auto set1 = static_cast<uint16_t>(SigmaOp::SetCamDataGroup1);
+  CamDataGroup1 body;
+  body.shutterSpeed = 0x20;
+  body.aperture = 0x30;
+  tp.respond_data(get1, body.encode());
+
+  CameraStateCache cache(cam, std::chrono::milliseconds(200));
+  CHECK(*cache.get<CamDataGroup1>().aperture == 0x30);
+  CHECK(*cache.get<CamDataGroup1>().aperture == 0x30);
+  CHECK(tp.command_count(get1) == 1);
+
+  // same values: no transaction at all
+  CamDataGroup1 want;
+  want.shutterSpeed = 0x20;
+  want.aperture = 0x30;
+  REQUIRE(cache.set(want).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set1) == 0);
+
+  // one field changed: only that one goes out
+  want.aperture = 0x38;
+  const size_t mark = tp.writes.size();
+  REQUIRE(cache.set(want).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set1) == 1);
+  CamDataGroup1 only;
+  only.aperture = 0x38;
+  const auto payload = only.encode();
+  bool sent = false;
+  for (size_t i = mark; i + 1 < tp.writes.size(); ++i)
+    if (read_16le(&tp.writes[i][6]) == set1 &&
+        read_16le(&tp.writes[i][4]) == PTP_CONTAINER_COMMAND)
+      sent = std::vector<uint8_t>(tp.writes[i + 1].begin() + 12, tp.writes[i + 1].end()) == payload;
+  CHECK(sent);
+  CHECK(*cache.cached<CamDataGroup1>()->aperture == 0x38);
+  // the body may have fitted 0x38 to the lens: a repeat goes out in full
+  REQUIRE(cache.set(want).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set1) == 2);
+
+  // a refused write forgets the group, so the next set sends everything
+  tp.fail_next(set1, PTP_RESP_InvalidParameter);
+  want.shutterSpeed = 0x28;
+  CHECK(cache.set(want).response_code == PTP_RESP_InvalidParameter);
+  CHECK_FALSE(cache.cached<CamDataGroup1>());
+  REQUIRE(cache.set(want).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set1) == 4);
+
+  // writes don't make the mirror fresh: reads go to the body again
+  cache.get<CamDataGroup1>();
+  CHECK(tp.command_count(get1) == 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  cache.get<CamDataGroup1>();
+  CHECK(tp.command_count(get1) == 3);
+
+  // an old mirror proves nothing (a dial may have turned): all of it goes out
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  const size_t mark2 = tp.writes.size();
+  REQUIRE(cache.set(want).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set1) == 5);
+  const auto full = want.encode();
+  sent = false;
+  for (size_t i = mark2; i + 1 < tp.writes.size(); ++i)
+    if (read_16le(&tp.writes[i][6]) == set1 &&
+        read_16le(&tp.writes[i][4]) == PTP_CONTAINER_COMMAND)
+      sent = std::vector<uint8_t>(tp.writes[i + 1].begin() + 12, tp.writes[i + 1].end()) == full;
+  CHECK(sent);
+
+  const auto st = cache.stats();
+  CHECK(st.reads == 3);
+  CHECK(st.read_hits == 1);
+  CHECK(st.writes == 5);
+  CHECK(st.writes_skipped == 1);
+
+  // the body can't clamp Group2 values: a write keeps the mirror usable
+  const auto get2 = static_cast<uint16_t>(SigmaOp::GetCamDataGroup2);
+  const auto set2 = static_cast<uint16_t>(SigmaOp::SetCamDataGroup2);
+  CamDataGroup2 body2;
+  body2.exposureMode = ExposureMode::Manual;
+  tp.respond_data(get2, body2.encode());
+  cache.get<CamDataGroup2>();
+  CamDataGroup2 want2;
+  want2.exposureMode = ExposureMode::ProgramAuto;
+  REQUIRE(cache.set(want2).response_code == PTP_RESP_OK);
+  REQUIRE(cache.set(want2).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set2) == 1);
+  CHECK(tp.command_count(get2) == 1);
+}
+
+TEST_CASE("CameraProfile applies groups in dependency order and reads back clampable ones")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  constexpr auto op = [](SigmaOp o)
+  { return static_cast<uint16_t>(o); };
+  tp.respond_data(op(SigmaOp::ConfigApi), build_api_config("fp", "01.00"));
+  cam.open_session(7);
+  cam.config_api();
+
+  CamDataGroup1 g1;
+  g1.shutterSpeed = 0x20;
+  g1.isoSpeed = 0x10;
+  CamDataGroup2 g2;
+  g2.exposureMode = ExposureMode::Manual;
+  CamDataGroup4 g4;
+  g4.hdr = static_cast<HDR>(1);
+  CameraProfile profile;
+  profile.set(g1).set(g4).set(g2);
+  profile.set(CamDataGroup5{}); // nothing settable: no Set*
+  REQUIRE(profile.transactions() == 3);
+
+  // the body lifts ISO to its floor
+  CamDataGroup1 body = g1;
+  body.isoSpeed = 0x18;
+  tp.respond_data(op(SigmaOp::GetCamDataGroup1), body.encode());
+
+  size_t mark = tp.writes.size();
+  ProfileApplyResult r = profile.apply(cam);
+  CHECK(r.ok());
+  CHECK(r.sent == 3);
+  REQUIRE(r.clamped == std::vector<uint16_t>{op(SigmaOp::SetCamDataGroup1)});
+  CHECK(commands_since(tp, mark) ==
+        std::vector<uint16_t>{op(SigmaOp::SetCamDataGroup2), op(SigmaOp::SetCamDataGroup1),
+                              op(SigmaOp::SetCamDataGroup4), op(SigmaOp::GetCamDataGroup1)});
+
+  // same payloads again; a refused Group2 stops the rest
+  tp.respond_data(op(SigmaOp::GetCamDataGroup1), g1.encode());
+  tp.fail_next(op(SigmaOp::SetCamDataGroup2), PTP_RESP_InvalidParameter);
+  mark = tp.writes.size();
+  r = profile.apply(cam);
+  CHECK_FALSE(r.ok());
+  CHECK(r.sent == 1);
+  REQUIRE(r.refused.size() == 1);
+  CHECK(r.refused[0].response_code == PTP_RESP_InvalidParameter);
+  CHECK(commands_since(tp, mark) == std::vector<uint16_t>{op(SigmaOp::SetCamDataGroup2)});
+
+  r = profile.apply(cam);
+  CHECK(r.ok());
+  CHECK(r.clamped.empty());
+
+  // session recovery re-applies what the profile set
+  mark = tp.writes.size();
+  cam.recover_session();
+  const auto after = commands_since(tp, mark);
+  CHECK(std::count(after.begin(), after.end(), op(SigmaOp::SetCamDataGroup4)) == 1);
+}
+
+TEST_CASE("CanSetValidator rejects or clamps locally from one cached GetCamCanSetInfo5")
+{
+  FakeTransport tp;
+  SigmaCamera cam(tp);
+  const auto info_op = static_cast<uint16_t>(SigmaOp::GetCamCanSetInfo5);
+  const auto set1 = static_cast<uint16_t>(SigmaOp::SetCamDataGroup1);
+  // tag 0x01: shutter codes 0x10..0x28 step 8; tag 0x02: apertures 0x20, 0x30;
+  // tag 0x03: exposure compensation -1.0..+0.5 EV as signed codes
+  std::vector<uint8_t> b;
+  put_32le(b, 0);
+  put_32le(b, 3);
+  put_16le(b, 0x01);
+  put_16le(b, static_cast<uint16_t>(DirectoryType::UInt8));
+  put_32le(b, 4);
+  put_32le(b, 0x28201810);
+  put_16le(b, 0x02);
+  put_16le(b, static_cast<uint16_t>(DirectoryType::UInt8));
+  put_32le(b, 2);
+  put_32le(b, 0x00003020);
+  put_16le(b, 0x03);
+  put_16le(b, static_cast<uint16_t>(DirectoryType::Int8));
+  put_32le(b, 4);
+  put_32le(b, 0x0400FCF8); // -8 -4 0 4
+  tp.respond_data(info_op, b);
+
+  CanSetValidator v(cam);
+  v.bind(CanSetField::ShutterSpeed, 0x01);
+  v.bind(CanSetField::Aperture, 0x02);
+
+  CamDataGroup1 g;
+  g.shutterSpeed = 0x18;
+  g.aperture = 0x30;
+  g.isoSpeed = 0x77; // unbound: not checked
+  CHECK(v.check(g).ok());
+
+  g.shutterSpeed = 0x1B;
+  g.aperture = 0x31;
+  CHECK_THROWS(v.set(g));
+  CHECK(tp.command_count(set1) == 0); // nothing went to the body
+
+  CanSetVerdict r = v.check(g, CanSetAction::Clamp);
+  CHECK(r.ok());
+  CHECK(r.clamped.size() == 2);
+  CHECK(*g.shutterSpeed == 0x18); // nearest code
+  CHECK(*g.aperture == 0x30);
+  g.shutterSpeed = 0x40;
+  v.check(g, CanSetAction::Clamp);
+  CHECK(*g.shutterSpeed == 0x28);
+  CHECK(tp.command_count(info_op) == 1);
+
+  REQUIRE(v.set(g).response_code == PTP_RESP_OK);
+  CHECK(tp.command_count(set1) == 1);
+
+  // negative compensation is a valid code, and clamps by EV, not by byte
+  v.bind(CanSetField::ExpComp, 0x03);
+  CamDataGroup1 comp;
+  comp.expComp = 248; // -1.0 EV
+  CHECK(v.check(comp).ok());
+  comp.expComp = 240; // -2.0 EV
+  v.check(comp, CanSetAction::Clamp);
+  CHECK(*comp.expComp == 248);
+  comp.expComp = 16; // +2.0 EV
+  v.check(comp, CanSetAction::Clamp);
+  CHECK(*comp.expComp == 4);
+  comp.expComp = 251; // -0.7 EV
+  v.check(comp, CanSetAction::Clamp);
+  CHECK(*comp.expComp == 252);
+  v.unbind(CanSetField::ExpComp);
+
+  // an unlisted mode is never swapped for a neighbouring code
+  v.bind(CanSetField::DriveMode, 0x02);
+  CamDataGroup2 drive;
+  drive.driveMode = static_cast<DriveMode>(0x31);
+  r = v.check(drive, CanSetAction::Clamp);
+  CHECK_FALSE(r.ok());
+  CHECK(r.clamped.empty());
+  CHECK(static_cast<int>(*drive.driveMode) == 0x31);
+  v.unbind(CanSetField::DriveMode);
+
+  // a new exposure mode refetches the limits
+  CamDataGroup2 mode;
+  mode.exposureMode = ExposureMode::Manual;
+  REQUIRE(v.set(mode).response_code == PTP_RESP_OK);
+  v.check(g);
+  CHECK(tp.command_count(info_op) == 2);
+}
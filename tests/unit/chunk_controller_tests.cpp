@@ -0,0 +1,57 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_version_macros.hpp>
+
+static_assert(CATCH_VERSION_MAJOR >= 3, "Catch2 v3 required");
+
+#include <algorithm>
+#include <chrono>
+#include <utils/chunk_controller.h>
+
+using namespace std::chrono;
+
+// 2 ms per request plus 40 MB/s on the wire
+static nanoseconds simulated(std::uint32_t bytes)
+{
+  return milliseconds(2) + nanoseconds(std::uint64_t(bytes) * 25);
+}
+
+TEST_CASE("ChunkController grows to the latency target and saws below it")
+{
+  ChunkPolicy p;
+  p.latency_target = milliseconds(100);
+  ChunkController c(p);
+  REQUIRE(c.next() == p.start_bytes);
+
+  std::uint32_t biggest = 0;
+  for (int i = 0; i < 60; ++i)
+  {
+    const std::uint32_t n = c.next();
+    CHECK(n % 4096 == 0);
+    CHECK(n >= p.min_bytes);
+    CHECK(n <= p.max_bytes);
+    biggest = std::max(biggest, n);
+    c.record(n, n, simulated(n));
+  }
+  // ~3.9 MB fits in 100 ms; one chunk may overshoot before the cut
+  CHECK(biggest > 2 * 1024 * 1024);
+  CHECK(biggest < 8 * 1024 * 1024);
+  CHECK(c.bytes_per_sec() > 30e6);
+}
+
+TEST_CASE("ChunkController backs off on a slow chunk and ignores tails")
+{
+  ChunkPolicy p;
+  p.start_bytes = 4 * 1024 * 1024;
+  ChunkController c(p);
+
+  c.record(c.next(), 1000, nanoseconds(0)); // nothing measured
+  REQUIRE(c.next() == 4 * 1024 * 1024);
+  c.record(4096, 4096, microseconds(100)); // short tail of a file
+  REQUIRE(c.next() == 4 * 1024 * 1024);
+
+  c.record(c.next(), c.next(), seconds(1));
+  REQUIRE(c.next() == 2 * 1024 * 1024);
+  for (int i = 0; i < 20; ++i)
+    c.record(c.next(), c.next(), seconds(1));
+  REQUIRE(c.next() == p.min_bytes);
+}
@@ -0,0 +1,210 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_version_macros.hpp>
+
+static_assert(CATCH_VERSION_MAJOR >= 3, "Catch2 v3 required");
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utils/jpeg.h>
+#include <utils/jpeg_decode.h>
+
+#if PTP_SIGMA_HAVE_JPEG
+#include <cstdio>
+#include <cstdlib>
+#include <jpeglib.h>
+
+// Real baseline JPEG: horizontal red ramp, green constant, blue = frame tag.
+static std::vector<std::uint8_t> encode_jpeg(int w, int h, std::uint8_t tag)
+{
+  jpeg_compress_struct c;
+  jpeg_error_mgr err;
+  c.err = jpeg_std_error(&err);
+  jpeg_create_compress(&c);
+  unsigned char *buf = nullptr;
+  unsigned long len = 0;
+  jpeg_mem_dest(&c, &buf, &len);
+  c.image_width = w;
+  c.image_height = h;
+  c.input_components = 3;
+  c.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&c);
+  jpeg_set_quality(&c, 95, TRUE);
+  jpeg_start_compress(&c, TRUE);
+  std::vector<std::uint8_t> row(std::size_t(w) * 3);
+  for (int x = 0; x < w; ++x)
+  {
+    row[x * 3] = std::uint8_t(x * 255 / (w - 1));
+    row[x * 3 + 1] = 128;
+    row[x * 3 + 2] = tag;
+  }
+  while (c.next_scanline < c.image_height)
+  {
+    JSAMPROW r = row.data();
+    jpeg_write_scanlines(&c, &r, 1);
+  }
+  jpeg_finish_compress(&c);
+  jpeg_destroy_compress(&c);
+  std::vector<std::uint8_t> out(buf, buf + len);
+  std::free(buf);
+  return out;
+}
+#endif
+
+// SOI, APP0 stub, SOF0, SOS, scan, EOI
+static std::vector<std::uint8_t> tiny_jpeg(std::uint16_t w, std::uint16_t h,
+                                           const std::vector<std::uint8_t> &scan)
+{
+  std::vector<std::uint8_t> b{0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x04, 'J', 'F'};
+  b.insert(b.end(), {0xFF, 0xC0, 0x00, 0x0B, 8, std::uint8_t(h >> 8), std::uint8_t(h),
+                     std::uint8_t(w >> 8), std::uint8_t(w), 1, 1, 0x11, 0});
+  b.insert(b.end(), {0xFF, 0xDA, 0x00, 0x08, 1, 1, 0x00, 0, 63, 0});
+  b.insert(b.end(), scan.begin(), scan.end());
+  b.insert(b.end(), {0xFF, 0xD9});
+  return b;
+}
+
+TEST_CASE("hash64 matches the XXH64 reference")
+{
+  std::vector<std::uint8_t> seq(100);
+  for (int i = 0; i < 100; ++i)
+    seq[i] = std::uint8_t(i);
+  CHECK(hash64("", 0) == 0xEF46DB3751D8E999ull);
+  CHECK(hash64("abc", 3) == 0x44BC2CF5AD770999ull);
+  CHECK(hash64(seq.data(), seq.size()) == 0x6AC1E58032166597ull);
+  CHECK(hash64(seq.data(), seq.size(), 7) == 0x80653E7E9B887CDDull);
+}
+
+TEST_CASE("jpeg_sniff reads dimensions and bounds the scan")
+{
+  const std::vector<std::uint8_t> scan{0x12, 0xFF, 0x00, 0x34, 0xFF, 0xD3, 0x56};
+  auto j = tiny_jpeg(640, 426, scan);
+  j.insert(j.end(), {0, 0, 0}); // padding after EOI
+
+  const JpegInfo info = jpeg_sniff(j.data(), j.size());
+  REQUIRE(info.valid);
+  CHECK(info.width == 640);
+  CHECK(info.height == 426);
+  CHECK(info.components == 1);
+  CHECK(info.scan_size == scan.size());
+  CHECK(info.scan_hash == hash64(scan.data(), scan.size()));
+
+  auto cut = j;
+  cut.resize(cut.size() - 6); // EOI lost
+  CHECK_FALSE(jpeg_sniff(cut.data(), cut.size()).valid);
+  CHECK_FALSE(jpeg_sniff(j.data() + 2, j.size() - 2).valid); // no SOI
+  std::vector<std::uint8_t> no_sof{0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02, 0x11, 0xFF, 0xD9};
+  CHECK_FALSE(jpeg_sniff(no_sof.data(), no_sof.size()).valid);
+}
+
+TEST_CASE("FrameFilter flags repeats, placeholders and broken frames")
+{
+  const auto a = tiny_jpeg(8, 8, {1, 2, 3});
+  const auto b = tiny_jpeg(8, 8, {4, 5, 6});
+  const auto none = tiny_jpeg(8, 8, {9, 9});
+  FrameFilter f;
+  f.add_placeholder(jpeg_sniff(none.data(), none.size()).scan_hash);
+
+  CHECK(f.classify(jpeg_sniff(a.data(), a.size())) == FrameFilter::Fresh);
+  CHECK(f.classify(jpeg_sniff(a.data(), a.size())) == FrameFilter::Duplicate);
+  CHECK(f.classify(jpeg_sniff(none.data(), none.size())) == FrameFilter::Placeholder);
+  CHECK(f.classify(jpeg_sniff(a.data(), a.size())) == FrameFilter::Duplicate);
+  CHECK(f.classify(jpeg_sniff(b.data(), b.size())) == FrameFilter::Fresh);
+  CHECK(f.classify(jpeg_sniff(b.data(), 5)) == FrameFilter::Invalid);
+}
+
+#if PTP_SIGMA_HAVE_JPEG
+TEST_CASE("JpegDecodePool::decode scales in the DCT domain")
+{
+  const auto j = encode_jpeg(320, 240, 200);
+  RgbImage img;
+  const struct
+  {
+    JpegScale scale;
+    std::uint32_t w, h;
+  } cases[] = {{JpegScale::Full, 320, 240},
+               {JpegScale::Half, 160, 120},
+               {JpegScale::Quarter, 80, 60},
+               {JpegScale::Eighth, 40, 30}};
+  for (const auto &c : cases)
+  {
+    REQUIRE(JpegDecodePool::decode(j.data(), j.size(), c.scale, img));
+    CHECK(img.width == c.w);
+    CHECK(img.height == c.h);
+    REQUIRE(img.rgb.size() == std::size_t(c.w) * c.h * 3);
+    const std::uint8_t *mid = &img.rgb[(c.h / 2 * c.w + c.w / 2) * 3];
+    CHECK(std::abs(int(mid[1]) - 128) < 8);
+    CHECK(std::abs(int(mid[2]) - 200) < 8);
+  }
+
+  const std::uint8_t *before = img.rgb.data();
+  REQUIRE(JpegDecodePool::decode(j.data(), j.size(), JpegScale::Quarter, img));
+  CHECK(img.rgb.data() == before); // smaller output reuses the buffer
+
+  auto cut = j;
+  cut.resize(cut.size() / 3);
+  cut[0] = 0x00; // no SOI
+  CHECK_FALSE(JpegDecodePool::decode(cut.data(), cut.size(), JpegScale::Full, img));
+  CHECK_FALSE(img.error.empty());
+}
+
+TEST_CASE("JpegDecodePool returns images in submission order and recycles them")
+{
+  JpegDecodeOptions opt;
+  opt.workers = 3;
+  opt.max_pending = 8;
+  opt.scale = JpegScale::Half;
+  JpegDecodePool pool(opt);
+
+  std::vector<std::vector<std::uint8_t>> frames;
+  for (int i = 0; i < 8; ++i)
+    // bigger frames first, so later ones tend to finish earlier
+    frames.push_back(encode_jpeg(640 - i * 64, 480 - i * 48, std::uint8_t(i * 30)));
+  frames[5] = {0xFF, 0xD8, 0x00};
+
+  for (int i = 0; i < 8; ++i)
+    CHECK(pool.submit(frames[i].data(), frames[i].size(), 100 + i) == std::uint64_t(i + 1));
+  CHECK(pool.submit(frames[0].data(), frames[0].size()) == 0); // backlog full
+  CHECK(pool.pending() == 8);
+
+  for (int i = 0; i < 8; ++i)
+  {
+    RgbImagePtr img = pool.next(std::chrono::seconds(5));
+    REQUIRE(img);
+    CHECK(img->order == std::uint64_t(i + 1));
+    CHECK(img->tag == std::uint64_t(100 + i));
+    if (i == 5)
+    {
+      CHECK_FALSE(img->ok);
+      continue;
+    }
+    REQUIRE(img->ok);
+    CHECK(img->width == std::uint32_t(320 - i * 32));
+    CHECK(std::abs(int(img->rgb[2]) - i * 30) < 8);
+  }
+  CHECK(pool.pending() == 0);
+  CHECK_FALSE(pool.next());
+
+  // a released image is handed out again
+  const RgbImage *first = nullptr;
+  for (int round = 0; round < 2; ++round)
+  {
+    REQUIRE(pool.submit(frames[7].data(), frames[7].size()) != 0);
+    RgbImagePtr img = pool.next(std::chrono::seconds(5));
+    REQUIRE(img);
+    if (round == 0)
+      first = img.get();
+    else
+      CHECK(img.get() == first);
+  }
+}
+#else
+TEST_CASE("JpegDecodePool is unavailable without libjpeg-turbo")
+{
+  CHECK_FALSE(JpegDecodePool::available());
+  CHECK_THROWS(JpegDecodePool{});
+  RgbImage img;
+  const std::uint8_t j[] = {0xFF, 0xD8, 0xFF, 0xD9};
+  CHECK_FALSE(JpegDecodePool::decode(j, sizeof j, JpegScale::Half, img));
+}
+#endif
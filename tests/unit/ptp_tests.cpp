@@ -0,0 +1,188 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_version_macros.hpp>
+
+static_assert(CATCH_VERSION_MAJOR >= 3, "Catch2 v3 required");
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ptp/device_info.h>
+#include <ptp/device_prop.h>
+#include <utils/utils.h>
+
+static void put_u16_array(std::vector<std::uint8_t> &b,
+                          const std::vector<std::uint16_t> &v)
+{
+  put_32le(b, std::uint32_t(v.size()));
+  for (auto x : v)
+    put_16le(b, x);
+}
+
+static std::vector<std::uint8_t> sample_device_info()
+{
+  std::vector<std::uint8_t> b;
+  put_16le(b, 100);       // StandardVersion
+  put_32le(b, 0x00000006); // VendorExtensionID
+  put_16le(b, 100);
+  put_ptp_str(b, "sigma.com: 1.0");
+  put_16le(b, 0);                                // FunctionalMode
+  put_u16_array(b, {0x1001, 0x1002, 0x101B, 0x9015, 0x9035}); // operations
+  put_u16_array(b, {0x4002, 0xC001});            // events
+  put_u16_array(b, {0x5001, 0xD001});            // properties
+  put_u16_array(b, {});                          // capture formats
+  put_u16_array(b, {0x3801, 0x3000});            // image formats
+  put_ptp_str(b, "SIGMA");
+  put_ptp_str(b, "fp");
+  put_ptp_str(b, "01.00");
+  put_ptp_str(b, "1234567");
+  return b;
+}
+
+TEST_CASE("DeviceInfo: decode strings and arrays")
+{
+  DeviceInfo di;
+  di.decode(sample_device_info());
+
+  CHECK(di.StandardVersion == 100);
+  CHECK(di.VendorExtensionDesc == "sigma.com: 1.0");
+  CHECK(di.OperationsSupported.size() == 5);
+  CHECK(di.ImageFormats.size() == 2);
+  CHECK(di.CaptureFormats.empty());
+  CHECK(di.Manufacturer == "SIGMA");
+  CHECK(di.Model == "fp");
+  CHECK(di.DeviceVersion == "01.00");
+  CHECK(di.SerialNumber == "1234567");
+}
+
+TEST_CASE("DeviceInfo: capability bitsets cover standard and vendor pages")
+{
+  DeviceInfo di;
+  di.decode(sample_device_info());
+
+  CHECK(di.supports_operation(0x1001));
+  CHECK(di.supports_operation(0x101B));
+  CHECK(di.supports_operation(0x9035));
+  CHECK_FALSE(di.supports_operation(0x1009));
+  CHECK_FALSE(di.supports_operation(0x9030));
+  CHECK_FALSE(di.supports_operation(0x2001)); // outside both pages
+
+  CHECK(di.supports_event(0x4002));
+  CHECK(di.supports_event(0xC001));
+  CHECK_FALSE(di.supports_event(0x4006));
+
+  CHECK(di.supports_property(0x5001));
+  CHECK(di.supports_property(0xD001));
+  CHECK_FALSE(di.supports_property(0x5002));
+}
+
+TEST_CASE("DeviceInfo: truncated dataset throws")
+{
+  auto raw = sample_device_info();
+  raw.resize(20);
+  DeviceInfo di;
+  CHECK_THROWS(di.decode(raw));
+}
+
+TEST_CASE("DeviceInfoCache: key is filesystem safe")
+{
+  CHECK(DeviceInfoCache::make_key("SIGMA fp", "01.00/x", "9300 1") == "SIGMA_fp_01.00_x_9300_1");
+}
+
+static std::vector<std::uint8_t> desc_header(std::uint16_t code, std::uint16_t type,
+                                             std::uint8_t getset)
+{
+  std::vector<std::uint8_t> b;
+  put_16le(b, code);
+  put_16le(b, type);
+  put_8(b, getset);
+  return b;
+}
+
+TEST_CASE("DevicePropDesc: UINT16 range form")
+{
+  auto raw = desc_header(0x5001, PTP_DTC_UINT16, 1);
+  put_16le(raw, 100); // default
+  put_16le(raw, 200); // current
+  put_8(raw, DevicePropDesc::FormRange);
+  put_16le(raw, 100);
+  put_16le(raw, 1000);
+  put_16le(raw, 50);
+
+  DevicePropDesc d;
+  d.decode(raw);
+  CHECK(d.PropertyCode == 0x5001);
+  CHECK(d.writable());
+  CHECK(d.CurrentValue.as_uint() == 200);
+  CHECK(d.RangeMax.as_uint() == 1000);
+
+  CHECK(d.accepts(PropValue::of_uint(PTP_DTC_UINT16, 150)));
+  CHECK_FALSE(d.accepts(PropValue::of_uint(PTP_DTC_UINT16, 160)));  // off step
+  CHECK_FALSE(d.accepts(PropValue::of_uint(PTP_DTC_UINT16, 1050))); // above max
+  CHECK_FALSE(d.accepts(PropValue::of_uint(PTP_DTC_UINT32, 150)));  // wrong type
+}
+
+TEST_CASE("DevicePropDesc: signed enumeration form")
+{
+  auto raw = desc_header(0x5010, PTP_DTC_INT8, 1);
+  put_8(raw, 0);
+  put_8(raw, 0xFD); // -3
+  put_8(raw, DevicePropDesc::FormEnum);
+  put_16le(raw, 3);
+  put_8(raw, 0xFD);
+  put_8(raw, 0);
+  put_8(raw, 3);
+
+  DevicePropDesc d;
+  d.decode(raw);
+  REQUIRE(d.Enumeration.size() == 3);
+  CHECK(d.CurrentValue.as_int() == -3);
+  CHECK(d.Enumeration[0].less(d.Enumeration[1]));
+  CHECK(d.accepts(PropValue::of_int(PTP_DTC_INT8, -3)));
+  CHECK_FALSE(d.accepts(PropValue::of_int(PTP_DTC_INT8, 1)));
+  CHECK(PropValue::of_int(PTP_DTC_INT8, -3).encode() == std::vector<std::uint8_t>{0xFD});
+}
+
+TEST_CASE("DevicePropDesc: string, array and 128-bit values")
+{
+  auto raw = desc_header(0xD100, PTP_DTC_STR, 0);
+  put_ptp_str(raw, "");
+  put_ptp_str(raw, "fp L");
+  put_8(raw, DevicePropDesc::FormNone);
+  DevicePropDesc s;
+  s.decode(raw);
+  CHECK_FALSE(s.writable());
+  CHECK(s.CurrentValue.Str == "fp L");
+  CHECK(s.CurrentValue.encode().size() == 1 + 5 * 2);
+
+  raw = desc_header(0xD101, PTP_DTC_ARRAY | PTP_DTC_UINT16, 1);
+  put_u16_array(raw, {});
+  put_u16_array(raw, {1, 2, 0xFFFF});
+  put_8(raw, DevicePropDesc::FormNone);
+  DevicePropDesc a;
+  a.decode(raw);
+  REQUIRE(a.CurrentValue.Elements.size() == 3);
+  CHECK(a.CurrentValue.Elements[2].as_uint() == 0xFFFF);
+
+  raw = desc_header(0xD102, PTP_DTC_INT128, 1);
+  for (int k = 0; k < 16; ++k)
+    put_8(raw, 0);
+  for (int k = 0; k < 16; ++k)
+    put_8(raw, k < 8 ? 0x11 : 0xFF); // negative
+  put_8(raw, DevicePropDesc::FormNone);
+  DevicePropDesc w;
+  w.decode(raw);
+  CHECK(w.CurrentValue.Bits == 0x1111111111111111ull);
+  CHECK(w.CurrentValue.High == ~0ull);
+  CHECK(w.CurrentValue.less(w.FactoryDefaultValue));
+  std::vector<std::uint8_t> back;
+  w.CurrentValue.encode(back);
+  CHECK(back == std::vector<std::uint8_t>(raw.end() - 17, raw.end() - 1));
+}
+
+TEST_CASE("DevicePropDesc: truncated value throws")
+{
+  auto raw = desc_header(0x5001, PTP_DTC_UINT32, 1);
+  put_16le(raw, 1);
+  DevicePropDesc d;
+  CHECK_THROWS(d.decode(raw));
+}
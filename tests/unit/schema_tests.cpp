@@ -261,6 +261,91 @@ TEST_CASE("CamDataGroup5: roundtrip with interval")
 }
 
 // -------- SnapCommand --------
+TEST_CASE("CamDataGroup merge: later fields win, LOC and interval stay whole")
+{
+  CamDataGroup4 a;
+  a.hdr = static_cast<HDR>(1);
+  a.locDistortion = static_cast<LOCDistortion>(1);
+  a.locVignetting = static_cast<LOCVignetting>(1);
+  CamDataGroup4 b;
+  b.locDiffraction = static_cast<LOCDiffraction>(1);
+  a.merge(b);
+  REQUIRE(a.hdr.has_value());
+  CHECK(*a.locDiffraction == static_cast<LOCDiffraction>(1));
+  // b sent the block with the other entries Off
+  CHECK(*a.locDistortion == LOCDistortion::Off);
+  CHECK(*a.locVignetting == LOCVignetting::Off);
+
+  CamDataGroup5 c;
+  c.intervalTimerSecond = 10;
+  c.intervalTimerFrame = 5;
+  CamDataGroup5 d;
+  d.intervalTimerFrame = 9; // half a pair: never sent, never merged
+  d.colorTemp = 5500;
+  c.merge(d);
+  CHECK(*c.intervalTimerFrame == 5);
+  CHECK(*c.colorTemp == 5500);
+
+  CamDataGroup1 e;
+  e.shutterSpeed = 0x20;
+  CamDataGroup1 f;
+  f.batteryState = 3; // read-only
+  f.shutterSpeed = 0x28;
+  e.merge(f);
+  CHECK(*e.shutterSpeed == 0x28);
+  CHECK_FALSE(e.batteryState.has_value());
+}
+
+TEST_CASE("CamDataGroup diff: only changed fields, LOC and interval stay whole")
+{
+  CamDataGroup1 known;
+  known.shutterSpeed = 0x20;
+  known.aperture = 0x30;
+  known.batteryState = 3;
+  CamDataGroup1 want;
+  want.shutterSpeed = 0x20;
+  want.aperture = 0x38;
+  want.isoSpeed = 0x10; // unknown on the body side: sent
+  auto d1 = want.diff(known);
+  REQUIRE(d1);
+  CHECK_FALSE(d1->shutterSpeed.has_value());
+  CHECK(*d1->aperture == 0x38);
+  CHECK(*d1->isoSpeed == 0x10);
+  known.merge(*d1);
+  CHECK_FALSE(want.diff(known));
+
+  CamDataGroup4 k4;
+  k4.locDistortion = static_cast<LOCDistortion>(1);
+  k4.merge(k4); // whole block, others Off
+  CamDataGroup4 w4;
+  w4.locDistortion = static_cast<LOCDistortion>(1);
+  CHECK_FALSE(w4.diff(k4)); // sends the same block
+  w4.locVignetting = static_cast<LOCVignetting>(1);
+  auto d4 = w4.diff(k4);
+  REQUIRE(d4);
+  CHECK(*d4->locDistortion == static_cast<LOCDistortion>(1));
+  CHECK(*d4->locVignetting == static_cast<LOCVignetting>(1));
+  CHECK(*d4->locColorShade == LOCColorShade::Off);
+
+  CamDataGroup5 k5;
+  k5.intervalTimerSecond = 10;
+  k5.intervalTimerFrame = 5;
+  CamDataGroup5 w5 = k5;
+  w5.intervalTimerFrame = 6;
+  auto d5 = w5.diff(k5);
+  REQUIRE(d5);
+  CHECK(*d5->intervalTimerSecond == 10); // the unchanged half goes too
+  CHECK(*d5->intervalTimerFrame == 6);
+  CHECK_FALSE(d5->colorTemp.has_value());
+
+  CamDataGroupFocus kf;
+  kf.dmfPos = std::vector<uint8_t>{1, 2};
+  CamDataGroupFocus wf = kf;
+  CHECK_FALSE(wf.diff(kf));
+  wf.dmfPos = std::vector<uint8_t>{1, 3};
+  REQUIRE(wf.diff(kf));
+}
+
 TEST_CASE("SnapCommand: exact bytes")
 {
   SnapCommand s; // defaults: Mode=GeneralCapt, Amount=1
@@ -350,3 +435,80 @@ TEST_CASE("CamCaptStatus: decode fields")
   CHECK(static_cast<int>(s.Status) == 0x1234);
   CHECK(static_cast<int>(s.Dest) == 0x03);
 }
+
+TEST_CASE("Views decode in place, without copying the payload")
+{
+  std::vector<std::uint8_t> raw{0x05, 0x00, 0x00, 0x00, 1, 2, 3, 4, 5, 0xEE};
+  BigPartialPictFile copy;
+  copy.decode(raw);
+  const std::uint8_t *at = raw.data();
+
+  BigPartialPictFileView part;
+  part.decode(std::move(raw));
+  REQUIRE(part.AcquiredSize == 5);
+  REQUIRE(part.size() == 5); // trailing byte past AcquiredSize is not data
+  CHECK(part.data() == at + 4);
+  CHECK(std::vector<std::uint8_t>(part.data(), part.data() + part.size()) == copy.PartialData);
+
+  std::vector<std::uint8_t> frame(10, 0);
+  frame.insert(frame.end(), {0xFF, 0xD8, 0xFF, 0xD9});
+  at = frame.data();
+  ViewFrameView view;
+  view.decode(std::move(frame));
+  REQUIRE(view.size() == 4);
+  CHECK(view.data() == at + 10);
+  CHECK(view.data()[1] == 0xD8);
+
+  CHECK_THROWS(view.decode(std::vector<std::uint8_t>(9)));
+
+  // behind a kept 12-byte container header
+  std::vector<std::uint8_t> framed(12, 0xAA);
+  framed.insert(framed.end(), {0x02, 0x00, 0x00, 0x00, 7, 8});
+  at = framed.data();
+  part.decode(std::move(framed), 12);
+  REQUIRE(part.AcquiredSize == 2);
+  CHECK(part.data() == at + 16);
+  CHECK(part.data()[1] == 8);
+  CHECK_THROWS(view.decode(std::vector<std::uint8_t>(21), 12));
+}
+
+// -------- CamCanSetInfo5 --------
+TEST_CASE("CamCanSetInfo5: directory entries inline and by offset")
+{
+  // 3 entries: UInt8 x3 inline, UInt16 x4 at an offset, String (raw only)
+  std::vector<std::uint8_t> b;
+  put_32le(b, 0);
+  put_32le(b, 3);
+  const std::size_t data_at = 8 + 3 * 12;
+  auto entry = [&](std::uint16_t tag, DirectoryType t, std::uint32_t n, std::uint32_t v)
+  {
+    put_16le(b, tag);
+    put_16le(b, static_cast<std::uint16_t>(t));
+    put_32le(b, n);
+    put_32le(b, v);
+  };
+  entry(0x20, DirectoryType::UInt16, 4, std::uint32_t(data_at));
+  entry(0x01, DirectoryType::UInt8, 3, 0x00102008); // 08 20 10, unsorted
+  entry(0x30, DirectoryType::String, 2, 0x00000041);
+  for (std::uint16_t v : {5500, 3200, 6500, 3200})
+    put_16le(b, v);
+
+  CamCanSetInfo5 info;
+  info.decode(b);
+  REQUIRE(info.entries.size() == 3);
+  CHECK(info.entries[0].tag == 0x01); // sorted by tag
+  const auto *e1 = info.find(0x01);
+  REQUIRE(e1);
+  CHECK(e1->values == std::vector<std::int64_t>{0x08, 0x10, 0x20});
+  const auto *e2 = info.find(0x20);
+  REQUIRE(e2);
+  CHECK(e2->values == std::vector<std::int64_t>{3200, 5500, 6500}); // deduplicated
+  const auto *e3 = info.find(0x30);
+  REQUIRE(e3);
+  CHECK(e3->values.empty());
+  CHECK(e3->raw.size() == 2);
+  CHECK(info.find(0x02) == nullptr);
+
+  b.resize(20); // directory cut short
+  CHECK_THROWS(info.decode(b));
+}
@@ -0,0 +1,139 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_version_macros.hpp>
+
+static_assert(CATCH_VERSION_MAJOR >= 3, "Catch2 v3 required");
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <utils/shm_ring.h>
+
+static std::string ring_name(const char *tag)
+{
+  return "/sigma_test_" + std::string(tag) + "_" + std::to_string(getpid());
+}
+
+// every byte is the low byte of the seq, so a torn copy shows up
+static std::vector<std::uint8_t> frame(std::uint64_t seq, std::size_t n)
+{
+  return std::vector<std::uint8_t>(n, std::uint8_t(seq));
+}
+
+TEST_CASE("ShmRing hands the newest frame to a reader in place")
+{
+  const auto name = ring_name("basic");
+  CHECK_THROWS(ShmRingReader(name));
+
+  ShmRingWriter w(name, 3, 4096);
+  ShmRingReader r(name);
+  CHECK(r.slots() == 3);
+  CHECK(r.writer_alive());
+
+  ShmFrame f;
+  CHECK_FALSE(r.latest(f));
+  CHECK(r.latest_seq() == 0);
+
+  const auto a = frame(1, 1000);
+  CHECK(w.publish(a.data(), a.size()) == 1);
+  REQUIRE(r.latest(f));
+  CHECK(f.seq == 1);
+  CHECK(f.size == 1000);
+  CHECK(std::all_of(f.data, f.data + f.size, [](std::uint8_t b)
+                    { return b == 1; }));
+  CHECK(f.captured_ns > 0);
+  CHECK(r.still_valid(f));
+
+  // the slot is reused three frames later
+  for (std::uint64_t s = 2; s <= 3; ++s)
+  {
+    const auto b = frame(s, 500);
+    w.publish(b.data(), b.size());
+  }
+  CHECK(r.still_valid(f));
+  const auto d = frame(4, 10);
+  w.publish(d.data(), d.size());
+  CHECK_FALSE(r.still_valid(f));
+
+  std::vector<std::uint8_t> copy;
+  ShmFrame meta;
+  REQUIRE(r.copy_latest(copy, &meta));
+  CHECK(meta.seq == 4);
+  CHECK(copy == d);
+
+  const std::vector<std::uint8_t> big(4097, 0);
+  CHECK(w.publish(big.data(), big.size()) == 0);
+  CHECK(r.latest_seq() == 4);
+
+  REQUIRE(r.wait_next(3, f, std::chrono::milliseconds(0)));
+  CHECK(f.seq == 4);
+  CHECK_FALSE(r.wait_next(4, f, std::chrono::milliseconds(5)));
+}
+
+TEST_CASE("ShmRingWriter replaces only a segment whose writer has exited")
+{
+  const auto name = ring_name("owner");
+  {
+    ShmRingWriter w(name, 2, 64);
+    CHECK_THROWS(ShmRingWriter(name, 2, 64));
+    ShmRingReader r(name); // the live writer's segment is untouched
+    CHECK(r.writer_alive());
+  }
+
+  // a writer killed before its destructor leaves the segment behind
+  const pid_t child = fork();
+  REQUIRE(child >= 0);
+  if (child == 0)
+  {
+    new ShmRingWriter(name, 2, 64);
+    _exit(0);
+  }
+  int status = 0;
+  REQUIRE(waitpid(child, &status, 0) == child);
+  CHECK_FALSE(ShmRingReader(name).writer_alive());
+
+  ShmRingWriter w(name, 3, 64);
+  ShmRingReader r(name);
+  CHECK(r.slots() == 3);
+  CHECK(r.writer_alive());
+}
+
+TEST_CASE("ShmRing readers never see a torn frame")
+{
+  const auto name = ring_name("torn");
+  ShmRingWriter w(name, 2, 64 * 1024);
+  ShmRingReader r(name);
+
+  std::atomic<bool> done{false};
+  std::thread writer([&]
+                     {
+                       for (std::uint64_t s = 1; s <= 20000; ++s)
+                       {
+                         const auto f = frame(s, 1024 + (s % 32) * 1024);
+                         w.publish(f.data(), f.size());
+                       }
+                       done = true; });
+
+  std::vector<std::uint8_t> copy;
+  ShmFrame meta;
+  std::uint64_t last = 0, reads = 0;
+  while (!done)
+  {
+    if (!r.copy_latest(copy, &meta))
+      continue;
+    ++reads;
+    REQUIRE(copy.size() == 1024 + (meta.seq % 32) * 1024);
+    REQUIRE(std::all_of(copy.begin(), copy.end(), [&](std::uint8_t b)
+                        { return b == std::uint8_t(meta.seq); }));
+    REQUIRE(meta.seq >= last);
+    last = meta.seq;
+  }
+  writer.join();
+  CHECK(reads > 0);
+  REQUIRE(r.copy_latest(copy, &meta));
+  CHECK(meta.seq == 20000);
+}
@@ -0,0 +1,80 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_version_macros.hpp>
+
+static_assert(CATCH_VERSION_MAJOR >= 3, "Catch2 v3 required");
+
+#include <set>
+#include <string>
+#include <thread>
+#include <utils/trace.h>
+
+TEST_CASE("TraceScope records nothing while tracing is off")
+{
+  trace_enable(false);
+  trace_clear();
+  {
+    TraceScope ts("idle", "test");
+    REQUIRE_FALSE(ts);
+    ts.arg("n", 1);
+  }
+  REQUIRE(trace_event_count() == 0);
+}
+
+TEST_CASE("trace_json exports complete events per thread")
+{
+  trace_clear();
+  trace_enable(true);
+  trace_thread_name("main");
+  {
+    TraceScope ts("transact", "ptp");
+    REQUIRE(ts);
+    ts.arg("opcode", 0x1001);
+    ts.arg("bytes_in", 42);
+  }
+  std::thread([]
+              {
+    trace_thread_name("worker \"1\"");
+    TRACE_SCOPE("chunk_write", "download"); })
+      .join();
+  trace_enable(false);
+
+  REQUIRE(trace_event_count() == 2);
+  const std::string json = trace_json();
+  CHECK(json.find("\"traceEvents\"") != std::string::npos);
+  CHECK(json.find("\"name\":\"transact\",\"cat\":\"ptp\"") != std::string::npos);
+  CHECK(json.find("\"args\":{\"opcode\":4097,\"bytes_in\":42}") != std::string::npos);
+  CHECK(json.find("\"name\":\"chunk_write\"") != std::string::npos);
+  CHECK(json.find("worker \\\"1\\\"") != std::string::npos);
+
+  trace_clear();
+  REQUIRE(trace_event_count() == 0);
+}
+
+TEST_CASE("exited threads hand their buffer to the next one")
+{
+  trace_clear();
+  trace_enable(true);
+  std::thread([]
+              { TRACE_SCOPE("first", "test"); })
+      .join();
+  const std::size_t buffers = trace_buffer_count();
+  for (int i = 0; i < 20; ++i)
+    std::thread([]
+                { TRACE_SCOPE("writer", "download"); })
+        .join();
+  trace_enable(false);
+
+  CHECK(trace_buffer_count() == buffers);
+  REQUIRE(trace_event_count() == 21);
+  // events keep the id of the thread that recorded them
+  const std::string json = trace_json();
+  const std::string key = "\"name\":\"writer\",\"cat\":\"download\",\"pid\":1,\"tid\":";
+  std::set<std::string> tids;
+  for (auto at = json.find(key); at != std::string::npos; at = json.find(key, at + 1))
+  {
+    const auto from = at + key.size();
+    tids.insert(json.substr(from, json.find(',', from) - from));
+  }
+  CHECK(tids.size() == 20);
+  trace_clear();
+}